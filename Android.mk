@@ -21,10 +21,27 @@ LOCAL_SRC_FILES := \
 	truncate.c \
 	steamext.c \
 	roots.c \
+	partitions.c \
+	fsprobe.c \
+	luks.c \
+	loopdev.c \
+	format.c \
+	sysconv.c \
+	iotune.c \
+	tweaks.c \
+	initd.c \
+	coldplug.c \
+	modload.c \
+	rcedit.c \
+	detectcache.c \
+	propwait.c \
+	bootplan.c \
 	ui.c \
 	verifier.c \
 	init.c \
 	system.c \
+	native.c \
+	trace.c \
 	device.c \
 	config.c \
 	oem.c
@@ -157,7 +174,7 @@ LOCAL_C_INCLUDES := bootable/steam
 
 LOCAL_STATIC_LIBRARIES += libsteam_busybox libsteam_clearsilverregex libsteam_mkyaffs2image libsteam_unyaffs libsteam_erase_image libsteam_dump_image libsteam_flash_image libsteam_mtdutils
 LOCAL_STATIC_LIBRARIES += libsteam_amend
-LOCAL_STATIC_LIBRARIES += libsteam_minzip libunz libsteam_mtdutils libsteam_mmcutils libmincrypt
+LOCAL_STATIC_LIBRARIES += libsteam_minzip libunz libz libsteam_mtdutils libsteam_mmcutils libmincrypt
 LOCAL_STATIC_LIBRARIES += libsteam_minui libpixelflinger_static libpng libcutils
 LOCAL_STATIC_LIBRARIES += libstdc++ libc
 
@@ -174,6 +191,14 @@ LOCAL_STATIC_LIBRARIES := libmincrypt libcutils libstdc++ libc
 
 include $(BUILD_EXECUTABLE)
 
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := rcedit_test.c rcedit.c
+LOCAL_MODULE := steam_rcedit_test
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_HOST_EXECUTABLE)
+
 commands_recovery_local_path :=
 
 endif   # TARGET_ARCH == arm
@@ -0,0 +1,72 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "bootplan.h"
+#include "config.h"
+#include "ui.h"
+
+typedef struct {
+  long long system_mtime, system_size;
+  long long sbin_mtime, sbin_size;
+} BootPlanKey;
+
+static int plan_key(BootPlanKey* key)
+{
+  struct stat s;
+  if (stat(CONFIG_SYSTEM,&s)) return -1;
+  key->system_mtime = s.st_mtime;
+  key->system_size = s.st_size;
+  if (stat(CONFIG_SBIN,&s)) return -1;
+  key->sbin_mtime = s.st_mtime;
+  key->sbin_size = s.st_size;
+  return 0;
+}
+
+int bootplan_load(BootPlan* plan)
+{
+  char version[128];
+  BootPlanKey key, saved;
+  FILE* f;
+  int ok = 0;
+  if (plan_key(&key)) return -1;
+  f = fopen(BOOTPLAN_FILE,"r");
+  if (!f) return -1;
+  if (fgets(version,sizeof(version),f) && strcmp(version,EXPAND(RECOVERY_VERSION)"\n")==0 &&
+      fscanf(f,"%lld %lld %lld %lld %d %d",&saved.system_mtime,&saved.system_size,&saved.sbin_mtime,&saved.sbin_size,&plan->system_type,&plan->efs)==6) {
+    ok = memcmp(&key,&saved,sizeof(key))==0;
+  }
+  fclose(f);
+  return ok ? 0 : -1;
+}
+
+int bootplan_save(const BootPlan* plan)
+{
+  BootPlanKey key;
+  FILE* f;
+  if (plan_key(&key)) return -1;
+  f = fopen(BOOTPLAN_FILE ".tmp","w");
+  if (!f) return -1;
+  fprintf(f,"%s\n%lld %lld %lld %lld %d %d\n",EXPAND(RECOVERY_VERSION),key.system_mtime,key.system_size,key.sbin_mtime,key.sbin_size,plan->system_type,plan->efs);
+  if (fclose(f) || rename(BOOTPLAN_FILE ".tmp",BOOTPLAN_FILE)) {
+    unlink(BOOTPLAN_FILE ".tmp");
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef __STEAM_BOOTPLAN_H
+#define __STEAM_BOOTPLAN_H
+
+// decisions of the last complete boot
+//
+// The plan is saved after a boot that left nothing pending (no version
+// mismatch, upgrade or conversion), keyed on the size and modification time
+// of the rw and ro configs and on the Steam version of the initramfs. While
+// none of these change, the version check and the conversion checks can be
+// skipped. Any set_conf changes the rw config, so it invalidates the plan
+
+#define BOOTPLAN_FILE "/system/etc/steam.bootplan"
+
+typedef struct {
+  int system_type;      // fs.system.type
+  int efs;              // 1 if /system/efs is used in place of the efs partition
+} BootPlan;
+
+// 0 if a plan matching the current configs was loaded
+int bootplan_load(BootPlan* plan);
+// saves the plan with the current state of the configs
+int bootplan_save(const BootPlan* plan);
+
+#endif
@@ -0,0 +1,133 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+
+#include "coldplug.h"
+
+typedef struct {
+  const char* cls;
+  const char* dir;     // under devroot, "" for devroot itself
+  mode_t mode;         // type and permissions of the nodes
+} ColdplugClass;
+
+// everything is root only, except the nodes in g_public
+static const ColdplugClass g_classes[] = {
+  { "block", "block", S_IFBLK|0600 },
+  { "graphics", "graphics", S_IFCHR|0600 },
+  { "input", "input", S_IFCHR|0600 },
+  { "sound", "snd", S_IFCHR|0600 },
+  { NULL, NULL, S_IFCHR|0600 }
+};
+
+// the nodes anyone may use
+static const char* g_public[] = { "null", "zero", "full", "random", "urandom", "tty", "ptmx", NULL };
+
+// reads major:minor from the dev file of a sysfs device directory
+static int read_dev(const char* sysdir, dev_t* dev)
+{
+  char path[PATH_MAX];
+  char buf[32];
+  unsigned int major, minor;
+  int fd, len;
+  snprintf(path,sizeof(path),"%s/dev",sysdir);
+  fd = open(path,O_RDONLY);
+  if (fd<0) return -1;
+  len = read(fd,buf,sizeof(buf)-1);
+  close(fd);
+  if (len<=0) return -1;
+  buf[len] = '\0';
+  if (sscanf(buf,"%u:%u",&major,&minor)!=2) return -1;
+  *dev = makedev(major,minor);
+  return 0;
+}
+
+static int make_node(const char* devdir, const char* name, mode_t mode, dev_t dev)
+{
+  char path[PATH_MAX];
+  // names with '!' stand for subdirectories, none of which we need
+  if (strchr(name,'!')) return 0;
+  snprintf(path,sizeof(path),"%s/%s",devdir,name);
+  if (S_ISCHR(mode)) {
+    const char** p;
+    for (p = g_public; *p; p++) if (strcmp(*p,name)==0) mode = S_IFCHR|0666;
+  }
+  if (mknod(path,mode,dev)) return 0;
+  // mknod is subject to the umask
+  chmod(path,mode&07777);
+  return 1;
+}
+
+// every device directory in sysdir. With partitions set the subdirectories
+// of each device are checked too, which is where old kernels keep them
+static int walk_class(const char* sysdir, const char* devdir, mode_t mode, int partitions)
+{
+  DIR* d = opendir(sysdir);
+  struct dirent* entry;
+  int count = 0;
+  if (!d) return 0;
+  mkdir(devdir,0755);
+  while ((entry = readdir(d))) {
+    char path[PATH_MAX];
+    dev_t dev;
+    if (entry->d_name[0]=='.') continue;
+    snprintf(path,sizeof(path),"%s/%s",sysdir,entry->d_name);
+    if (read_dev(path,&dev)) continue;
+    count += make_node(devdir,entry->d_name,mode,dev);
+    if (partitions) count += walk_class(path,devdir,mode,0);
+  }
+  closedir(d);
+  return count;
+}
+
+int coldplug(const char* devroot)
+{
+  DIR* d = opendir("/sys/class");
+  struct dirent* entry;
+  struct stat s;
+  int count = 0;
+  mkdir(devroot,0755);
+  if (d) {
+    while ((entry = readdir(d))) {
+      char sysdir[PATH_MAX];
+      char devdir[PATH_MAX];
+      const ColdplugClass* c;
+      if (entry->d_name[0]=='.') continue;
+      for (c = g_classes; c->cls; c++) if (strcmp(c->cls,entry->d_name)==0) break;
+      snprintf(sysdir,sizeof(sysdir),"/sys/class/%s",entry->d_name);
+      if (c->cls && c->dir[0]) snprintf(devdir,sizeof(devdir),"%s/%s",devroot,c->dir);
+      else snprintf(devdir,sizeof(devdir),"%s",devroot);
+      count += walk_class(sysdir,devdir,c->mode,0);
+    }
+    closedir(d);
+  }
+  // deprecated sysfs layout: block devices only in /sys/block, with the
+  // partitions below the disks
+  if (stat("/sys/class/block",&s)) {
+    char devdir[PATH_MAX];
+    snprintf(devdir,sizeof(devdir),"%s/block",devroot);
+    count += walk_class("/sys/block",devdir,S_IFBLK|0600,1);
+  }
+  return count;
+}
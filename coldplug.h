@@ -0,0 +1,12 @@
+#ifndef __STEAM_COLDPLUG_H
+#define __STEAM_COLDPLUG_H
+
+// creates the device nodes of every device the kernel already knows about,
+// from the dev files under /sys/class (and /sys/block on old sysfs layouts).
+// Block devices go to devroot/block, framebuffers to devroot/graphics, input
+// devices to devroot/input, sound to devroot/snd and everything else to
+// devroot. The nodes are root only, except the likes of null, zero and tty.
+// Existing nodes are left alone. Returns the number of nodes created
+int coldplug(const char* devroot);
+
+#endif
@@ -195,8 +195,21 @@ int set_conf(const char* key, const char* value)
 int get_capability(const char* key, char* value)
 {
   if (strstr(key,"fs.support.")==key) {
-    char* fsname = key+strlen("fs.support.");
-    if (call_busybox("grep",fsname,"/proc/filesystems",NULL)==0) {
+    const char* fsname = key+strlen("fs.support.");
+    char line[128];
+    int found = 0;
+    FILE* f = fopen("/proc/filesystems","r");
+    if (f) {
+      // lines are "nodev\tname" or "\tname"
+      while (!found && fgets(line,sizeof(line),f)) {
+        char* name = strrchr(line,'\t');
+        name = name ? name+1 : line;
+        name[strcspn(name,"\n")] = '\0';
+        if (strcmp(name,fsname)==0) found = 1;
+      }
+      fclose(f);
+    }
+    if (found) {
       if (value) {
         strcpy(value,"1");
       }
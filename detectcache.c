@@ -0,0 +1,194 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "detectcache.h"
+#include "device.h"
+#include "fsprobe.h"
+#include "native.h"
+#include "locale.h"
+
+#define DETECT_CACHE_MOUNT "/res/.tmp_detectcache"
+#define DETECT_CACHE_FILE "/steam/detect.cache"
+#define DETECT_CACHE_MAX 8
+
+typedef struct {
+  char device[64];
+  char uuid[40];
+  unsigned long long size;
+  int fstype;
+} DetectCacheEntry;
+
+static DetectCacheEntry g_entries[DETECT_CACHE_MAX];
+static int g_num_entries = 0;
+static int g_loaded = 0;
+// where the cache device is mounted, and whether we mounted it
+static char g_dir[256];
+static int g_mounted = 0;
+
+// the mount point of the device if it's mounted already
+static int find_mount(const char* device, char* dir)
+{
+  struct stat d;
+  char line[1024];
+  int found = 0;
+  FILE* f;
+  if (stat(device,&d) || !S_ISBLK(d.st_mode)) return 0;
+  f = fopen("/proc/mounts","r");
+  if (!f) return 0;
+  while (!found && fgets(line,sizeof(line),f)) {
+    char source[256];
+    struct stat s;
+    if (sscanf(line,"%255s %255s",source,dir)!=2) continue;
+    found = stat(source,&s)==0 && S_ISBLK(s.st_mode) && s.st_rdev==d.st_rdev;
+  }
+  fclose(f);
+  return found;
+}
+
+static int cache_mount(int rw)
+{
+  // a second mount of the sdcard would fail with EBUSY
+  if (find_mount(DETECT_CACHE_BLOCK_NAME,g_dir)) return 0;
+  strcpy(g_dir,DETECT_CACHE_MOUNT);
+  mkdir(DETECT_CACHE_MOUNT,0700);
+  if (native_mount(DETECT_CACHE_FSTYPE,rw ? "utf8" : "ro,utf8",DETECT_CACHE_BLOCK_NAME,DETECT_CACHE_MOUNT)) {
+    printf(DETECT_CACHE_NO_MOUNT,DETECT_CACHE_BLOCK_NAME,strerror(errno));
+    rmdir(DETECT_CACHE_MOUNT);
+    return -1;
+  }
+  g_mounted = 1;
+  return 0;
+}
+
+static void cache_umount()
+{
+  if (!g_mounted) return;
+  native_umount(DETECT_CACHE_MOUNT,0);
+  rmdir(DETECT_CACHE_MOUNT);
+  g_mounted = 0;
+}
+
+static void cache_load()
+{
+  char line[256];
+  char path[PATH_MAX];
+  FILE* f;
+  if (g_loaded) return;
+  g_loaded = 1;
+  if (cache_mount(0)) return;
+  snprintf(path,sizeof(path),"%s" DETECT_CACHE_FILE,g_dir);
+  f = fopen(path,"r");
+  if (f) {
+    while (g_num_entries<DETECT_CACHE_MAX && fgets(line,sizeof(line),f)) {
+      DetectCacheEntry* e = &g_entries[g_num_entries];
+      if (sscanf(line,"%63s %39s %llu %d",e->device,e->uuid,&e->size,&e->fstype)==4) g_num_entries++;
+    }
+    fclose(f);
+  }
+  cache_umount();
+}
+
+static void cache_save()
+{
+  char path[PATH_MAX];
+  char tmp[PATH_MAX];
+  FILE* f;
+  int i;
+  if (cache_mount(1)) return;
+  snprintf(path,sizeof(path),"%s/steam",g_dir);
+  mkdir(path,0755);
+  snprintf(path,sizeof(path),"%s" DETECT_CACHE_FILE,g_dir);
+  snprintf(tmp,sizeof(tmp),"%s.tmp",path);
+  f = fopen(tmp,"w");
+  if (f) {
+    for (i=0; i<g_num_entries; i++) {
+      fprintf(f,"%s %s %llu %d\n",g_entries[i].device,g_entries[i].uuid,g_entries[i].size,g_entries[i].fstype);
+    }
+    if (fclose(f)==0) rename(tmp,path);
+  } else {
+    printf(DETECT_CACHE_NO_SAVE,path,strerror(errno));
+  }
+  cache_umount();
+}
+
+static int find_entry(const char* device)
+{
+  int i;
+  for (i=0; i<g_num_entries; i++) {
+    if (strcmp(g_entries[i].device,device)==0) return i;
+  }
+  return -1;
+}
+
+// the superblock has to identify the filesystem, otherwise it can't be cached
+static int probe(const char* device, FsProbeInfo* info)
+{
+  int type = fsprobe(device,info);
+  if (type<=0 || type==TYPE_CRYPT || !info->uuid[0] || strchr(info->uuid,' ')) return 0;
+  return type;
+}
+
+int detect_cache_lookup(const char* device)
+{
+  FsProbeInfo info;
+  int type = probe(device,&info);
+  int i;
+  if (!type) return 0;
+  cache_load();
+  i = find_entry(device);
+  if (i<0) return 0;
+  if (strcmp(g_entries[i].uuid,info.uuid) || g_entries[i].size!=info.size) return 0;
+  // the base filesystem must still be the same
+  if ((g_entries[i].fstype&TYPE_FSTYPE_MASK)!=type) return 0;
+  return g_entries[i].fstype;
+}
+
+void detect_cache_store(const char* device, int fstype)
+{
+  FsProbeInfo info;
+  int type = probe(device,&info);
+  int i;
+  if (!type || (fstype&(TYPE_CRYPT|TYPE_RFS_BAD)) || (fstype&TYPE_FSTYPE_MASK)!=type) return;
+  if (strlen(device)>=sizeof(g_entries[0].device)) return;
+  cache_load();
+  i = find_entry(device);
+  if (i>=0 && strcmp(g_entries[i].uuid,info.uuid)==0 && g_entries[i].size==info.size && g_entries[i].fstype==fstype) return;
+  if (i<0) {
+    if (g_num_entries==DETECT_CACHE_MAX) return;
+    i = g_num_entries++;
+  }
+  strcpy(g_entries[i].device,device);
+  strcpy(g_entries[i].uuid,info.uuid);
+  g_entries[i].size = info.size;
+  g_entries[i].fstype = fstype;
+  cache_save();
+}
+
+void detect_cache_forget(const char* device)
+{
+  int i;
+  cache_load();
+  i = find_entry(device);
+  if (i<0) return;
+  g_entries[i] = g_entries[--g_num_entries];
+  cache_save();
+}
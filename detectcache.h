@@ -0,0 +1,19 @@
+#ifndef __STEAM_DETECTCACHE_H
+#define __STEAM_DETECTCACHE_H
+
+// filesystem detection results kept across boots
+//
+// The results of filesystem_check are saved per block device together with
+// the uuid and size from the superblock, on a partition that never needs
+// detection (DETECT_CACHE_BLOCK_NAME of the device). A cached type is only
+// returned while the superblock still matches, so a reformat invalidates it
+
+// returns the cached type of the device, 0 if there's none or it's stale
+int detect_cache_lookup(const char* device);
+// saves the detected type of the device. Crypted and inconsistent results
+// are not cached
+void detect_cache_store(const char* device, int fstype);
+// drops the entry of the device, for changes the superblock doesn't show
+void detect_cache_forget(const char* device);
+
+#endif
@@ -22,6 +22,7 @@
 #include "locale.h"
 #include "roots.h"
 #include "config.h"
+#include "rcedit.h"
 #include "../steam_main/steam.h"
 
 char* MENU_HEADERS[] = { NULL };
@@ -48,10 +49,28 @@ const char g_auto[] = "@\0g_auto";
 #include "device/sgs-i9000.c"
 #endif
 
+// the same partitions on every board, only the block names come from the board
+const PartitionDesc g_partition_table[] = {
+    { "system", "SYSTEM:", "/system", "/tmp/sys", SYSTEM_BLOCK_NAME, "loop4", 0, "-F 32 -S 4096 -s 1", WORKLOAD_READ_MOSTLY },
+    { "cache", "CACHE:", "/cache", NULL, CACHE_BLOCK_NAME, "loop1", BLOCK_CACHE_LOOP_SIZE, "-F 16 -S 4096 -s 1", WORKLOAD_LARGE_FILES },
+    { "data", "DATA:", "/data", NULL, DATA_BLOCK_NAME, "loop2", BLOCK_DATA_LOOP_SIZE, "-F 32 -S 4096 -s 4", WORKLOAD_SMALL_FILES },
+#ifdef HAS_DATADATA
+    { "dbdata", "DATADATA:", "/dbdata", NULL, DBDATA_BLOCK_NAME, "loop3", BLOCK_DBDATA_LOOP_SIZE, "-F 16 -S 4096 -s 1", WORKLOAD_SMALL_FILES },
+#endif
+#ifdef BOARD_HAS_PHONE_CONTROLLER
+    { "efs", "EFS:", "/efs", NULL, EFS_BLOCK_NAME, "loop5", 0, "", WORKLOAD_READ_MOSTLY },
+#endif
+};
+#define NUM_PARTITION_DESCS (sizeof(g_partition_table) / sizeof(g_partition_table[0]))
+
 int get_num_roots() {
   return NUM_ROOTS;
 }
 
+int get_num_partition_descs() {
+  return NUM_PARTITION_DESCS;
+}
+
 int device_recovery_start() {
     return 0;
 }
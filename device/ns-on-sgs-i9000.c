@@ -56,31 +56,30 @@ string mmcs[MMC_COUNT][3] = {
   { "format sd-ext", "SDEXT:" }
 };
 
+static const RcEdit g_vold_edits[] = {
+  { RC_REPLACE_LINE, "dev_mount sdcard", "dev_mount sdcard /mnt/sdcard 1 /devices/platform/s3c-sdhci.0/mmc_host/mmc0/mmc0:0001/block/mmcblk0" },
+};
+
+static const RcEdit g_recovery_init_edits[] = {
+  // TODO: hardcoding this _IS_ bad
+  { RC_DELETE_LINES, NULL, NULL, 306, 411 },
+  { RC_ADD_SECTION, "service console", "service recovery /sbin/steam recovery\n    user root\n    group root\n    oneshot\n" },
+  { RC_COMMENT, "mount yaffs2 mtd@system /system ro remount", NULL },
+};
+
+static const RcEdit g_init_edits[] = {
+  { RC_INSERT_AFTER, "export BOOTCLASSPATH", "    class_start earlyinitclass" },
+  { RC_ADD_SECTION, "service console", "service earlyinit /sbin/steam earlyinit\n    user root\n    group root\n    oneshot\n    class earlyinitclass\n" },
+  { RC_ADD_SECTION, "service console", "service postinit /sbin/steam postinit\n    user root\n    group root\n    oneshot\n" },
+};
+
 void fix_init(int isrecovery)
 {
-  // fix vold.conf
-  call_busybox("sed","-i","s|dev_mount sdcard.*|dev_mount sdcard /mnt/sdcard 1 /devices/platform/s3c-sdhci.0/mmc_host/mmc0/mmc0:0001/block/mmcblk0|","/system/etc/vold.fstab",NULL);
+  rc_edit_file("/system/etc/vold.fstab",g_vold_edits,sizeof(g_vold_edits)/sizeof(g_vold_edits[0]));
 
   if (isrecovery) {
-    // TODO: hardcoding this _IS_ bad
-    call_busybox("sed","-i","306,411d","init.rc",NULL);
-    call_busybox("sed","-i","/service console/ i\\\nservice recovery /sbin/steam recovery","init.rc",NULL);
-    call_busybox("sed","-i","/service console/ i\\\n    user root","init.rc",NULL);
-    call_busybox("sed","-i","/service console/ i\\\n    group root","init.rc",NULL);
-    call_busybox("sed","-i","/service console/ i\\\n    oneshot\\\n\\\n","init.rc",NULL);
-    call_busybox("sed","-i","s|mount yaffs2 mtd@system /system ro remount|#|","init.rc",NULL);
+    rc_edit_file("init.rc",g_recovery_init_edits,sizeof(g_recovery_init_edits)/sizeof(g_recovery_init_edits[0]));
   } else {
-    call_busybox("sed","-i","/export BOOTCLASSPATH/ a\\\n    class_start earlyinitclass","init.rc",NULL);
-
-    call_busybox("sed","-i","/service console/ i\\\nservice earlyinit /sbin/steam earlyinit","init.rc",NULL);
-    call_busybox("sed","-i","/service console/ i\\\n    user root","init.rc",NULL);
-    call_busybox("sed","-i","/service console/ i\\\n    group root","init.rc",NULL);
-    call_busybox("sed","-i","/service console/ i\\\n    oneshot","init.rc",NULL);
-    call_busybox("sed","-i","/service console/ i\\\n    class earlyinitclass\\\n\\\n","init.rc",NULL);
-
-    call_busybox("sed","-i","/service console/ i\\\nservice postinit /sbin/steam postinit","init.rc",NULL);
-    call_busybox("sed","-i","/service console/ i\\\n    user root","init.rc",NULL);
-    call_busybox("sed","-i","/service console/ i\\\n    group root","init.rc",NULL);
-    call_busybox("sed","-i","/service console/ i\\\n    oneshot\\\n\\\n","init.rc",NULL);
+    rc_edit_file("init.rc",g_init_edits,sizeof(g_init_edits)/sizeof(g_init_edits[0]));
   }
 }
@@ -11,6 +11,10 @@
 #define SDCARD_BLOCK_NAME "/dev/block/mmcblk0p1"
 #define SDCARD2_BLOCK_NAME "/dev/block/mmcblk1p1"
 
+// the filesystem detection cache is kept here, as its type is always known
+#define DETECT_CACHE_BLOCK_NAME SDCARD_BLOCK_NAME
+#define DETECT_CACHE_FSTYPE "vfat"
+
 // for the partition reformatter
 #define SDCARD_EXT_BLOCK_NAME "/dev/block/mmcblk1X"
 
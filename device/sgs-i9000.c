@@ -56,31 +56,36 @@ string mmcs[MMC_COUNT][3] = {
   { "format sd-ext", "SDEXT:" }
 };
 
-void fix_init(int isrecovery)
-{
-  char value[VALUE_MAX_LENGTH];
-
 // TODO: This is designed for an unmodified initramfs, and might break if it's already modified
-  call_busybox("sed","-i","/export TMPDIR/ a\\\n    class_start earlyinitclass","init.rc",NULL);
-  call_busybox("sed","-i","s/mount rfs/#mount rfs/","init.rc",NULL);
-  call_busybox("sed","-i","s|/system/bin/playlogos1|/sbin/steam postinit|g","init.rc",NULL);
+static const RcEdit g_init_edits[] = {
+  { RC_INSERT_AFTER, "export TMPDIR", "    class_start earlyinitclass" },
+  { RC_COMMENT, "mount rfs", NULL },
+  { RC_REPLACE, "/system/bin/playlogos1", "/sbin/steam postinit" },
+  { RC_ADD_SECTION, "service playlogos1", "service earlyinit /sbin/steam earlyinit\n    user root\n    group root\n    oneshot\n    class earlyinitclass\n" },
+};
 
-  if (get_conf("init.bootanim",value) && strcmp(value,"2")==0) {
-     call_busybox("sed","-i","/service playlogos1/ i\\\nservice bootanim /system/bin/bootanimation","init.rc",NULL);
-     call_busybox("sed","-i","/service playlogos1/ i\\\n    user graphics","init.rc",NULL);
-     call_busybox("sed","-i","/service playlogos1/ i\\\n    group graphics","init.rc",NULL);
-     call_busybox("sed","-i","/service playlogos1/ i\\\n    oneshot","init.rc",NULL);
-     call_busybox("sed","-i","/service playlogos1/ i\\\n    disabled","init.rc",NULL);
-     call_busybox("sed","-i","/service playlogos1/ i\\\n    class nostart\\\n\\\n","init.rc",NULL);
-   }
-   call_busybox("sed","-i","/service playlogos1/ i\\\nservice earlyinit /sbin/steam earlyinit","init.rc",NULL);
-   call_busybox("sed","-i","/service playlogos1/ i\\\n    user root","init.rc",NULL);
-   call_busybox("sed","-i","/service playlogos1/ i\\\n    group root","init.rc",NULL);
-   call_busybox("sed","-i","/service playlogos1/ i\\\n    oneshot","init.rc",NULL);
-   call_busybox("sed","-i","/service playlogos1/ i\\\n    class earlyinitclass\\\n\\\n","init.rc",NULL);
+static const RcEdit g_bootanim_edits[] = {
+  { RC_ADD_SECTION, "service earlyinit", "service bootanim /system/bin/bootanimation\n    user graphics\n    group graphics\n    oneshot\n    disabled\n    class nostart\n" },
+};
 
-   call_busybox("sed","-i","s|mount tmpfs nodev /tmp||","recovery.rc",NULL);
-   call_busybox("sed","-i","s/mount rfs/#mount rfs/","recovery.rc",NULL);
-   call_busybox("sed","-i","s|/sbin/adbd recovery|/sbin/adbd|","recovery.rc",NULL);
-   call_busybox("sed","-i","s|/system/bin/recovery|/sbin/recovery|","recovery.rc",NULL);
+static const RcEdit g_recovery_edits[] = {
+  { RC_DELETE, "mount tmpfs nodev /tmp", NULL },
+  { RC_COMMENT, "mount rfs", NULL },
+  { RC_REPLACE, "/sbin/adbd recovery", "/sbin/adbd" },
+  { RC_REPLACE, "/system/bin/recovery", "/sbin/recovery" },
+};
+
+void fix_init(int isrecovery)
+{
+  char value[VALUE_MAX_LENGTH];
+  RcFile* rc = rc_load("init.rc");
+  if (rc) {
+    rc_apply(rc,g_init_edits,sizeof(g_init_edits)/sizeof(g_init_edits[0]));
+    if (get_conf("init.bootanim",value) && strcmp(value,"2")==0) {
+      rc_apply(rc,g_bootanim_edits,sizeof(g_bootanim_edits)/sizeof(g_bootanim_edits[0]));
+    }
+    rc_save(rc,"init.rc");
+    rc_free(rc);
+  }
+  rc_edit_file("recovery.rc",g_recovery_edits,sizeof(g_recovery_edits)/sizeof(g_recovery_edits[0]));
 }
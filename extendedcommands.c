@@ -44,6 +44,8 @@
 
 #include "extendedcommands.h"
 #include "nandroid.h"
+#include "system.h"
+#include "trace.h"
 
 int signature_check_enabled = 1;
 int script_assert_enabled = 1;
@@ -807,6 +809,7 @@ void show_advanced_menu()
                             ADV_MENU_KEYTEST,
                             ADV_MENU_SCREENTEST,
                             ADV_MENU_SECRETTEST,
+                            ADV_MENU_BOOTPROFILE,
 #ifndef BOARD_HAS_SMALL_RECOVERY
                             ADV_MENU_PARTITION,
                             ADV_MENU_FIXPERM,
@@ -899,6 +902,18 @@ void show_advanced_menu()
                 break;             
             }
             case 6:
+            {
+                struct stat st;
+                // the last full boot if it was saved, this boot otherwise
+                ensure_root_path_mounted("CACHE:");
+                ui_set_show_text(1);
+                if (stat(BOOT_PROFILE_FILE, &st) == 0)
+                    show_timeline(BOOT_PROFILE_FILE, 20000, ui_print);
+                else
+                    show_timeline(SYSTEM_TRACE_FILE, 20000, ui_print);
+                break;
+            }
+            case 7:
             {
                 static char* ext_sizes[] = { "128M",
                                              "256M",
@@ -944,7 +959,7 @@ void show_advanced_menu()
                     ui_print("An error occured while partitioning your SD Card. Please see /tmp/recovery.log for more details.\n");
                 break;
             }
-            case 7:
+            case 8:
             {
                 ensure_root_path_mounted("SYSTEM:");
                 ensure_root_path_mounted("DATA:");
@@ -959,7 +974,7 @@ void show_advanced_menu()
 
 void write_fstab_root(char *root_path, FILE *file)
 {
-    RootInfo *info = get_root_info_for_path(root_path);
+    const RootInfo *info = get_root_info_for_path(root_path);
     if (info == NULL) {
         LOGW("Unable to get root info for %s during fstab generation!", root_path);
         return;
@@ -0,0 +1,338 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Formatting service: mkfs with the right parameters and progress, and
+// formatting of several partitions at once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <linux/fs.h>
+
+#include "format.h"
+#include "roots.h"
+#include "partitions.h"
+#include "system.h"
+#include "ui.h"
+#include "locale.h"
+#include "../steam_main/steam.h"
+
+#define MKFS_MAX_ARGS 24
+#define MB (1024*1024ULL)
+
+typedef struct {
+  int block_size;
+  int inode_ratio;   // bytes per inode
+  int journal_mb;
+} MkfsParams;
+
+static void choose_params(const PartitionDesc* desc, unsigned long long size, MkfsParams* p)
+{
+  int workload = desc ? desc->workload : WORKLOAD_SMALL_FILES;
+  unsigned long long journal;
+  // 1k blocks waste less on small partitions
+  p->block_size = size>=256*MB ? 4096 : 1024;
+  switch (workload) {
+    case WORKLOAD_READ_MOSTLY:
+      p->inode_ratio = 8192;
+      journal = size/256;
+      break;
+    case WORKLOAD_LARGE_FILES:
+      p->inode_ratio = 16384;
+      journal = size/256;
+      break;
+    default:
+      // lots of small databases, and a lot of metadata updates
+      p->inode_ratio = 4096;
+      journal = size/64;
+      break;
+  }
+  if (p->inode_ratio<p->block_size) p->inode_ratio = p->block_size;
+  // mke2fs needs at least 1024 journal blocks
+  int min = p->block_size/1024;
+  p->journal_mb = size ? journal/MB : 4;
+  if (p->journal_mb<min) p->journal_mb = min;
+  if (p->journal_mb>64) p->journal_mb = 64;
+}
+
+// runs in the child. The command is "tool arg1 arg2...", the arguments
+// don't contain spaces
+static void mkfs_popen(const char* command)
+{
+  char* argv[MKFS_MAX_ARGS+1];
+  char* cmd = strdup(command);
+  int argc = 0;
+  char* p;
+  memset(argv,0,sizeof(argv));
+  for (p = strtok(cmd," "); p && argc<MKFS_MAX_ARGS; p = strtok(NULL," ")) argv[argc++] = p;
+  if (!argc) _exit(1);
+  // the applets are called with NULL terminated argument lists, the unused
+  // slots are NULL already
+  int (*applet)(const char*, ...) = NULL;
+  if (strcmp(argv[0],"mkfs.ext2")==0 || strcmp(argv[0],"mkfs.ext4")==0) applet = call_mke2fs;
+  if (strcmp(argv[0],"mkfs.jfs")==0) applet = call_mkfs_jfs;
+  if (applet) {
+    _exit(applet(argv[0],argv[1],argv[2],argv[3],argv[4],argv[5],argv[6],argv[7],argv[8],argv[9],argv[10],
+                 argv[11],argv[12],argv[13],argv[14],argv[15],argv[16],argv[17],argv[18],argv[19],argv[20],
+                 argv[21],argv[22],argv[23],NULL));
+  }
+  char path[PATH_MAX];
+  sprintf(path,"/sbin/%s",argv[0]);
+  execv(path,argv);
+  _exit(127);
+}
+
+// mke2fs prints "Writing inode tables:  12/345" and backspaces over the
+// numbers, this follows it like a terminal would
+static float parse_progress(const char* line, float last)
+{
+  if (strstr(line,"Writing superblocks")) return 0.95;
+  if (strstr(line,"Creating journal")) return 0.9;
+  int len = strlen(line);
+  int i = len;
+  while (i>0 && line[i-1]>='0' && line[i-1]<='9') i--;
+  if (i==len || i==0 || line[i-1]!='/') return last;
+  unsigned int total = atoi(line+i);
+  int j = i-1;
+  while (j>0 && line[j-1]>='0' && line[j-1]<='9') j--;
+  if (j==i-1 || total==0) return last;
+  float f = (float)atoi(line+j)/total;
+  if (strstr(line,"group tables")) return 0.1*f;
+  if (strstr(line,"inode tables")) return 0.1+0.75*f;
+  return 0.9*f;
+}
+
+static int run_mkfs(const char* command, format_progress_fn progress, void* ctx)
+{
+  int sout = -1;
+  char line[256];
+  int len = 0;
+  float fraction = 0;
+  char c;
+  printf("%s\n",command);
+  pid_t pid = popen3func(NULL,&sout,NULL,POPEN_JOINSTDERR,command,mkfs_popen);
+  if (pid<0) return -1;
+  while (read(sout,&c,1)>0) {
+    if (c=='\b') {
+      if (len>0) {
+        float f = parse_progress(line,fraction);
+        if (progress && f!=fraction) progress(ctx,f);
+        fraction = f;
+        line[--len] = '\0';
+      }
+    } else if (c=='\n' || c=='\r') {
+      float f = parse_progress(line,fraction);
+      if (progress && f!=fraction) progress(ctx,f);
+      fraction = f;
+      if (c=='\n') printf("%s\n",line);
+      len = 0;
+      line[0] = '\0';
+    } else if (len<(int)sizeof(line)-1) {
+      line[len++] = c;
+      line[len] = '\0';
+    }
+  }
+  if (len) printf("%s\n",line);
+  int r = pclose3(pid,NULL,&sout,NULL,0);
+  if (progress) progress(ctx,1.0);
+  return r;
+}
+
+int format_mkfs(int fstype, const char* device, const char* label, const PartitionDesc* desc,
+                unsigned long long size, format_progress_fn progress, void* ctx)
+{
+  char command[PATH_MAX+256];
+  MkfsParams p;
+  if (!size) {
+    const PartitionInfo* info = find_partition_by_device(device);
+    if (info) size = info->size;
+  }
+  if (!size) {
+    int fd = open(device,O_RDONLY);
+    if (fd>=0) {
+      if (ioctl(fd,BLKGETSIZE64,&size)<0) size = 0;
+      close(fd);
+    }
+  }
+  choose_params(desc,size,&p);
+  if (fstype&TYPE_RFS) {
+    sprintf(command,"fat.format -v %s %s",desc ? desc->fat_options : "",device);
+  } else if (fstype&TYPE_EXT2) {
+    sprintf(command,"mkfs.ext2 -L %s -b %d -i %d -m 0 -F %s",label,p.block_size,p.inode_ratio,device);
+  } else if (fstype&TYPE_EXT4) {
+    sprintf(command,"mkfs.ext4 -L %s -b %d -i %d -J size=%d -m 0 -F %s",label,p.block_size,p.inode_ratio,p.journal_mb,device);
+  } else if (fstype&TYPE_JFS) {
+    sprintf(command,"mkfs.jfs -q -L %s %s",label,device);
+  } else {
+    return -1;
+  }
+  return run_mkfs(command,progress,ctx);
+}
+
+//////////////////////////////
+// parallel formatting
+
+typedef struct FormatState {
+  FormatJob* job;
+  char* secret;
+  pthread_t thread;
+  int started;
+  int has_successor;          // a later job on the same device joins this one
+  struct FormatState* after;  // an earlier job on the same device
+  float fraction;
+} FormatState;
+
+static pthread_mutex_t g_progress_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FormatState* g_states;
+static int g_count;
+
+static void job_progress(void* ctx, float fraction)
+{
+  FormatState* state = ctx;
+  int i;
+  float sum = 0;
+  pthread_mutex_lock(&g_progress_mutex);
+  state->fraction = fraction;
+  if (g_states) {
+    for (i=0; i<g_count; i++) sum += g_states[i].fraction;
+    ui_set_progress(sum/g_count);
+  } else {
+    ui_set_progress(fraction);
+  }
+  pthread_mutex_unlock(&g_progress_mutex);
+}
+
+static void run_job(FormatState* state)
+{
+  FormatJob* job = state->job;
+  time_t start = time(NULL);
+  ui_print(FORMAT_START,job->partition);
+  if (!filesystem_format_progress(job->fstype,job->partition,job->loopname,job->mtname,state->secret,job_progress,state)) {
+    job->result = FORMAT_JOB_UNFORMATTED;
+  } else {
+    job->result = check_and_mount(job->fstype,job->partition,job->loopname,job->mtname,state->secret);
+  }
+  job_progress(state,1.0);
+  if (job->result) {
+    ui_print(FORMAT_FAILED,job->partition,job->result);
+  } else {
+    ui_print(FORMAT_FINISHED,job->partition,(int)(time(NULL)-start));
+  }
+}
+
+static void* format_thread(void* arg)
+{
+  FormatState* state = arg;
+  // partitions of the same device would only fight over it
+  if (state->after && state->after->started) pthread_join(state->after->thread,NULL);
+  run_job(state);
+  return NULL;
+}
+
+// the whole disk the partition is on, jobs on the same disk compete for it
+static dev_t disk_of(const char* partition)
+{
+  struct stat s;
+  char path[PATH_MAX];
+  unsigned int ma, mi;
+  if (stat(partition,&s)) return 0;
+  dev_t dev = S_ISBLK(s.st_mode) ? s.st_rdev : s.st_dev;
+  // the stl/bml partitions of the OneNAND chip each look like a disk, the
+  // flash driver's major number is what they share
+  const char* name = strrchr(partition,'/');
+  name = name ? name+1 : partition;
+  if (S_ISBLK(s.st_mode) && (strncmp(name,"stl",3)==0 || strncmp(name,"bml",3)==0)) {
+    return makedev(major(dev),0);
+  }
+  snprintf(path,sizeof(path),"/sys/dev/block/%u:%u",major(dev),minor(dev));
+  // without sysfs only the driver is known, that's the safe guess
+  if (access(path,F_OK)) return makedev(major(dev),0);
+  strcat(path,"/partition");
+  if (access(path,F_OK)) return dev;
+  // the parent directory of a partition is its disk
+  strcpy(path+strlen(path)-strlen("partition"),"../dev");
+  FILE* f = fopen(path,"r");
+  if (!f) return makedev(major(dev),0);
+  if (fscanf(f,"%u:%u",&ma,&mi)==2) dev = makedev(ma,mi);
+  else dev = makedev(major(dev),0);
+  fclose(f);
+  return dev;
+}
+
+void format_filesystems(FormatJob* jobs, int count, char* secret, int parallel)
+{
+  int i,j;
+  if (count<=0) return;
+  for (i=0; i<count; i++) {
+    if ((jobs[i].fstype&TYPE_CRYPT) && strlen(secret)==0) {
+      // ask it now, the jobs shouldn't wait for the user one by one
+      filesystem_ask_secret(secret);
+      break;
+    }
+  }
+  FormatState* states = calloc(count,sizeof(FormatState));
+  if (!states) parallel = 0;
+  pthread_mutex_lock(&g_progress_mutex);
+  g_states = states;
+  g_count = count;
+  pthread_mutex_unlock(&g_progress_mutex);
+  ui_show_progress(1.0,0);
+  ui_set_progress(0);
+  for (i=0; i<count; i++) {
+    FormatState local;
+    FormatState* state = &local;
+    if (states) {
+      state = &states[i];
+    } else {
+      memset(&local,0,sizeof(local));
+    }
+    state->job = &jobs[i];
+    state->secret = secret;
+    if (!parallel) {
+      run_job(state);
+      continue;
+    }
+    dev_t dev = disk_of(jobs[i].partition);
+    for (j=i-1; j>=0 && !state->after; j--) {
+      if (dev && disk_of(jobs[j].partition)==dev) state->after = &states[j];
+    }
+    if (state->after) state->after->has_successor = 1;
+    if (pthread_create(&state->thread,NULL,format_thread,state)==0) {
+      state->started = 1;
+    } else {
+      // no thread, do it here (after the one it depends on)
+      if (state->after && state->after->started) pthread_join(state->after->thread,NULL);
+      run_job(state);
+    }
+  }
+  // the first jobs of a device are joined by the ones after them
+  for (i=0; i<count && parallel; i++) {
+    if (states[i].started && !states[i].has_successor) pthread_join(states[i].thread,NULL);
+  }
+  pthread_mutex_lock(&g_progress_mutex);
+  g_states = NULL;
+  g_count = 0;
+  pthread_mutex_unlock(&g_progress_mutex);
+  free(states);
+}
@@ -0,0 +1,34 @@
+#ifndef __STEAM_FORMAT_H
+#define __STEAM_FORMAT_H
+
+#include "roots.h"
+
+// called with the progress of the current operation, between 0.0 and 1.0
+typedef void (*format_progress_fn)(void* ctx, float fraction);
+
+// creates the filesystem (one of TYPE_RFS, TYPE_EXT2, TYPE_EXT4, TYPE_JFS)
+// on device. Block size, inode ratio and journal size are chosen from size
+// and the partition's workload (desc may be NULL, size may be 0 if unknown).
+// mkfs' progress is reported through progress if it's not NULL.
+// Returns the exit code of mkfs
+int format_mkfs(int fstype, const char* device, const char* label, const PartitionDesc* desc,
+                unsigned long long size, format_progress_fn progress, void* ctx);
+
+typedef struct {
+  int fstype;
+  const char* partition;
+  const char* loopname;
+  const char* mtname;
+  int result;            // set by format_filesystems: 0 if it's formatted and mounted
+} FormatJob;
+
+// FormatJob.result when the format itself failed, other nonzero results are
+// from mounting the formatted partition
+#define FORMAT_JOB_UNFORMATTED -1
+
+// formats and mounts the jobs, partitions on different disks in parallel
+// if parallel is set. The progress goes to the progress bar. If an encrypted
+// filesystem is requested and secret is empty, it's asked once for all jobs
+void format_filesystems(FormatJob* jobs, int count, char* secret, int parallel);
+
+#endif
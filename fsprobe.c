@@ -0,0 +1,163 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Filesystem detection by looking at the superblocks. This is what blkid
+// does, but we only need to know about the filesystems we can mount.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "roots.h"
+#include "fsprobe.h"
+
+#define LUKS_MAGIC "LUKS\xba\xbe"
+#define LUKS_UUID_OFFSET 168
+
+#define EXT_SUPERBLOCK_OFFSET 1024
+#define EXT_MAGIC 0xEF53
+
+#define JFS_SUPERBLOCK_OFFSET 32768
+#define JFS_MAGIC "JFS1"
+
+static unsigned int le16(const unsigned char* p)
+{
+  return p[0] | (p[1]<<8);
+}
+
+static unsigned int le32(const unsigned char* p)
+{
+  return p[0] | (p[1]<<8) | (p[2]<<16) | ((unsigned int)p[3]<<24);
+}
+
+static unsigned long long le64(const unsigned char* p)
+{
+  return le32(p) | ((unsigned long long)le32(p+4)<<32);
+}
+
+static int read_at(int fd, off_t offset, unsigned char* buf, size_t len)
+{
+  ssize_t r;
+  do {
+    r = pread(fd,buf,len,offset);
+  } while (r<0 && errno==EINTR);
+  return r==(ssize_t)len ? 0 : -1;
+}
+
+static void format_uuid(const unsigned char* u, char* out)
+{
+  sprintf(out,"%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+    u[0],u[1],u[2],u[3],u[4],u[5],u[6],u[7],u[8],u[9],u[10],u[11],u[12],u[13],u[14],u[15]);
+}
+
+static void copy_label(char* out, const unsigned char* in, int len)
+{
+  memcpy(out,in,len);
+  out[len] = '\0';
+  // fat labels are padded with spaces
+  while (len>0 && (out[len-1]==' ' || out[len-1]=='\0')) out[--len] = '\0';
+}
+
+static int probe_luks(const unsigned char* buf, FsProbeInfo* info)
+{
+  if (memcmp(buf,LUKS_MAGIC,6)) return 0;
+  memcpy(info->uuid,buf+LUKS_UUID_OFFSET,39);
+  info->uuid[39] = '\0';
+  return TYPE_CRYPT;
+}
+
+static int probe_ext(const unsigned char* sb, FsProbeInfo* info)
+{
+  if (le16(sb+56)!=EXT_MAGIC) return 0;
+  info->ext_mount_count = le16(sb+52);
+  info->ext_max_mount_count = (short)le16(sb+54);
+  info->ext_state = le16(sb+58);
+  info->ext_last_check = le32(sb+64);
+  info->ext_check_interval = le32(sb+68);
+  info->ext_compat = le32(sb+92);
+  info->ext_incompat = le32(sb+96);
+  info->ext_ro_compat = le32(sb+100);
+  info->size = (unsigned long long)le32(sb+4)<<(10+le32(sb+24));
+  format_uuid(sb+104,info->uuid);
+  copy_label(info->label,sb+120,16);
+  info->dirty = !(info->ext_state&EXT_STATE_VALID) || (info->ext_state&EXT_STATE_ERROR) ||
+    (info->ext_incompat&EXT_FEATURE_INCOMPAT_RECOVER);
+  // the ext2 driver can only mount it if it has no journal and no new features
+  if ((info->ext_compat&EXT_FEATURE_COMPAT_HAS_JOURNAL) ||
+      (info->ext_incompat&~(EXT_FEATURE_INCOMPAT_FILETYPE)) ||
+      (info->ext_ro_compat&~(EXT_FEATURE_RO_COMPAT_SPARSE_SUPER|EXT_FEATURE_RO_COMPAT_LARGE_FILE))) {
+    return TYPE_EXT4;
+  }
+  return TYPE_EXT2;
+}
+
+// RFS is Samsung's FAT implementation, it's FAT compatible on disk
+static int probe_fat(const unsigned char* bs, FsProbeInfo* info)
+{
+  if (bs[510]!=0x55 || bs[511]!=0xAA) return 0;
+  unsigned int sector_size = le16(bs+11);
+  if (sector_size<512 || sector_size>4096 || (sector_size&(sector_size-1))) return 0;
+  unsigned int sectors = le16(bs+19);
+  if (!sectors) sectors = le32(bs+32);
+  if (memcmp(bs+82,"FAT32   ",8)==0) {
+    sprintf(info->uuid,"%04X-%04X",le16(bs+69),le16(bs+67));
+    copy_label(info->label,bs+71,11);
+  } else if (memcmp(bs+54,"FAT",3)==0) {
+    sprintf(info->uuid,"%04X-%04X",le16(bs+41),le16(bs+39));
+    copy_label(info->label,bs+43,11);
+  } else {
+    return 0;
+  }
+  info->size = (unsigned long long)sectors*sector_size;
+  return TYPE_RFS;
+}
+
+static int probe_jfs(const unsigned char* sb, FsProbeInfo* info)
+{
+  if (memcmp(sb,JFS_MAGIC,4)) return 0;
+  // s_size counts physical blocks of s_pbsize bytes
+  info->size = le64(sb+8)*le32(sb+24);
+  info->jfs_state = le32(sb+40);
+  info->dirty = info->jfs_state!=JFS_STATE_CLEAN;
+  format_uuid(sb+136,info->uuid);
+  copy_label(info->label,sb+152,16);
+  return TYPE_JFS;
+}
+
+int fsprobe(const char* device, FsProbeInfo* info)
+{
+  FsProbeInfo dummy;
+  unsigned char buf[1024];
+  int type = 0;
+  int fd;
+  if (!info) info = &dummy;
+  memset(info,0,sizeof(*info));
+  fd = open(device,O_RDONLY);
+  if (fd<0) return -1;
+
+  if (read_at(fd,0,buf,512)) {
+    close(fd);
+    return -1;
+  }
+  type = probe_luks(buf,info);
+  if (!type && read_at(fd,EXT_SUPERBLOCK_OFFSET,buf,1024)==0) type = probe_ext(buf,info);
+  if (!type && read_at(fd,0,buf,512)==0) type = probe_fat(buf,info);
+  if (!type && read_at(fd,JFS_SUPERBLOCK_OFFSET,buf,1024)==0) type = probe_jfs(buf,info);
+  close(fd);
+  info->type = type;
+  return type;
+}
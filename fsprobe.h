@@ -0,0 +1,41 @@
+#ifndef __STEAM_FSPROBE_H
+#define __STEAM_FSPROBE_H
+
+// superblock based filesystem detection
+
+typedef struct {
+  int type;                      // TYPE_EXT2, TYPE_EXT4, TYPE_RFS, TYPE_JFS, TYPE_CRYPT or 0
+  unsigned long long size;       // size of the filesystem in bytes, 0 if unknown
+  char uuid[40];                 // uuid or volume id, empty if there's none
+  char label[17];
+  int dirty;                     // not cleanly unmounted
+  // ext2/3/4 superblock fields
+  unsigned int ext_compat;
+  unsigned int ext_incompat;
+  unsigned int ext_ro_compat;
+  int ext_state;
+  int ext_mount_count;
+  int ext_max_mount_count;
+  unsigned int ext_last_check;
+  unsigned int ext_check_interval;
+  // jfs superblock fields
+  int jfs_state;
+} FsProbeInfo;
+
+// ext feature flags we are interested in
+#define EXT_FEATURE_COMPAT_HAS_JOURNAL 0x0004
+#define EXT_FEATURE_INCOMPAT_FILETYPE 0x0002
+#define EXT_FEATURE_INCOMPAT_RECOVER 0x0004
+#define EXT_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001
+#define EXT_FEATURE_RO_COMPAT_LARGE_FILE 0x0002
+
+#define EXT_STATE_VALID 0x0001
+#define EXT_STATE_ERROR 0x0002
+
+#define JFS_STATE_CLEAN 0
+
+// reads the superblocks of the block device. Returns the detected type (0
+// if it's unknown), or -1 if the device can't be read. info may be NULL
+int fsprobe(const char* device, FsProbeInfo* info);
+
+#endif
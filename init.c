@@ -18,6 +18,20 @@
 #include "ui.h"
 #include "device.h"
 #include "system.h"
+#include "native.h"
+#include "luks.h"
+#include "format.h"
+#include "sysconv.h"
+#include "iotune.h"
+#include "tweaks.h"
+#include "trace.h"
+#include "initd.h"
+#include "coldplug.h"
+#include "modload.h"
+#include "detectcache.h"
+#include "propwait.h"
+#include "bootplan.h"
+#include "rcedit.h"
 #include "locale.h"
 #include "config.h"
 #include "nandroid.h"
@@ -53,74 +67,53 @@ void reboot_recovery() {
 
 extern char **environ;
 
+// enables the command trace if it's asked for on the kernel command line
+// or in the config
+static void check_trace() {
+  char value[VALUE_MAX_LENGTH];
+  char cmdline[1024];
+  if (system_trace_enabled()) return;
+  // the boot profile is the same trace, the recovery menu turns it on
+  if (strcmp(get_conf_def("debug.trace",value,"0"),"1")==0 ||
+      strcmp(get_conf_def("debug.bootprofile",value,"0"),"1")==0) {
+    system_trace_open(SYSTEM_TRACE_FILE);
+    return;
+  }
+  FILE* f = fopen("/proc/cmdline","r");
+  if (f) {
+    int r = fread(cmdline,1,sizeof(cmdline)-1,f);
+    cmdline[r]='\0';
+    fclose(f);
+    if (strstr(cmdline,"steam.trace=1")) system_trace_open(SYSTEM_TRACE_FILE);
+  }
+}
+
 int steam_postinit_main(int argc, char* argv[]) {
   freopen(POSTINIT_LOG_FILE,"a+",stdout);setbuf(stdout,NULL);
   freopen(POSTINIT_LOG_FILE,"a+",stderr);setbuf(stderr,NULL);
   struct stat sbuf;
   char value[VALUE_MAX_LENGTH];
   init_conf();
+  check_trace();
+  system_trace_stage("postinit");
   printf("--- POSTINIT ---\n");
   // remount / as it was set to read-only in init
-  call_busybox("mount","-o","remount,rw","/",NULL);
+  call_native("mount","-o","remount,rw","/",NULL);
 
   int startanim = 1;
   if (get_conf("init.bootanim",value) && strcmp(value,"0")==0) startanim=0;
   if (get_conf("init.bootanim",value) && strcmp(value,"2")==0) startanim=2;
 
   if (strcmp(get_conf_def("tweaks.iosched",value,"0"),"1")==0) {
-    // tweak cfq io scheduler
     printf(TWEAKS_ENABLE_IOSCHED);
-    DIR* d = opendir("/sys/block");
-    FILE *f;
-    if (d) {
-      struct dirent *entry;
-      char path[PATH_MAX];
-      while ((entry = readdir(d))!=NULL) {
-        if ((strstr(entry->d_name,"stl")==entry->d_name) ||
-           (strstr(entry->d_name,"mmc")==entry->d_name) ||
-           (strstr(entry->d_name,"bml")==entry->d_name) ||
-           (strstr(entry->d_name,"tfsr")==entry->d_name)) {
-          sprintf(path,"/sys/block/%s/queue/rotational",entry->d_name);
-          f = fopen(path,"w+"); if (f) { fprintf(f,"%s\n",get_conf_def("tweaks.iosched.rotational",value,"0")); fclose(f); }
-          sprintf(path,"/sys/block/%s/queue/iosched/low_latency",entry->d_name);
-          f = fopen(path,"w+"); if (f) { fprintf(f,"%s\n",get_conf_def("tweaks.iosched.low_latency",value,"1")); fclose(f); }
-          sprintf(path,"/sys/block/%s/queue/iosched/back_seek_penalty",entry->d_name);
-          f = fopen(path,"w+"); if (f) { fprintf(f,"%s\n",get_conf_def("tweaks.iosched.back_seek_penalty",value,"1")); fclose(f); }
-          sprintf(path,"/sys/block/%s/queue/iosched/back_seek_max",entry->d_name);
-          f = fopen(path,"w+"); if (f) { fprintf(f,"%s\n",get_conf_def("tweaks.iosched.back_seek_max",value,"1000000000")); fclose(f); }
-          sprintf(path,"/sys/block/%s/queue/iosched/slice_idle",entry->d_name);
-          f = fopen(path,"w+"); if (f) { fprintf(f,"%s\n",get_conf_def("tweaks.iosched.slice_idle",value,"3")); fclose(f); }
-        }
-      }
-      closedir(d);
+    // auto profile without results yet: measure it on this first boot
+    if (strcmp(get_conf_def("tweaks.iosched.profile",value,"custom"),"auto")==0 && !get_conf("tweaks.iosched.auto",value)) {
+      iotune_benchmark("/cache",NULL,0);
     }
+    iotune_apply();
   }
 
-  if (strcmp(get_conf_def("tweaks.kernelvm",value,"0"),"1")==0) {
-    printf(TWEAKS_ENABLE_KERNELVM);
-    FILE*f;
-    f = fopen("/proc/sys/vm/swappiness","w+"); if (f) { fprintf(f,"%s\n",get_conf_def("tweaks.kernelvm.swappiness",value,"0")); fclose(f); }
-    f = fopen("/proc/sys/vm/dirty_ratio","w+"); if (f) { fprintf(f,"%s\n",get_conf_def("tweaks.kernelvm.dirty_ratio",value,"20")); fclose(f); }
-    f = fopen("/proc/sys/vm/vfs_cache_pressure","w+"); if (f) { fprintf(f,"%s\n",get_conf_def("tweaks.kernelvm.vfs_cache_pressure",value,"100")); fclose(f); }
-    f = fopen("/proc/sys/vm/min_free_kbytes","w+"); if (f) { fprintf(f,"%s\n",get_conf_def("tweaks.kernelvm.min_free_kbytes",value,"2746")); fclose(f); }
-  }
-
-  if (strcmp(get_conf_def("tweaks.kernelsched",value,"0"),"1")==0) {
-    printf(TWEAKS_ENABLE_KERNELSCHED);
-    FILE*f;
-    f = fopen("/proc/sys/vm/sched_latency_ns","w+"); if (f) { fprintf(f,"%s\n",get_conf_def("tweaks.kernelsched.sched_latency_ns",value,"20000000")); fclose(f); }
-    f = fopen("/proc/sys/vm/sched_wakeup_granularity_ns","w+"); if (f) { fprintf(f,"%s\n",get_conf_def("tweaks.kernelsched.sched_min_granularity_ns",value,"1000000")); fclose(f); }
-    f = fopen("/proc/sys/vm/sched_min_granularity_ns","w+"); if (f) { fprintf(f,"%s\n",get_conf_def("tweaks.kernelsched.sched_wakeup_granularity_ns",value,"2000000")); fclose(f); }
-  }
-
-  if (strcmp(get_conf_def("tweaks.misc",value,"0"),"1")==0) {
-    printf(TWEAKS_ENABLE_MISC);
-    //property_set("dalvik.vm.startheapsize",get_conf_def("tweaks.misc.heapsize",value,"8m"));
-    //property_set("wifi.supplicant_scan_interval",get_conf_def("tweaks.misc.supplicant_scan_interval"));
-    FILE*f;
-    f = fopen("/proc/sys/vm/dirty_writeback_centisecs","w+"); if (f) { fprintf(f,"%s\n",get_conf_def("tweaks.misc.dirty_writeback_centisecs",value,"2000")); fclose(f); }
-    f = fopen("/proc/sys/vm/dirty_expire_centisecs","w+"); if (f) { fprintf(f,"%s\n",get_conf_def("tweaks.misc.dirty_expire_centisecs",value,"1000")); fclose(f); }
-  }
+  tweaks_apply_enabled();
 
   // BLN
   if (call_busybox("grep","^1$","/system/etc/bln.conf",NULL)==0) {
@@ -135,37 +128,22 @@ int steam_postinit_main(int argc, char* argv[]) {
     // no liblights found
     if (stat(LIBLIGHTS_DEST ".backup",&sbuf)) {
       // no backup found
-      call_busybox("cp",LIBLIGHTS_DEST,LIBLIGHTS_DEST ".backup",NULL);
+      call_native("cp",LIBLIGHTS_DEST,LIBLIGHTS_DEST ".backup",NULL);
     }
-    call_busybox("cp",LIBLIGHTS_SRC,LIBLIGHTS_DEST,NULL);
-    call_busybox("chmod","644",LIBLIGHTS_DEST,NULL);
+    call_native("cp",LIBLIGHTS_SRC,LIBLIGHTS_DEST,NULL);
+    call_native("chmod","644",LIBLIGHTS_DEST,NULL);
   }
   // put back original fat.format
-  call_busybox("cp","/sbin/fat.format","/system/bin/fat.format",NULL);
+  call_native("cp","/sbin/fat.format","/system/bin/fat.format",NULL);
 
   time_t t;
 
+  system_trace_stage("postinit init.d");
   t=time(NULL);printf(INITD_START,ctime(&t));
-  struct stat s;
-  if (stat("/system/etc/init.d",&s)==0) {
-    if (S_ISDIR(s.st_mode)) {
-      DIR* d = opendir("/system/etc/init.d");
-      struct dirent* entry;
-      if (d) {
-        while ((entry = readdir(d)) != NULL) {
-          if (entry->d_name && entry->d_name[0]=='S') {
-            char path[PATH_MAX];
-            sprintf(path,"/system/etc/init.d/%s",entry->d_name);
-            t=time(NULL);printf(INITD_STARTX,ctime(&t),entry->d_name);
-            sh(path);
-            t=time(NULL);printf(INITD_DONEX,ctime(&t),entry->d_name);
-          }
-        }
-        closedir(d);
-      }
-    }
-  }
+  initd_run("/system/etc/init.d",'S',atoi(get_conf_def("init.initd.jobs",value,"4")),
+    atoi(get_conf_def("init.initd.timeout",value,"60")));
   t=time(NULL);printf(INITD_DONE,ctime(&t));
+  system_trace_stage("postinit finish");
 
   if (strcmp(get_conf_def("init.rmsymlinks",value,"1"),"1")==0) {
     char** command = steam_command_list;
@@ -176,14 +154,18 @@ int steam_postinit_main(int argc, char* argv[]) {
   }
 
   // remount ro
-  call_busybox("mount","-o","remount,ro","/",NULL);
+  call_native("mount","-o","remount,ro","/",NULL);
   if (strcmp(get_conf_def("fs.system.ro",value,"1"),"1")==0) {
     // efs hiding needs rw rights
     if (strcmp(get_conf_def("fs.system.efs",value,"0"),"0")==0) {
-      call_busybox("mount","-o","remount,ro","/dev/block/stl9","/system",NULL);
+      call_native("mount","-o","remount,ro","/dev/block/stl9","/system",NULL);
     }
   }
 
+  // keep the profile of this boot, so it can be viewed from recovery
+  system_trace_stage(NULL);
+  if (system_trace_enabled()) call_native("cp",SYSTEM_TRACE_FILE,BOOT_PROFILE_FILE,NULL);
+
   // signal earlyinit that logo playing will start soon
   // so it can disable the display engine if needed
   property_set("dev.defaultclassstarted","1");
@@ -201,11 +183,15 @@ int steam_postinit_main(int argc, char* argv[]) {
   return 0;
 }
 
+#define EARLY_PROPERTY_TIMEOUT_MS 5000
+
 int steam_earlyinit_main(int argc, char* argv[]) {
   freopen(EARLYINIT_LOG_FILE,"a+",stdout);setbuf(stdout,NULL);
   freopen(EARLYINIT_LOG_FILE,"a+",stderr);setbuf(stderr,NULL);
   sprintf(TEMPORARY_LOG_FILE,"%s",POSTINIT_LOG_FILE);
   init_conf();
+  check_trace();
+  system_trace_stage("earlyinit");
   char value[VALUE_MAX_LENGTH];
   int donepinit = false;
   int shutdownscreen = true;
@@ -221,31 +207,16 @@ int steam_earlyinit_main(int argc, char* argv[]) {
   }
   time_t t;
 
+  system_trace_stage("earlyinit init.d");
   t=time(NULL);printf(INITD_EARLYSTART,ctime(&t));
-  struct stat s;
-  if (stat("/system/etc/init.d",&s)==0) {
-    if (S_ISDIR(s.st_mode)) {
-      DIR* d = opendir("/system/etc/init.d");
-      struct dirent* entry;
-      if (d) {
-        while ((entry = readdir(d)) != NULL) {
-          if (entry->d_name && entry->d_name[0]=='E') {
-            char path[PATH_MAX];
-            sprintf(path,"/system/etc/init.d/%s",entry->d_name);
-            t=time(NULL);printf(INITD_STARTX,ctime(&t),entry->d_name);
-            sh(path);
-            t=time(NULL);printf(INITD_DONEX,ctime(&t),entry->d_name);
-          }
-        }
-        closedir(d);
-      }
-    }
-  }
+  initd_run("/system/etc/init.d",'E',atoi(get_conf_def("init.initd.jobs",value,"4")),
+    atoi(get_conf_def("init.initd.timeout",value,"60")));
   t=time(NULL);printf(INITD_EARLYDONE,ctime(&t));
+  system_trace_stage(NULL);
 
   while (true) {
-    sleep(1);
-    usleep(1000000/15);
+    // read before the checks, so a change made meanwhile wakes us up
+    unsigned serial = property_serial();
     char value[PROPERTY_VALUE_MAX];
     // got the signal from post-init
     property_get("dev.defaultclassstarted",value,"");
@@ -285,75 +256,123 @@ int steam_earlyinit_main(int argc, char* argv[]) {
       if (strcmp(get_conf_def("steam.uninstallation",value,"0"),"1") == 0) reboot_recovery();
       exit(0);
     }
+    // both properties are only ever added, which wakes us up. The timeout
+    // is there for changed values and for a missing property area
+    property_wait(serial,EARLY_PROPERTY_TIMEOUT_MS);
   }
   return 0;
 }
 
+// mkfs and the restore need some memory too
+#define CONVERT_RAM_RESERVE (24*1024*1024LL)
+
+static void convert_progress(void* ctx, float fraction)
+{
+  float* range = ctx;
+  ui_set_progress(range[0]+(range[1]-range[0])*fraction);
+}
+
 int convert_system(int fromfstype, int tofstype)
 {
   struct statfs s;
-  uint64_t sdcardfree = 0, sysused = 2147483647;
+  uint64_t sdcardfree = 0, sysused = 0;
   char value[VALUE_MAX_LENGTH];
-  call_busybox("mkdir","/mnt",NULL);
-  call_busybox("mkdir","/mnt/sdcard",NULL);
-  call_busybox("mkdir","/mnt/external_sd",NULL);
-  call_busybox("mount","-t","vfat","-o","utf8",SDCARD_BLOCK_NAME,"/mnt/sdcard",NULL);
-  call_busybox("mount","-t","vfat","-o","utf8",SDCARD2_BLOCK_NAME,"/mnt/external_sd",NULL);
-  call_busybox("mkdir","/tmp/sys",NULL);
+  const PartitionDesc* sys = get_partition_desc_by_root("SYSTEM:");
+  const char* tmp = sys->temp_mount_point;
+  call_native("mkdir","/mnt",NULL);
+  call_native("mkdir","/mnt/sdcard",NULL);
+  call_native("mkdir","/mnt/external_sd",NULL);
+  call_native("mount","-t","vfat","-o","utf8",SDCARD_BLOCK_NAME,"/mnt/sdcard",NULL);
+  call_native("mount","-t","vfat","-o","utf8",SDCARD2_BLOCK_NAME,"/mnt/external_sd",NULL);
+  call_native("mkdir",tmp,NULL);
   if (fromfstype==(TYPE_RFS|TYPE_RFS_BAD)) {
-    call_busybox("mount","-t","rfs","-o",TYPE_RFS_BAD_DEFAULT_MOUNT,SYSTEM_BLOCK_NAME,"/tmp/sys",NULL);
+    call_native("mount","-t","rfs","-o",TYPE_RFS_BAD_DEFAULT_MOUNT,sys->block,tmp,NULL);
   } else {
-    check_and_mount(fromfstype,SYSTEM_BLOCK_NAME,"loop4","tmp/sys",NULL);
+    check_and_mount(fromfstype,sys->block,sys->loop,tmp+1,NULL);
   }
-  call_busybox("mkdir","/system/lib",NULL);
-  call_busybox("mkdir","/system/bin",NULL);
-  call_busybox("mkdir","/system/etc",NULL);
-  call_busybox("ln","-s","/system/etc","/etc",NULL);
-  call_busybox("cp","/res/misc/mke2fs.conf","/system/etc",NULL); // to make mkfs.ext4 to work
+  call_native("mkdir","/system/lib",NULL);
+  call_native("mkdir","/system/bin",NULL);
+  call_native("mkdir","/system/etc",NULL);
+  call_native("ln","-s","/system/etc","/etc",NULL);
+  call_native("cp","/res/misc/mke2fs.conf","/system/etc",NULL); // to make mkfs.ext4 to work
   // these files are needed, as fat.format is dynamically linked
-  call_busybox("cp","/tmp/sys/lib/liblog.so","/system/lib",NULL);
-  call_busybox("cp","/tmp/sys/lib/libcutils.so","/system/lib",NULL);
-  call_busybox("cp","/tmp/sys/lib/libc.so","/system/lib",NULL);
-  call_busybox("cp","/tmp/sys/lib/libstdc++.so","/system/lib",NULL);
-  call_busybox("cp","/tmp/sys/lib/libm.so","/system/lib",NULL);
-  call_busybox("cp","/tmp/sys/lib/libdl.so","/system/lib",NULL);
-  call_busybox("cp","/tmp/sys/bin/linker","/system/bin",NULL);
+  static const char* libs[] = { "lib/liblog.so", "lib/libcutils.so", "lib/libc.so", "lib/libstdc++.so",
+                                "lib/libm.so", "lib/libdl.so", "bin/linker", NULL };
+  char path[PATH_MAX];
+  int i;
+  for (i=0; libs[i]; i++) {
+    sprintf(path,"%s/%s",tmp,libs[i]);
+    call_native("cp",path,libs[i][0]=='l' ? "/system/lib" : "/system/bin",NULL);
+  }
   setenv("LD_LIBRARY_PATH","/system/lib",1); // use the libs from that directory
-  while (sdcardfree<sysused) {
-    if (statfs("/mnt/sdcard",&s)==0) {
+  SysconvStage stage;
+  memset(&stage,0,sizeof(stage));
+  strcpy(stage.ram_file,"/tmp/.syssave.scz");
+  strcpy(stage.spill_file,"/mnt/sdcard/.syssave/save.scz");
+  call_native("rm","-rf","/mnt/sdcard/.syssave",NULL);
+  call_native("mkdir","/mnt/sdcard/.syssave",NULL);
+  ui_show_progress(1.0,0);
+  ui_set_progress(0);
+  float range[2] = { 0, 0.45 };
+  while (true) {
+    // the stream stays in memory as long as it fits, the rest goes to the sdcard
+    stage.ram_budget = sysconv_ram_budget(CONVERT_RAM_RESERVE);
+    if (sysconv_stage(&stage,tmp,convert_progress,range)==0) break;
+    int err = errno;
+    sysconv_cleanup(&stage);
+    if (err==ENOSPC && statfs("/mnt/sdcard",&s)==0) {
       sdcardfree = s.f_bavail*s.f_bsize / (uint64_t)(1024*1024);
-      if (statfs("/system",&s)==0) {
-        sysused = (s.f_blocks - s.f_bfree)*s.f_bsize / (uint64_t)(1024*952); // add ~10% to needed space
+      if (statfs(tmp,&s)==0 && stage.data_bytes) {
+        // what didn't fit in memory, compressed like the part written so far, plus ~10%
+        sysused = (s.f_blocks - s.f_bfree)*s.f_bsize;
+        sysused = sysused*(stage.ram_bytes+stage.spill_bytes)/stage.data_bytes;
+        sysused = sysused>(uint64_t)stage.ram_budget ? (sysused-stage.ram_budget) / (uint64_t)(1024*952) : 0;
       }
-    }
-    if (sdcardfree<sysused) {
       ui_print(CONVERT_NO_SPACE);
       ui_print(CONVERT_SPACE_NEEDS,sysused,sdcardfree);
-      if (get_conf("preinit.allowfm",value) && strcmp(value,"1")==0) {
-        ui_print(CONVERT_LOAD_FM);
-        file_manager();
-      } else {
-        ui_print(CONVERT_NO_FM);
-        ui_print(INIT_HALT);
-        while (true) {
-          sleep(1);
-        }
+    } else {
+      ui_print(CONVERT_BACKUP_FAILED);
+    }
+    // nothing is lost yet, let the user fix it and try again
+    if (get_conf("preinit.allowfm",value) && strcmp(value,"1")==0) {
+      ui_print(CONVERT_LOAD_FM);
+      file_manager();
+    } else {
+      ui_print(CONVERT_NO_FM);
+      ui_print(INIT_HALT);
+      while (true) {
+        sleep(1);
       }
     }
   }
-  char backup_path[PATH_MAX];
-  call_busybox("rm","-rf","/mnt/sdcard/.syssave",NULL);
-  call_busybox("mkdir","/mnt/sdcard/.syssave",NULL);
-  if (call_busybox("tar","-cvpf","/mnt/sdcard/.syssave/save.tar","/tmp/sys",NULL)) {
-    ui_print(CONVERT_BACKUP_FAILED);
+  ui_print(CONVERT_STAGED,stage.entries,stage.ram_bytes/(1024*1024),stage.spill_bytes/(1024*1024));
+  if (stage.errors) {
+    ui_print(CONVERT_STAGE_ERRORS,stage.errors);
     ui_print(CONVERT_CONTINUE_ANYWAY);
   }
-  unmount_filesystem("/tmp/sys");
+  unmount_filesystem(tmp);
   sync();
-  filesystem_format(tofstype,SYSTEM_BLOCK_NAME,"loop4","tmp/sys",NULL);
+  range[0] = 0.45;
+  range[1] = 0.55;
+  int formatted = filesystem_format_progress(tofstype,sys->block,sys->loop,tmp+1,NULL,convert_progress,range)!=0;
   sync();
-  check_and_mount(tofstype,SYSTEM_BLOCK_NAME,"loop4","tmp/sys",NULL);
-  if (call_busybox("tar","-xvpf","/mnt/sdcard/.syssave/save.tar",NULL)) {
+  if (!formatted || check_and_mount(tofstype,sys->block,sys->loop,tmp+1,NULL)) {
+    // restoring now would fill the ramdisk, the staged copy is all there is
+    ui_print(CONVERT_TARGET_FAILED);
+    call_native("cp",stage.ram_file,"/mnt/sdcard/.syssave",NULL);
+    ui_print(CONVERT_STAGE_KEPT,"/mnt/sdcard/.syssave");
+    if (get_conf("preinit.allowfm",value) && strcmp(value,"1")==0) {
+      ui_print(CONVERT_LOAD_FM);
+      file_manager();
+    }
+    ui_print(INIT_HALT);
+    while (true) sleep(1);
+  }
+  range[0] = 0.55;
+  range[1] = 1.0;
+  int failed = sysconv_restore(&stage,tmp,convert_progress,range);
+  if (failed>0) ui_print(CONVERT_RESTORE_ERRORS,failed);
+  if (failed<0) {
     ui_print(CONVERT_RESTORE_FAILED);
     if (get_conf("preinit.allowfm",value) && strcmp(value,"1")==0) {
       ui_print(CONVERT_LOAD_FM);
@@ -361,20 +380,23 @@ int convert_system(int fromfstype, int tofstype)
     } else {
       ui_print(CONVERT_NO_FM);
       ui_print(INIT_HALT);
-      call_busybox("rm","-rf","/mnt/sdcard/.syssave",NULL);
+      sysconv_cleanup(&stage);
+      call_native("rm","-rf","/mnt/sdcard/.syssave",NULL);
       while (true) sleep(1);
     }
   }
-  call_busybox("mkdir","/mnt/sdcard/steam",NULL);
-  call_busybox("rm","-rf","/mnt/sdcard/steam/sysconv",NULL);
-  call_busybox("mkdir","/mnt/sdcard/steam/sysconv",NULL);
+  call_native("mkdir","/mnt/sdcard/steam",NULL);
+  call_native("rm","-rf","/mnt/sdcard/steam/sysconv",NULL);
+  call_native("mkdir","/mnt/sdcard/steam/sysconv",NULL);
   sh("cp /tmp/*.log /mnt/sdcard/steam/sysconv");
-  call_busybox("rm","-rf","/mnt/sdcard/.syssave",NULL);
-  call_busybox("umount","/mnt/external_sd",NULL);
-  call_busybox("umount","/mnt/sdcard",NULL);
+  sysconv_cleanup(&stage);
+  call_native("rm","-rf","/mnt/sdcard/.syssave",NULL);
+  call_native("umount","/mnt/external_sd",NULL);
+  call_native("umount","/mnt/sdcard",NULL);
   // in case of "faked" bad rfs, remove the flag
-  call_busybox("sed","-i","s/^fs.system.rfs=.*/#fs.system.rfs=ok/","/tmp/sys/etc/steam.conf",NULL);
-  unmount_filesystem("/tmp/sys");
+  sprintf(path,"%s/etc/steam.conf",tmp);
+  call_busybox("sed","-i","s/^fs.system.rfs=.*/#fs.system.rfs=ok/",path,NULL);
+  unmount_filesystem(tmp);
   printf(CONVERT_WAIT_REBOOT);
   sleep(5);
   reboot_recovery();
@@ -383,112 +405,219 @@ int convert_system(int fromfstype, int tofstype)
   return 0;
 }
 
+typedef struct {
+  int oldtype;
+  int newtype;
+  const char* partition;
+  const char* loopname;
+  const char* mtname;
+  char key[KEY_MAX_LENGTH];
+  int backup_flag;
+  int changed;
+} ConvertPart;
+
+// adds the partition of the table with the root name, if the device has it
+static int add_convert_part(ConvertPart* parts, int n, const char* root, int oldtype, int newtype, int backup_flag)
+{
+  const PartitionDesc* desc = get_partition_desc_by_root(root);
+  if (!desc) return n;
+  parts[n].oldtype = oldtype;
+  parts[n].newtype = newtype;
+  parts[n].partition = desc->block;
+  parts[n].loopname = desc->loop;
+  parts[n].mtname = desc->name;
+  sprintf(parts[n].key,"fs.%s.type",desc->name);
+  parts[n].backup_flag = backup_flag;
+  parts[n].changed = 0;
+  return n+1;
+}
+
 int convert_filesystems(int oldcache,int newcache,int olddata, int newdata, int olddbdata, int newdbdata, char* secret)
 {
+  ConvertPart parts[3];
+  int nparts = 0;
+  nparts = add_convert_part(parts,nparts,"CACHE:",oldcache,newcache,BACKUP_CACHE);
+  nparts = add_convert_part(parts,nparts,"DATA:",olddata,newdata,BACKUP_DATA);
+  nparts = add_convert_part(parts,nparts,"DATADATA:",olddbdata,newdbdata,BACKUP_DATADATA);
   char* header[] = { CONVERT_FS_HEADER, NULL };
-  char* items[] = { CONVERT_FS_FULLBACKUP, CONVERT_FS_ONLYBACKUP, CONVERT_FS_RMBACKUP, CONVERT_FS_RMALL, CONVERT_FS_CANCEL, NULL };
+  char* items[7];
   char value[VALUE_MAX_LENGTH];
+  int i, n = 0, live = 0;
+  for (i=0; i<nparts; i++) {
+    parts[i].changed = parts[i].newtype && (parts[i].oldtype!=parts[i].newtype);
+    if (parts[i].changed && filesystem_can_convert_live(parts[i].oldtype,parts[i].newtype)) live = 1;
+  }
+  if (live) items[n++] = CONVERT_FS_LIVE;
+  items[n++] = CONVERT_FS_FULLBACKUP;
+  items[n++] = CONVERT_FS_ONLYBACKUP;
+  items[n++] = CONVERT_FS_RMBACKUP;
+  items[n++] = CONVERT_FS_RMALL;
+  items[n++] = CONVERT_FS_CANCEL;
+  items[n] = NULL;
   int chosen_item = get_menu_selection(header,items,0);
   if (chosen_item>=0) printf("%s\n",items[chosen_item]);
+  if (live) {
+    // the partitions that can't be converted in place get a full backup
+    live = chosen_item==0;
+    if (chosen_item>0) chosen_item--;
+  }
   if (chosen_item>=0 && chosen_item != 4) {
     char tmp[PATH_MAX];
+    int flags = 0;
     nandroid_generate_timestamp_path(tmp);
+    ui_set_page(TEXTCONTAINER_MAIN);
+    if (live) {
+      float range[2] = { 0, 1.0 };
+      call_native("mount",NULL);
+      ui_show_progress(1.0,0);
+      for (i=0; i<nparts; i++) {
+        if (!parts[i].changed || !filesystem_can_convert_live(parts[i].oldtype,parts[i].newtype)) continue;
+        ui_print(CONVERT_LIVE_START,parts[i].mtname);
+        ui_set_progress(0);
+        int r = filesystem_convert_live(parts[i].oldtype,parts[i].newtype,parts[i].partition,parts[i].loopname,parts[i].mtname,secret,
+                                        convert_progress,range);
+        if (r==0) {
+          parts[i].changed = 0;
+        } else if (r==CONVERT_LIVE_UNMOUNTED) {
+          // a backup now would only save the converted files, formatting would lose them
+          ui_print(CONVERT_LIVE_NOT_MOUNTED,parts[i].mtname);
+          parts[i].changed = 0;
+        } else {
+          ui_print(CONVERT_LIVE_FAILED,parts[i].mtname);
+        }
+      }
+    }
+    for (i=0; i<nparts; i++) {
+      if (parts[i].changed) flags |= parts[i].backup_flag;
+    }
+    if (!flags) {
+      ui_set_page(TEXTCONTAINER_STDOUT);
+      return 0;
+    }
     if (chosen_item==3) {
       // no backup
     } else {
-      int flags = 0;
-      call_busybox("mkdir","/mnt",NULL);
-      call_busybox("mkdir","/mnt/sdcard",NULL);
-      if (newcache && (oldcache!=newcache)) flags = flags | BACKUP_CACHE;
-      if (newdata && (olddata!=newdata)) flags = flags | BACKUP_DATA;
-      if (newdbdata && (olddbdata!=newdbdata)) flags = flags | BACKUP_DATADATA;
-      ui_set_page(TEXTCONTAINER_MAIN);
-      call_busybox("mount",NULL);
+      call_native("mkdir","/mnt",NULL);
+      call_native("mkdir","/mnt/sdcard",NULL);
+      call_native("mount",NULL);
       if (nandroid_backup_flags(tmp,flags)!=0) {
         ui_set_page(TEXTCONTAINER_STDOUT);
         return -1;
       }
     }
-    call_busybox("mount",NULL);
-    if (newcache && (oldcache!=newcache)) {
-      unmount_filesystem("/cache");
-      filesystem_format(newcache,CACHE_BLOCK_NAME,"loop1","cache",secret);
-      check_and_mount(newcache,CACHE_BLOCK_NAME,"loop1","cache",secret);
-      sprintf(value,"%d",newcache);
-      set_conf("fs.cache.type",value);
-    }
-    if (newdata && (olddata!=newdata)) {
-      unmount_filesystem("/data");
-      filesystem_format(newdata,DATA_BLOCK_NAME,"loop2","data",secret);
-      check_and_mount(newdata,DATA_BLOCK_NAME,"loop2","data",secret);
-      sprintf(value,"%d",newdata);
-      set_conf("fs.data.type",value);
-    }
-#ifdef HAS_DATADATA
-    if (newdbdata && (olddbdata!=newdbdata)) {
-      unmount_filesystem("/dbdata");
-      filesystem_format(newdbdata,DBDATA_BLOCK_NAME,"loop3","dbdata",secret);
-      check_and_mount(newdbdata,DBDATA_BLOCK_NAME,"loop3","dbdata",secret);
-      sprintf(value,"%d",newdbdata);
-      set_conf("fs.dbdata.type",value);
-    }
-#endif
-    call_busybox("mount",NULL);
+    call_native("mount",NULL);
+    FormatJob jobs[3];
+    const char* keys[3];
+    int count = 0;
+    for (i=0; i<nparts; i++) {
+      if (!parts[i].changed) continue;
+      char mtpath[PATH_MAX];
+      sprintf(mtpath,"/%s",parts[i].mtname);
+      unmount_filesystem(mtpath);
+      FormatJob job = { parts[i].newtype, parts[i].partition, parts[i].loopname, parts[i].mtname, 0 };
+      keys[count] = parts[i].key;
+      jobs[count++] = job;
+    }
+    int parallel = strcmp(get_conf_def("init.parallelformat",value,"1"),"1")==0;
+    format_filesystems(jobs,count,secret,parallel);
+    for (i=0; i<count; i++) {
+      // the type is saved even if mounting failed, the partition is formatted already
+      if (jobs[i].result==FORMAT_JOB_UNFORMATTED) continue;
+      sprintf(value,"%d",jobs[i].fstype);
+      set_conf(keys[i],value);
+    }
+    call_native("mount",NULL);
     if (chosen_item==0 || chosen_item==2) {
       nandroid_restore(tmp,0,0,1,1,0);
     }
     if (chosen_item==2) {
-      call_busybox("rm","-rf",tmp,NULL);
+      call_native("rm","-rf",tmp,NULL);
     }
     ui_set_page(TEXTCONTAINER_STDOUT);
   }
   return 0;
 }
 
+// copies the modules from the sdcard that differ from the ones in
+// /lib/modules. The copies keep their times, so they are only copied again
+// when they change
+static void update_sd_modules()
+{
+  static const char* files[] = { "ext2/ext2.ko", "ext4/jbd2.ko", "ext4/ext4.ko", "jfs/jfs.ko", NULL };
+  int i;
+  call_native("mkdir","/mnt",NULL);
+  call_native("mkdir","/mnt/sdcard",NULL);
+  if (call_native("mount","-t","vfat","-o","ro,utf8",SDCARD_BLOCK_NAME,"/mnt/sdcard",NULL)) return;
+  for (i=0; files[i]; i++) {
+    char from[PATH_MAX];
+    char to[PATH_MAX];
+    struct stat sf, st;
+    sprintf(from,"/mnt/sdcard/steam/%s",files[i]);
+    sprintf(to,"/lib/modules/%s",strchr(files[i],'/')+1);
+    if (stat(from,&sf)) continue;
+    if (stat(to,&st)==0 && st.st_size==sf.st_size && st.st_mtime==sf.st_mtime) continue;
+    native_copy(from,to,NATIVE_COPY_PRESERVE);
+  }
+  call_native("umount","/mnt/sdcard",NULL);
+}
+
 int autoload_modules()
 {
   char value[VALUE_MAX_LENGTH];
   if (strcmp(get_conf_def("modules.autoload",value,"0"),"1")==0)
   {
-    if (strcmp(get_conf_def("modules.allowsd",value,"0"),"1")==0) {
-      call_busybox("mkdir","/mnt",NULL);
-      call_busybox("mkdir","/mnt/sdcard",NULL);
-      call_busybox("mount","-t","vfat","-o","utf8",SDCARD_BLOCK_NAME,"/mnt/sdcard",NULL);
-      call_busybox("cp","/mnt/sdcard/steam/ext2/ext2.ko","/lib/modules",NULL);
-      call_busybox("cp","/mnt/sdcard/steam/ext4/jbd2.ko","/lib/modules",NULL);
-      call_busybox("cp","/mnt/sdcard/steam/ext4/ext4.ko","/lib/modules",NULL);
-      call_busybox("cp","/mnt/sdcard/steam/jfs/jfs.ko","/lib/modules",NULL);
-      call_busybox("umount","/mnt/sdcard",NULL);
-    }
-
+    ModloadEntry modules[4];
+    int num = 0;
     if (!get_capability("fs.support.ext2",NULL)) {
-      call_busybox("insmod","/lib/modules/ext2.ko",NULL);
+      modules[num++] = (ModloadEntry){ "ext2", "/lib/modules/ext2.ko", NULL, NULL };
     }
     if (!get_capability("fs.support.ext4",NULL)) {
-      call_busybox("insmod","/lib/modules/jbd2.ko",NULL);
-      call_busybox("insmod","/lib/modules/ext4.ko",NULL);
+      modules[num++] = (ModloadEntry){ "jbd2", "/lib/modules/jbd2.ko", NULL, NULL };
+      modules[num++] = (ModloadEntry){ "ext4", "/lib/modules/ext4.ko", "jbd2", NULL };
     }
     if (!get_capability("fs.support.jfs",NULL)) {
-      call_busybox("insmod","/lib/modules/jfs.ko",NULL);
+      modules[num++] = (ModloadEntry){ "jfs", "/lib/modules/jfs.ko", NULL, NULL };
     }
+    // the sdcard is only needed if something is going to be loaded
+    if (num && strcmp(get_conf_def("modules.allowsd",value,"0"),"1")==0) update_sd_modules();
+    modload(modules,num);
     return 1;
   }
   return 0;
 }
 
+// the graphics and the flash drivers are loaded side by side
+static const ModloadEntry g_boot_modules[] = {
+  { "pvrsrvkm", "/modules/pvrsrvkm.ko", NULL, NULL },
+  { "s3c_lcd", "/modules/s3c_lcd.ko", "pvrsrvkm", NULL },
+  { "s3c_bc", "/modules/s3c_bc.ko", "s3c_lcd", NULL },
+  { "fsr", "/lib/modules/fsr.ko", NULL, NULL },
+  { "fsr_stl", "/lib/modules/fsr_stl.ko", "fsr", NULL },
+  { "rfs_glue", "/lib/modules/rfs_glue.ko", "fsr_stl", NULL },
+  { "rfs_fat", "/lib/modules/rfs_fat.ko", "rfs_glue", NULL },
+  { "j4fs", "/lib/modules/j4fs.ko", "fsr_stl", NULL },
+  { "param", "/lib/modules/param.ko", "j4fs", NULL },
+};
+
+static void mount_progress(int done, int count) {
+  ui_set_progress(0.6+0.3*done/count);
+}
+
 int steam_init_main(int argc, char* argv[]) {
   // STAGE 1: initialize proc, sys and tmp
+  system_trace_stage("init stage 1");
   // If these fail we're doomed anyway...
-  call_busybox("mkdir","/proc",NULL);
-  call_busybox("mkdir","/sys",NULL);
-  call_busybox("mkdir","/tmp",NULL);
-  call_busybox("mount","-t","proc","proc","/proc",NULL);
-  call_busybox("mount","-t","sysfs","sys","/sys",NULL);
-  call_busybox("mount","-t","tmpfs","tmpfs","/tmp",NULL);
+  call_native("mkdir","/proc",NULL);
+  call_native("mkdir","/sys",NULL);
+  call_native("mkdir","/tmp",NULL);
+  call_native("mount","-t","proc","proc","/proc",NULL);
+  call_native("mount","-t","sysfs","sys","/sys",NULL);
+  call_native("mount","-t","tmpfs","tmpfs","/tmp",NULL);
 
   // tmpfs is up, redirect stdout and stderr to /tmp
   freopen(INIT_LOG_FILE,"a+",stdout);setbuf(stdout,NULL);
   freopen(INIT_LOG_FILE,"a+",stderr);setbuf(stderr,NULL);
+  check_trace();
   printf("     /--------  /-----     /||        ||\n");
   printf("    / \\------/ //-----    //||\\      /||\n");
   printf("   /     ||   //         // ||\\\\    //||\n");
@@ -504,78 +633,16 @@ int steam_init_main(int argc, char* argv[]) {
 
   // STAGE 2: load up modules and create initial directory and device system
   printf(INIT_STAGE,2);
-  call_busybox("insmod","/modules/pvrsrvkm.ko",NULL);
-  call_busybox("insmod","/modules/s3c_lcd.ko",NULL);
-  call_busybox("insmod","/modules/s3c_bc.ko",NULL);
-
-  call_busybox("insmod","/lib/modules/fsr.ko",NULL);
-  call_busybox("insmod","/lib/modules/fsr_stl.ko",NULL);
-  call_busybox("insmod","/lib/modules/rfs_glue.ko",NULL);
-  call_busybox("insmod","/lib/modules/rfs_fat.ko",NULL);
-  call_busybox("insmod","/lib/modules/j4fs.ko",NULL);
-  call_busybox("insmod","/lib/modules/param.ko",NULL);
-
-  call_busybox("mkdir","/dev",NULL);
-
-  call_busybox("mkdir","/dev/block",NULL);
-  call_busybox("mkdir","/dev/snd",NULL);
-
-  call_busybox("mknod","/dev/null","c","1","3",NULL);
-  call_busybox("mknod","/dev/zero","c","1","5",NULL);
-  call_busybox("mknod","/dev/random","c","1","8",NULL);
-  call_busybox("mknod","/dev/urandom","c","1","9",NULL);
-
-  // internal and external sd card
-  call_busybox("mknod","/dev/block/mmcblk0","b","179","0",NULL);
-  call_busybox("mknod","/dev/block/mmcblk0p1","b","179","1",NULL);
-  call_busybox("mknod","/dev/block/mmcblk0p2","b","179","2",NULL);
-
-  call_busybox("mknod","/dev/block/mmcblk1","b","179","8",NULL);
-  call_busybox("mknod","/dev/block/mmcblk1p1","b","179","9",NULL);
-
-  // ROM blocks
-  call_busybox("mknod","/dev/block/stl1","b","138","1",NULL);
-  call_busybox("mknod","/dev/block/stl2","b","138","2",NULL);
-  call_busybox("mknod","/dev/block/stl3","b","138","3",NULL);
-  call_busybox("mknod","/dev/block/stl4","b","138","4",NULL);
-  call_busybox("mknod","/dev/block/stl5","b","138","5",NULL);
-  call_busybox("mknod","/dev/block/stl6","b","138","6",NULL);
-  call_busybox("mknod","/dev/block/stl7","b","138","7",NULL);
-  call_busybox("mknod","/dev/block/stl8","b","138","8",NULL);
-  call_busybox("mknod","/dev/block/stl9","b","138","9",NULL);
-  call_busybox("mknod","/dev/block/stl10","b","138","10",NULL);
-  call_busybox("mknod","/dev/block/stl11","b","138","11",NULL);
-  call_busybox("mknod","/dev/block/stl12","b","138","12",NULL);
-
-  // loop devices. loop0 will be unused to keep it free for mods
-  call_busybox("mknod","/dev/block/loop0","b","7","0",NULL);
-  call_busybox("mknod","/dev/block/loop1","b","7","1",NULL);
-  call_busybox("mknod","/dev/block/loop2","b","7","2",NULL);
-  call_busybox("mknod","/dev/block/loop3","b","7","3",NULL);
-  call_busybox("mknod","/dev/block/loop4","b","7","4",NULL);
-  call_busybox("mknod","/dev/block/loop5","b","7","5",NULL);
-  call_busybox("mknod","/dev/block/loop6","b","7","6",NULL);
-  call_busybox("mknod","/dev/block/loop7","b","7","7",NULL);
-
-  // framebuffer support for display
-  call_busybox("mkdir","/dev/graphics",NULL);
-  call_busybox("mknod","/dev/graphics/fb0","c","29","0",NULL);
-  call_busybox("mknod","/dev/graphics/fb1","c","29","1",NULL);
-  call_busybox("mknod","/dev/graphics/fb2","c","29","2",NULL);
-  call_busybox("mknod","/dev/graphics/fb3","c","29","3",NULL);
-  call_busybox("mknod","/dev/graphics/fb4","c","29","4",NULL);
-
-  // touch screen and keyboard support
-  call_busybox("mkdir","/dev/input",NULL);
-  call_busybox("mknod","/dev/input/event0","c","13","64",NULL);
-  call_busybox("mknod","/dev/input/event1","c","13","65",NULL);
-  call_busybox("mknod","/dev/input/event2","c","13","66",NULL);
-  call_busybox("mknod","/dev/input/event3","c","13","67",NULL);
-  call_busybox("mknod","/dev/input/event4","c","13","68",NULL);
-  call_busybox("mknod","/dev/input/mice","c","13","63",NULL);
-  call_busybox("mknod","/dev/input/mouse0","c","13","32",NULL);
-
-  call_busybox("mkdir","/dev/mapper",NULL);
+  system_trace_stage("init stage 2");
+  modload(g_boot_modules,sizeof(g_boot_modules)/sizeof(g_boot_modules[0]));
+
+  call_native("mkdir","/dev",NULL);
+
+  // nodes of every device the kernel has found by now, in place of a
+  // hard coded list. Loop devices are created by loopdev when needed
+  printf(INIT_COLDPLUG,coldplug("/dev"));
+  call_native("mkdir","/dev/block",NULL);
+  call_native("mkdir","/dev/mapper",NULL);
 
   printf(INIT_DEVICES_DONE);
   sprintf(TEMPORARY_LOG_FILE,"%s",INIT_LOG_FILE);
@@ -592,9 +659,9 @@ int steam_init_main(int argc, char* argv[]) {
   if (get_conf("preinit.graphics",value) && strcmp(value,"1")==0) usegraphics = 1;
   if (isrecovery && get_conf("preinit.recovery.graphics",value) && strcmp(value,"1")==0) usegraphics = 1;
   if (usegraphics) {
+    // only the splash, the menus and logs are loaded when a menu is shown
     printf(INIT_LOAD_GRAPHICS);
-    ui_init();
-    ui_set_page(TEXTCONTAINER_STDOUT);
+    ui_init_splash();
     ui_show_progress(1,0);
   }
   if (isrecovery) printf("\n\nRECOVERY MODE\n\n");
@@ -611,27 +678,47 @@ int steam_init_main(int argc, char* argv[]) {
 
   printf(INIT_CREATE_MOUNT);
   autoload_modules();
-  call_busybox("mkdir","/cache",NULL);
+  // devices of the modules just loaded
+  coldplug("/dev");
+  call_native("mkdir","/cache",NULL);
 #ifdef HAS_DATADATA
-  call_busybox("mkdir","/dbdata",NULL);
+  call_native("mkdir","/dbdata",NULL);
 #endif
-  call_busybox("mkdir","/data",NULL);
-  call_busybox("mkdir","/system",NULL);
+  call_native("mkdir","/data",NULL);
+  call_native("mkdir","/system",NULL);
   if (usegraphics) ui_set_progress(0.3);
 
   // STAGE 3: Do everything to get /system mounted
   printf(INIT_STAGE,3);
-  // we don't know much about /system, as the config file is stored there4
-  int system_type = 0;
+  system_trace_stage("init stage 3");
+  const PartitionDesc* sysdesc = get_partition_desc_by_root("SYSTEM:");
+  // we don't know much about /system, as the config file is stored there,
+  // only what the detection cache remembers from the last boot
+  int system_type = detect_cache_lookup(MAIN_BLOCK_NAME);
+  int mounted = 0;
+  if (system_type) {
+    printf(INIT_DETECT_CACHED,MAIN_BLOCK_NAME,system_type);
+    mounted = check_and_mount(system_type,MAIN_BLOCK_NAME,sysdesc->loop,MAIN_BLOCK_LABEL,NULL)==0;
+    if (mounted && filesystem_rfs_bad(system_type,MAIN_BLOCK_LABEL)) {
+      // detect it again, so that it's offered to be fixed
+      if (unmount_filesystem(MAIN_BLOCK_MTP)) call_native("umount","-f",MAIN_BLOCK_MTP,NULL);
+      mounted = 0;
+    }
+    if (!mounted) system_type = 0;
+  }
   int count = 0;
-  while (system_type==0 && count<20) {
+  while (!mounted && system_type==0 && count<20) {
     system_type = filesystem_check(MAIN_BLOCK_NAME);
-    sleep(1);
+    // the block device might not be ready yet, nor its node
+    if (system_type==0) {
+      sleep(1);
+      coldplug("/dev");
+    }
     count++;
   }
-  if (system_type&TYPE_RFS_BAD) {
+  if (!mounted && (system_type&TYPE_RFS_BAD)) {
     // inconsistent rfs state, asking user to fix it
-    if (!usegraphics) { ui_init(); ui_set_page(TEXTCONTAINER_STDOUT); }
+    ui_init(); ui_set_page(TEXTCONTAINER_STDOUT);
     char* headers[] = { INIT_RFS_INCONSISTENT_FIX_HEADER, NULL };
     char* items[] = { INIT_RFS_INCONSISTENT_FIX_TAR, INIT_RFS_INCONSISTENT_FIX_NONE, INIT_RFS_INCONSISTENT_FIX_NONE2, NULL };
     int chosen_item = -1;
@@ -641,31 +728,44 @@ int steam_init_main(int argc, char* argv[]) {
     if (chosen_item==0) {
       convert_system(TYPE_RFS|TYPE_RFS_BAD,TYPE_RFS);
     } else if (chosen_item==1) {
-      call_busybox("mount","-t","rfs","-o",TYPE_RFS_BAD_DEFAULT_MOUNT,MAIN_BLOCK_NAME,MAIN_BLOCK_MTP,NULL);
+      call_native("mount","-t","rfs","-o",TYPE_RFS_BAD_DEFAULT_MOUNT,MAIN_BLOCK_NAME,MAIN_BLOCK_MTP,NULL);
     } else if (chosen_item==2) {
-      call_busybox("mount","-t","rfs","-o",TYPE_RFS_DEFAULT_MOUNT,MAIN_BLOCK_NAME,MAIN_BLOCK_MTP,NULL);
+      call_native("mount","-t","rfs","-o",TYPE_RFS_DEFAULT_MOUNT,MAIN_BLOCK_NAME,MAIN_BLOCK_MTP,NULL);
     }
     if (!usegraphics) ui_done();
-  } else {
-    check_and_mount(system_type,MAIN_BLOCK_NAME,"loop4",MAIN_BLOCK_LABEL,NULL);
+  } else if (!mounted) {
+    if (check_and_mount(system_type,MAIN_BLOCK_NAME,sysdesc->loop,MAIN_BLOCK_LABEL,NULL)==0) {
+      detect_cache_store(MAIN_BLOCK_NAME,system_type);
+    }
   }
-  if (strcmp(MAIN_BLOCK_NAME,SYSTEM_BLOCK_NAME)) {
+  if (strcmp(MAIN_BLOCK_NAME,sysdesc->block)) {
     // we need to mount system if it's not the main partition
-    system_type = mount_from_config_or_autodetect("fs.system.type",SYSTEM_BLOCK_NAME,"loop4","system",NULL);
+    char key[KEY_MAX_LENGTH];
+    sprintf(key,"fs.%s.type",sysdesc->name);
+    system_type = mount_from_config_or_autodetect(key,sysdesc->block,sysdesc->loop,sysdesc->name,NULL);
   }
   // system is now mounted/fixed
-  call_busybox("rm","/system/bin/fat.format",NULL);
-  call_busybox("ln","-s","/system/etc/","/etc",NULL);
-  call_busybox("cp","/res/misc/mke2fs.conf","/etc",NULL);
+  call_native("rm","/system/bin/fat.format",NULL);
+  call_native("ln","-s","/system/etc/","/etc",NULL);
+  call_native("cp","/res/misc/mke2fs.conf","/etc",NULL);
   if (usegraphics) ui_set_progress(0.4);
 
   // STAGE 4: check for Steam
   printf(INIT_STAGE,4);
+  system_trace_stage("init stage 4");
   // check if steam is installed. If not ask the user whether he wants to install it or not.
   struct stat s;
-  if (stat(CONFIG_SYSTEM,&s) || s.st_size<10) {
+  // with a plan from an unchanged config nothing is pending: no install,
+  // upgrade or conversion
+  BootPlan plan;
+  int fastpath = bootplan_load(&plan)==0;
+  int pending = 0;
+  if (fastpath) {
+    printf(INIT_BOOTPLAN);
+    init_conf();
+  } else if (stat(CONFIG_SYSTEM,&s) || s.st_size<10) {
     // nope
-    if (!usegraphics) { ui_init(); ui_set_page(TEXTCONTAINER_STDOUT); }
+    ui_init(); ui_set_page(TEXTCONTAINER_STDOUT);
     char* headers[] = { INSTALL_STEAM_HEADER, NULL };
     char* items[] = { INSTALL_STEAM_YES, INSTALL_STEAM_NO, NULL };
     int chosen_item = -1;
@@ -673,13 +773,14 @@ int steam_init_main(int argc, char* argv[]) {
       chosen_item = get_menu_selection(headers,items,0);
     }
     if (chosen_item==0) {
-      call_busybox("rm","/system/etc/steam.conf",NULL);
-      call_busybox("cp",CONFIG_SBIN,CONFIG_SYSTEM,NULL);
-      call_busybox("touch",CONFIG_SYSTEM,NULL);
+      call_native("rm","/system/etc/steam.conf",NULL);
+      call_native("cp",CONFIG_SBIN,CONFIG_SYSTEM,NULL);
+      call_native("touch",CONFIG_SYSTEM,NULL);
       init_conf();
       set_conf("steam.installation","1");
     } else {
       init_conf();
+      pending = 1;
     }
     if (!usegraphics) ui_done();
   } else {
@@ -698,7 +799,7 @@ int steam_init_main(int argc, char* argv[]) {
     value[0]='\0';  get_conf_ro("steam.variant.version",value);
     if (strcmp(value,varvers)) diff = 1;
     if (diff) {
-      if (!usegraphics) { ui_init(); ui_set_page(TEXTCONTAINER_STDOUT); }
+      ui_init(); ui_set_page(TEXTCONTAINER_STDOUT);
       char* headers[] = { UPGRADE_STEAM_HEADER, NULL };
       char* items[] = { UPGRADE_STEAM_YES, UPGRADE_STEAM_NO, UPGRADE_STEAM_SKIP, NULL };
       int chosen_item = -1;
@@ -707,32 +808,40 @@ int steam_init_main(int argc, char* argv[]) {
       }
       if (!usegraphics) ui_done();
       if (chosen_item==0) {
-        call_busybox("rm","/system/etc/steam.conf.old",NULL);
+        call_native("rm","/system/etc/steam.conf.old",NULL);
         call_busybox("mv","/system/etc/steam.conf","/system/etc/steam.conf.old",NULL);
         sh("/sbin/busybox cat "CONFIG_SBIN" "CONFIG_SYSTEM".old > "CONFIG_SYSTEM);
-        call_busybox("touch",CONFIG_SYSTEM,NULL);
+        call_native("touch",CONFIG_SYSTEM,NULL);
         init_conf();
         set_conf("steam.old.version",version);
         set_conf("steam.old.variant",variant);
         set_conf("steam.old.variant.version",varvers);
         set_conf("steam.upgrade","1");
       } else if (chosen_item==1) {
-        call_busybox("rm","/system/etc/steam.conf",NULL);
-        call_busybox("cp",CONFIG_SBIN,CONFIG_SYSTEM,NULL);
-        call_busybox("touch",CONFIG_SYSTEM,NULL);
+        call_native("rm","/system/etc/steam.conf",NULL);
+        call_native("cp",CONFIG_SBIN,CONFIG_SYSTEM,NULL);
+        call_native("touch",CONFIG_SYSTEM,NULL);
         init_conf();
         set_conf("steam.installation","1");
       } else {
         init_conf();
+        // asked again on the next boot
+        pending = 1;
       }
     } else {
       init_conf();
     }
   }
 
-  // save the system type
-  sprintf(value,"%d",system_type);
-  set_conf("fs.system.type",value);
+  // the rw config might have enabled tracing
+  check_trace();
+
+  // save the system type. Every write changes the config, only do it if needed
+  if (!fastpath || plan.system_type!=system_type) {
+    char old[VALUE_MAX_LENGTH];
+    sprintf(value,"%d",system_type);
+    if (!get_conf("fs.system.type",old) || strcmp(old,value)) set_conf("fs.system.type",value);
+  }
 
   // we check this again, as the rw config might have set this variable too
   autoload_modules();
@@ -741,8 +850,7 @@ int steam_init_main(int argc, char* argv[]) {
     if (!usegraphics) {
       usegraphics = 1;
       printf(INIT_LOAD_GRAPHICS);
-      ui_init();
-      ui_set_page(TEXTCONTAINER_STDOUT);
+      ui_init_splash();
       ui_show_progress(1,0);
       ui_set_progress(0.5); //we're at 50% already, wow! :)
     }
@@ -750,13 +858,14 @@ int steam_init_main(int argc, char* argv[]) {
 
   // STAGE 5: convert filesystem on /system if needed
   printf(INIT_STAGE,5);
-  if (get_conf("fs.system.convertto",value)) {
+  system_trace_stage("init stage 5");
+  if (!fastpath && get_conf("fs.system.convertto",value)) {
     int newfs = 0;
     if (sscanf(value,"%d",&newfs)!=1) newfs = 0;
     set_conf("fs.system.convertto",NULL);
     if (newfs&TYPE_FSTYPE_MASK) {
       if (system_type!=newfs) {
-        if (!usegraphics) ui_init();
+        ui_init(); ui_set_page(TEXTCONTAINER_STDOUT);
         if (confirm_selection(CONVERT_SYSTEM_SURE,CONVERT_SYSTEM_CONFIRM)) {
           unmount_filesystem("/system");
           convert_system(system_type,newfs);
@@ -766,55 +875,79 @@ int steam_init_main(int argc, char* argv[]) {
     }
   }
 
-  if (strcmp(get_conf_def("fs.system.efs",value,"0"),"1")==0) {
+  int efs = fastpath ? plan.efs : strcmp(get_conf_def("fs.system.efs",value,"0"),"1")==0;
+  if (efs) {
     struct stat s;
+    // even on the fast path: the copy may have been removed since
     if (stat("/system/efs",&s)) {
       // create a copy of /efs inside /system
-      call_busybox("mkdir","/efs",NULL);
-      call_busybox("mount","-t","rfs","-o",TYPE_RFS_DEFAULT_MOUNT,EFS_BLOCK_NAME,"/efs",NULL);
-      call_busybox("cp","-R","/efs","/system",NULL);
-      call_busybox("umount","/efs",NULL);
-      call_busybox("rmdir","/efs",NULL);
+      call_native("mkdir","/efs",NULL);
+      call_native("mount","-t","rfs","-o",TYPE_RFS_DEFAULT_MOUNT,EFS_BLOCK_NAME,"/efs",NULL);
+      call_native("cp","-R","/efs","/system",NULL);
+      call_native("umount","/efs",NULL);
+      call_native("rmdir","/efs",NULL);
     }
     // and use that
-    call_busybox("ln","-s","/system/efs","/efs",NULL);
+    call_native("ln","-s","/system/efs","/efs",NULL);
   } else {
     // else mount /efs normally
-    call_busybox("rm","-rf","/system/efs",NULL);
-    call_busybox("mkdir","/efs",NULL);
-    call_busybox("mount","-t","rfs","-o",TYPE_RFS_DEFAULT_MOUNT,EFS_BLOCK_NAME,"/efs",NULL);
+    if (!fastpath) call_native("rm","-rf","/system/efs",NULL);
+    call_native("mkdir","/efs",NULL);
+    call_native("mount","-t","rfs","-o",TYPE_RFS_DEFAULT_MOUNT,EFS_BLOCK_NAME,"/efs",NULL);
   }
 
   // STAGE 6: Mount all other filesystems
   printf(INIT_STAGE,6);
+  system_trace_stage("init stage 6");
   char secret[256];secret[0] = '\0';
   ui_set_progress(0.6);
-  int cache_type = mount_from_config_or_autodetect("fs.cache.type",CACHE_BLOCK_NAME,"loop1","cache",secret);
-  ui_set_progress(0.7);
-  int data_type = mount_from_config_or_autodetect("fs.data.type",DATA_BLOCK_NAME,"loop2","data",secret);
-  ui_set_progress(0.8);
-#ifdef HAS_DATADATA
-  int dbdata_type = mount_from_config_or_autodetect("fs.dbdata.type",DBDATA_BLOCK_NAME,"loop3","dbdata",secret);
-#else
-  int dbdata_type = 0;
-#endif
+  // the partitions of the table besides system, types[] is in this order
+  const char* roots[] = { "CACHE:", "DATA:", "DATADATA:" };
+  int types[3] = { 0, 0, 0 };
+  int which[3];
+  MountJob jobs[3];
+  char keys[3][KEY_MAX_LENGTH];
+  int njobs = 0;
+  int i;
+  for (i=0; i<3; i++) {
+    const PartitionDesc* desc = get_partition_desc_by_root(roots[i]);
+    if (!desc) continue;
+    sprintf(keys[njobs],"fs.%s.type",desc->name);
+    MountJob job = { keys[njobs], desc->block, desc->loop, desc->name, 0 };
+    which[njobs] = i;
+    jobs[njobs++] = job;
+  }
+  int parallel = strcmp(get_conf_def("init.parallelmount",value,"1"),"1")==0;
+  mount_from_config_parallel(jobs,njobs,secret,parallel,mount_progress);
+  for (i=0; i<njobs; i++) types[which[i]] = jobs[i].fstype;
+  int cache_type = types[0];
+  int data_type = types[1];
+  int dbdata_type = types[2];
   ui_set_progress(0.9);
   // STAGE 7: convert filesystems
   printf(INIT_STAGE,7);
+  system_trace_stage("init stage 7");
 
   int newcache = 0;
   int newdata = 0;
   int newdbdata = 0;
-  if (get_conf("fs.cache.convertto",value) && sscanf(value,"%d",&newcache)==1) {} else newcache=0;
-  if (get_conf("fs.data.convertto",value) && sscanf(value,"%d",&newdata)==1) {} else newdata=0;
-#ifdef HAS_DATADATA
-  if (get_conf("fs.dbdata.convertto",value) && sscanf(value,"%d",&newdbdata)==1) {} else newdbdata=0;
-#endif
-  set_conf("fs.cache.convertto",NULL);
-  set_conf("fs.data.convertto",NULL);
+  if (!fastpath) {
+    // only clear the keys that are set, each write rewrites the config
+    if (get_conf("fs.cache.convertto",value)) {
+      if (sscanf(value,"%d",&newcache)!=1) newcache=0;
+      set_conf("fs.cache.convertto",NULL);
+    }
+    if (get_conf("fs.data.convertto",value)) {
+      if (sscanf(value,"%d",&newdata)!=1) newdata=0;
+      set_conf("fs.data.convertto",NULL);
+    }
 #ifdef HAS_DATADATA
-  set_conf("fs.dbdata.convertto",NULL);
+    if (get_conf("fs.dbdata.convertto",value)) {
+      if (sscanf(value,"%d",&newdbdata)!=1) newdbdata=0;
+      set_conf("fs.dbdata.convertto",NULL);
+    }
 #endif
+  }
   if (newcache==cache_type) newcache=0;
   if (newdata==data_type) newdata=0;
 #ifdef HAS_DATADATA
@@ -822,36 +955,54 @@ int steam_init_main(int argc, char* argv[]) {
 #endif
   if (newcache || newdata || newdbdata) {
     // at least one filesystem needs reformatting
-    if (!usegraphics) ui_init();
+    ui_init();
     convert_filesystems(cache_type,newcache,data_type,newdata,dbdata_type,newdbdata,secret);
     if (!usegraphics) ui_done();
   }
   memset(secret,0,sizeof(secret));
+  luks_forget_keys();
 
   // STAGE 8: modify init.rc and start
   printf(INIT_STAGE,8);
+  system_trace_stage("init stage 8");
   ui_set_progress(1.0);
 
   // this is device specific
   fix_init(isrecovery);
 
   //TODO: if we're on a modified initramfs, these settings won't turn the properties off!
+  RcEdit props[3];
+  int nprops = 0;
   if (strcmp(get_conf_def("adb.root",value,"0"),"0")) {
     if ((isrecovery && strcmp(value,"1")==0) || (strcmp(value,"3")==0) || (strcmp(value,"2")==0)) {
-      call_busybox("sed","-i","s/ro.debuggable=0/ro.debuggable=1/","default.prop",NULL);
+      RcEdit debuggable = { RC_REPLACE, "ro.debuggable=0", "ro.debuggable=1", 0, 0 };
+      props[nprops++] = debuggable;
       if ((isrecovery && strcmp(value,"1")==0) || (strcmp(value,"3")==0)) {
-        call_busybox("sed","-i","s/ro.secure=1/ro.secure=0/","default.prop",NULL);
+        RcEdit secure = { RC_REPLACE, "ro.secure=1", "ro.secure=0", 0, 0 };
+        props[nprops++] = secure;
       }
     }
   }
 
   if (strcmp(get_conf_def("adb.boot",value,"0"),"0")) {
     if ((isrecovery && strcmp(value,"1")==0) || (strcmp(value,"2")==0)) {
-      call_busybox("sed","-i","s/persist.service.adb.enable=0/persist.service.adb.enable=1/","default.prop",NULL);
+      RcEdit adb = { RC_REPLACE, "persist.service.adb.enable=0", "persist.service.adb.enable=1", 0, 0 };
+      props[nprops++] = adb;
     }
   }
+  // all of them in one pass
+  if (nprops) rc_edit_file("/default.prop",props,nprops);
+
+  // everything is done, the next boot can skip the checks while the config
+  // stays the same
+  if (!fastpath && !pending) {
+    plan.system_type = system_type;
+    plan.efs = efs;
+    bootplan_save(&plan);
+  }
 
   if (usegraphics) ui_done();
+  system_trace_stage(NULL);
   // parent will continue, and load up init
   char* argp[] = {"init",NULL};
   execve("/init.original",argp,environ);
@@ -0,0 +1,252 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "initd.h"
+#include "system.h"
+#include "locale.h"
+
+#define INITD_MAX_DEPS 16
+#define INITD_HEADER_SIZE 2048
+#define INITD_POLL_US 10000
+#define INITD_KILL_GRACE_US 1000000
+
+#define SCRIPT_WAITING 0
+#define SCRIPT_RUNNING 1
+#define SCRIPT_DONE 2
+
+typedef struct {
+  char name[NAME_MAX+1];
+  char deps[INITD_MAX_DEPS][NAME_MAX+1];
+  int ndeps;
+  int after_all;                // "after: *"
+  int timeout;
+  int state;
+  pid_t pid;
+  unsigned long long start;
+  int killed;                   // 1 after SIGTERM, 2 after SIGKILL
+  unsigned long long killtime;
+  int status;
+} InitdScript;
+
+static int compare_name(const void* a, const void* b)
+{
+  return strcmp(((const InitdScript*)a)->name,((const InitdScript*)b)->name);
+}
+
+// "# key: value" lines in the first part of the script
+static void parse_headers(InitdScript* sc, const char* path)
+{
+  char buf[INITD_HEADER_SIZE+1];
+  char* line;
+  char* save;
+  int fd = open(path,O_RDONLY);
+  int len;
+  if (fd<0) return;
+  len = read(fd,buf,INITD_HEADER_SIZE);
+  close(fd);
+  if (len<=0) return;
+  buf[len] = '\0';
+  for (line = strtok_r(buf,"\n",&save); line; line = strtok_r(NULL,"\n",&save)) {
+    char* p = line;
+    if (*p!='#') continue;
+    p++;
+    while (*p==' ' || *p=='\t') p++;
+    if (strncmp(p,"after:",6)==0) {
+      char* dep;
+      char* dsave;
+      for (dep = strtok_r(p+6," \t\r",&dsave); dep; dep = strtok_r(NULL," \t\r",&dsave)) {
+        if (strcmp(dep,"*")==0) {
+          sc->after_all = 1;
+        } else if (sc->ndeps<INITD_MAX_DEPS && strlen(dep)<=NAME_MAX) {
+          strcpy(sc->deps[sc->ndeps++],dep);
+        }
+      }
+    } else if (strncmp(p,"timeout:",8)==0) {
+      sc->timeout = atoi(p+8);
+    }
+  }
+}
+
+static int load_scripts(const char* dir, char prefix, int timeout, InitdScript* scripts)
+{
+  DIR* d = opendir(dir);
+  struct dirent* entry;
+  int num = 0;
+  int i;
+  if (!d) return 0;
+  while ((entry = readdir(d)) != NULL && num<INITD_MAX_SCRIPTS) {
+    char path[PATH_MAX];
+    struct stat s;
+    if (entry->d_name[0]!=prefix) continue;
+    snprintf(path,sizeof(path),"%s/%s",dir,entry->d_name);
+    if (stat(path,&s) || !S_ISREG(s.st_mode)) continue;
+    memset(&scripts[num],0,sizeof(scripts[num]));
+    strcpy(scripts[num].name,entry->d_name);
+    scripts[num].timeout = timeout;
+    num++;
+  }
+  closedir(d);
+  qsort(scripts,num,sizeof(*scripts),compare_name);
+  for (i=0; i<num; i++) {
+    char path[PATH_MAX];
+    snprintf(path,sizeof(path),"%s/%s",dir,scripts[i].name);
+    parse_headers(&scripts[i],path);
+  }
+  return num;
+}
+
+// a script can start if everything it waits for is done. Dependencies on
+// scripts that don't exist are ignored
+static int is_ready(InitdScript* scripts, int num, int i)
+{
+  int j, k;
+  if (scripts[i].after_all) {
+    for (j=0; j<i; j++) if (scripts[j].state!=SCRIPT_DONE) return 0;
+  }
+  for (k=0; k<scripts[i].ndeps; k++) {
+    for (j=0; j<num; j++) {
+      if (j!=i && strcmp(scripts[j].name,scripts[i].deps[k])==0 && scripts[j].state!=SCRIPT_DONE) return 0;
+    }
+  }
+  return 1;
+}
+
+static pid_t start_script(const char* dir, InitdScript* sc)
+{
+  char path[PATH_MAX];
+  char log[PATH_MAX];
+  time_t t;
+  pid_t pid;
+  snprintf(path,sizeof(path),"%s/%s",dir,sc->name);
+  snprintf(log,sizeof(log),INITD_LOG_DIR"/%s.log",sc->name);
+  t = time(NULL);
+  printf(INITD_STARTX,ctime(&t),sc->name);
+  sc->start = system_trace_now();
+  pid = fork();
+  if (pid==0) {
+    // own process group, so a timeout kills whatever it started too
+    setpgid(0,0);
+    int fd = open(log,O_WRONLY|O_CREAT|O_TRUNC,0644);
+    if (fd>=0) {
+      dup2(fd,1);
+      dup2(fd,2);
+      if (fd>2) close(fd);
+    }
+    execl(_PATH_BSHELL,"sh",path,(char*)NULL);
+    _exit(127);
+  }
+  if (pid>0) setpgid(pid,pid);
+  return pid;
+}
+
+static void finish_script(InitdScript* sc, int status)
+{
+  time_t t = time(NULL);
+  sc->state = SCRIPT_DONE;
+  sc->pid = 0;
+  if (WIFEXITED(status)) sc->status = WEXITSTATUS(status);
+  else sc->status = WIFSIGNALED(status) ? 128+WTERMSIG(status) : -1;
+  system_trace_span(SYSTEM_TRACE_SCRIPT,sc->name,sc->start,sc->status);
+  if (sc->killed) {
+    printf(INITD_KILLEDX,ctime(&t),sc->name,sc->timeout);
+  } else if (sc->status) {
+    printf(INITD_FAILEDX,ctime(&t),sc->name,sc->status,INITD_LOG_DIR,sc->name);
+  } else {
+    printf(INITD_DONEX,ctime(&t),sc->name);
+  }
+}
+
+int initd_run(const char* dir, char prefix, int jobs, int timeout)
+{
+  InitdScript* scripts = malloc(INITD_MAX_SCRIPTS*sizeof(InitdScript));
+  int num, running = 0, done = 0, failed = 0;
+  int i;
+  if (!scripts) return -1;
+  if (jobs<1) jobs = 1;
+  num = load_scripts(dir,prefix,timeout,scripts);
+  if (num) mkdir(INITD_LOG_DIR,0755);
+
+  while (done<num) {
+    int started = 0;
+    unsigned long long now;
+    // start whatever is ready, in name order
+    for (i=0; i<num && running<jobs; i++) {
+      if (scripts[i].state!=SCRIPT_WAITING || !is_ready(scripts,num,i)) continue;
+      scripts[i].pid = start_script(dir,&scripts[i]);
+      if (scripts[i].pid<0) {
+        finish_script(&scripts[i],127<<8);
+        done++;
+        failed++;
+        started++;
+        continue;
+      }
+      scripts[i].state = SCRIPT_RUNNING;
+      running++;
+      started++;
+    }
+    if (!running && !started) {
+      // nothing can start: the dependencies form a cycle, so break it at
+      // the first waiting script
+      for (i=0; i<num; i++) {
+        if (scripts[i].state==SCRIPT_WAITING) {
+          printf(INITD_CYCLE,scripts[i].name);
+          scripts[i].ndeps = 0;
+          scripts[i].after_all = 0;
+          break;
+        }
+      }
+      continue;
+    }
+    usleep(INITD_POLL_US);
+    now = system_trace_now();
+    for (i=0; i<num; i++) {
+      InitdScript* sc = &scripts[i];
+      int status;
+      if (sc->state!=SCRIPT_RUNNING) continue;
+      if (waitpid(sc->pid,&status,WNOHANG)==sc->pid) {
+        finish_script(sc,status);
+        if (sc->status) failed++;
+        running--;
+        done++;
+        continue;
+      }
+      if (sc->timeout>0 && !sc->killed && now-sc->start>(unsigned long long)sc->timeout*1000000ULL) {
+        kill(-sc->pid,SIGTERM);
+        sc->killed = 1;
+        sc->killtime = now;
+      } else if (sc->killed==1 && now-sc->killtime>INITD_KILL_GRACE_US) {
+        kill(-sc->pid,SIGKILL);
+        sc->killed = 2;
+      }
+    }
+  }
+  free(scripts);
+  return failed;
+}
@@ -0,0 +1,24 @@
+#ifndef __STEAM_INITD_H
+#define __STEAM_INITD_H
+
+// init.d script runner
+//
+// The scripts of a directory starting with prefix are run in name order,
+// up to jobs at the same time. A script can declare what it has to wait for
+// with header lines (comments near its start):
+//   # after: S10first S20second    waits until these scripts have finished
+//   # after: *                     waits for all scripts sorted before it
+//   # timeout: 120                 seconds, overrides the default
+// Output of each script goes to INITD_LOG_DIR/<name>.log. A script running
+// longer than its timeout (0 means no limit) is killed with its children.
+// Boot runs 4 at a time with a 60 second timeout (init.initd.jobs and
+// init.initd.timeout). A script that relies on the ones before it having
+// finished says so with "# after: *"
+
+#define INITD_LOG_DIR "/tmp/initd"
+#define INITD_MAX_SCRIPTS 128
+
+// returns the number of scripts that failed or were killed
+int initd_run(const char* dir, char prefix, int jobs, int timeout);
+
+#endif
@@ -0,0 +1,410 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// I/O scheduler profiles and the benchmark choosing between them
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+
+#include "iotune.h"
+#include "config.h"
+#include "locale.h"
+
+#define BENCH_TIME_MS 800
+#define BENCH_MIN_SIZE (64*1024*1024LL)
+#define BENCH_STREAM_CHUNK (256*1024)
+#define BENCH_WRITE_CHUNK (64*1024)
+#define BENCH_WRITE_MAX (8*1024*1024)
+#define BENCH_BLOCK 4096
+
+typedef struct {
+  const char* name;
+  const char* value;
+} Tunable;
+
+typedef struct {
+  const char* name;
+  const char* schedulers[3];   // the first one the kernel has is used
+  const char* read_ahead_kb;
+  const char* nr_requests;
+  Tunable tunables[8];         // only the ones of the chosen scheduler exist
+} IotuneProfile;
+
+static const IotuneProfile g_profiles[IOTUNE_NUM_PROFILES] = {
+  // reads first, short batches
+  { "latency", { "deadline", "cfq", NULL }, "128", "128",
+    { { "read_expire", "150" }, { "write_expire", "1500" }, { "fifo_batch", "4" }, { "writes_starved", "4" },
+      { "low_latency", "1" }, { "slice_idle", "0" }, { "back_seek_penalty", "1" }, { NULL, NULL } } },
+  // long slices and big requests
+  { "throughput", { "cfq", "deadline", NULL }, "512", "256",
+    { { "low_latency", "0" }, { "slice_idle", "8" }, { "quantum", "8" }, { "back_seek_penalty", "1" },
+      { "back_seek_max", "1000000000" }, { "fifo_batch", "32" }, { NULL, NULL } } },
+  // as little work per request as possible
+  { "battery", { "noop", NULL }, "64", "64",
+    { { NULL, NULL } } },
+};
+
+const char* iotune_profile_name(int profile)
+{
+  if (profile<0 || profile>=IOTUNE_NUM_PROFILES) return "custom";
+  return g_profiles[profile].name;
+}
+
+static int find_profile(const char* name)
+{
+  int i;
+  for (i=0; i<IOTUNE_NUM_PROFILES; i++) {
+    if (strcmp(g_profiles[i].name,name)==0) return i;
+  }
+  return -1;
+}
+
+static int is_flash_device(const char* name)
+{
+  return strstr(name,"stl")==name || strstr(name,"mmc")==name || strstr(name,"bml")==name || strstr(name,"tfsr")==name;
+}
+
+static void write_queue(const char* dev, const char* file, const char* value)
+{
+  char path[PATH_MAX];
+  snprintf(path,sizeof(path),"/sys/block/%s/queue/%s",dev,file);
+  FILE* f = fopen(path,"w");
+  if (f) {
+    fprintf(f,"%s\n",value);
+    fclose(f);
+  }
+}
+
+// the scheduler file looks like "noop deadline [cfq]"
+static int has_scheduler(const char* dev, const char* name)
+{
+  char path[PATH_MAX];
+  char line[256];
+  int found = 0;
+  snprintf(path,sizeof(path),"/sys/block/%s/queue/scheduler",dev);
+  FILE* f = fopen(path,"r");
+  if (!f) return 0;
+  if (fgets(line,sizeof(line),f)) {
+    char* p;
+    for (p = strtok(line," []\n"); p && !found; p = strtok(NULL," []\n")) found = strcmp(p,name)==0;
+  }
+  fclose(f);
+  return found;
+}
+
+static void apply_profile(const char* dev, const IotuneProfile* profile)
+{
+  int i;
+  // the iosched directory belongs to the scheduler, so that goes first
+  for (i=0; profile->schedulers[i]; i++) {
+    if (has_scheduler(dev,profile->schedulers[i])) {
+      write_queue(dev,"scheduler",profile->schedulers[i]);
+      break;
+    }
+  }
+  write_queue(dev,"rotational","0");
+  write_queue(dev,"read_ahead_kb",profile->read_ahead_kb);
+  write_queue(dev,"nr_requests",profile->nr_requests);
+  for (i=0; profile->tunables[i].name; i++) {
+    char file[64];
+    snprintf(file,sizeof(file),"iosched/%s",profile->tunables[i].name);
+    write_queue(dev,file,profile->tunables[i].value);
+  }
+}
+
+// the cfq tweaks as they always were, tunable from the config
+static void apply_custom(const char* dev)
+{
+  char value[VALUE_MAX_LENGTH];
+  write_queue(dev,"rotational",get_conf_def("tweaks.iosched.rotational",value,"0"));
+  write_queue(dev,"iosched/low_latency",get_conf_def("tweaks.iosched.low_latency",value,"1"));
+  write_queue(dev,"iosched/back_seek_penalty",get_conf_def("tweaks.iosched.back_seek_penalty",value,"1"));
+  write_queue(dev,"iosched/back_seek_max",get_conf_def("tweaks.iosched.back_seek_max",value,"1000000000"));
+  write_queue(dev,"iosched/slice_idle",get_conf_def("tweaks.iosched.slice_idle",value,"3"));
+}
+
+static int configured_profile(const char* dev)
+{
+  char key[KEY_MAX_LENGTH];
+  char value[VALUE_MAX_LENGTH];
+  get_conf_def("tweaks.iosched.profile",value,"custom");
+  if (strcmp(value,"auto")==0) {
+    // devices that weren't measured get what most of the others got
+    snprintf(key,sizeof(key),"tweaks.iosched.auto.%s",dev);
+    if (!get_conf(key,value)) get_conf_def("tweaks.iosched.auto",value,"custom");
+  }
+  return find_profile(value);
+}
+
+void iotune_apply()
+{
+  DIR* d = opendir("/sys/block");
+  struct dirent* de;
+  if (!d) return;
+  while ((de = readdir(d))) {
+    if (!is_flash_device(de->d_name)) continue;
+    int profile = configured_profile(de->d_name);
+    if (profile>=0) {
+      apply_profile(de->d_name,&g_profiles[profile]);
+    } else {
+      apply_custom(de->d_name);
+    }
+    printf(IOTUNE_APPLIED,de->d_name,iotune_profile_name(profile));
+  }
+  closedir(d);
+}
+
+//////////////////////////////
+// benchmark
+
+typedef struct {
+  const char* path;       // device or file
+  int write;
+  long long size;         // of the device
+  volatile int stop;
+  long long bytes;
+  pthread_t thread;
+  int started;
+} Load;
+
+static long long now_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (long long)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+
+// the page cache would measure memory instead of the device
+static int open_direct(const char* path, int flags)
+{
+  int fd = open(path,flags|O_DIRECT,0600);
+  if (fd<0) fd = open(path,flags,0600);
+  return fd;
+}
+
+static void* load_thread(void* arg)
+{
+  Load* load = arg;
+  int chunk = load->write ? BENCH_WRITE_CHUNK : BENCH_STREAM_CHUNK;
+  int fd = load->write ? open_direct(load->path,O_WRONLY|O_CREAT|O_TRUNC) : open_direct(load->path,O_RDONLY);
+  char* buf = memalign(BENCH_BLOCK,chunk);
+  long long pos = 0;
+  if (fd<0 || !buf) {
+    if (fd>=0) close(fd);
+    free(buf);
+    return NULL;
+  }
+  memset(buf,0x5a,chunk);
+  while (!load->stop) {
+    if (load->write) {
+      if (pos>=BENCH_WRITE_MAX) pos = 0;
+      if (pwrite(fd,buf,chunk,pos)!=chunk) break;
+      // like a database would
+      if (((pos+chunk)&0xfffff)==0) fdatasync(fd);
+    } else {
+      if (pos+chunk>load->size) pos = 0;
+      if (pread(fd,buf,chunk,pos)!=chunk) break;
+    }
+    pos += chunk;
+    load->bytes += chunk;
+  }
+  close(fd);
+  free(buf);
+  return NULL;
+}
+
+static void start_load(Load* load)
+{
+  load->stop = 0;
+  load->bytes = 0;
+  load->started = pthread_create(&load->thread,NULL,load_thread,load)==0;
+}
+
+static void stop_load(Load* load)
+{
+  load->stop = 1;
+  if (load->started) pthread_join(load->thread,NULL);
+  load->started = 0;
+}
+
+// random reads while the device is busy streaming, that's what makes the
+// ui stutter
+static void bench_profile(const char* dev, const char* path, long long size, const char* writefile,
+                          int* latency_us, int* throughput_kb)
+{
+  Load reader, writer;
+  memset(&reader,0,sizeof(reader));
+  memset(&writer,0,sizeof(writer));
+  reader.path = path;
+  reader.size = size;
+  writer.path = writefile;
+  writer.write = 1;
+  *latency_us = 0;
+  *throughput_kb = 0;
+  int fd = open_direct(path,O_RDONLY);
+  char* buf = memalign(BENCH_BLOCK,BENCH_BLOCK);
+  if (fd<0 || !buf) {
+    if (fd>=0) close(fd);
+    free(buf);
+    return;
+  }
+  start_load(&reader);
+  if (writefile) start_load(&writer);
+  long long start = now_us();
+  long long total = 0;
+  int count = 0;
+  while (now_us()-start<BENCH_TIME_MS*1000LL) {
+    long long pos = ((long long)rand()*BENCH_BLOCK) % (size-BENCH_BLOCK);
+    pos -= pos%BENCH_BLOCK;
+    long long t = now_us();
+    if (pread(fd,buf,BENCH_BLOCK,pos)!=BENCH_BLOCK) break;
+    total += now_us()-t;
+    count++;
+  }
+  long long elapsed = now_us()-start;
+  stop_load(&reader);
+  stop_load(&writer);
+  if (writefile) unlink(writefile);
+  close(fd);
+  free(buf);
+  if (count) *latency_us = total/count;
+  if (elapsed>0) *throughput_kb = (reader.bytes+writer.bytes)*1000/elapsed;
+  printf(IOTUNE_MEASURED,dev,*latency_us,*throughput_kb);
+}
+
+static long long device_size(const char* dev)
+{
+  char path[PATH_MAX];
+  long long sectors = 0;
+  snprintf(path,sizeof(path),"/sys/block/%s/size",dev);
+  FILE* f = fopen(path,"r");
+  if (!f) return 0;
+  if (fscanf(f,"%lld",&sectors)!=1) sectors = 0;
+  fclose(f);
+  return sectors*512;
+}
+
+static int dev_matches(const char* path, dev_t dev)
+{
+  unsigned int major, minor;
+  int ret = 0;
+  FILE* f = fopen(path,"r");
+  if (!f) return 0;
+  if (fscanf(f,"%u:%u",&major,&minor)==2) ret = makedev(major,minor)==dev;
+  fclose(f);
+  return ret;
+}
+
+// true if the disk or one of its partitions is dev
+static int holds_dev(const char* disk, dev_t dev)
+{
+  char path[PATH_MAX];
+  struct dirent* de;
+  int found = 0;
+  snprintf(path,sizeof(path),"/sys/block/%s/dev",disk);
+  if (dev_matches(path,dev)) return 1;
+  snprintf(path,sizeof(path),"/sys/block/%s",disk);
+  DIR* d = opendir(path);
+  if (!d) return 0;
+  while (!found && (de = readdir(d))) {
+    if (strstr(de->d_name,disk)!=de->d_name) continue;
+    snprintf(path,sizeof(path),"/sys/block/%s/%s/dev",disk,de->d_name);
+    found = dev_matches(path,dev);
+  }
+  closedir(d);
+  return found;
+}
+
+// the lowest latency of the profiles that keep at least 80% of the best throughput
+static int choose(const IotuneResult* r)
+{
+  int i, best = -1, maxthr = 0;
+  for (i=0; i<IOTUNE_NUM_PROFILES; i++) {
+    if (r->throughput_kb[i]>maxthr) maxthr = r->throughput_kb[i];
+  }
+  for (i=0; i<IOTUNE_NUM_PROFILES; i++) {
+    if (!r->latency_us[i] || r->throughput_kb[i]*5<maxthr*4) continue;
+    if (best<0 || r->latency_us[i]<r->latency_us[best]) best = i;
+  }
+  return best;
+}
+
+int iotune_benchmark(const char* writedir, IotuneResult* results, int max)
+{
+  IotuneResult local[IOTUNE_MAX_DEVICES];
+  char path[PATH_MAX];
+  char writefile[PATH_MAX];
+  char key[KEY_MAX_LENGTH];
+  int votes[IOTUNE_NUM_PROFILES];
+  struct stat s;
+  struct dirent* de;
+  int count = 0, i;
+  dev_t writedev = 0;
+  if (!results || max>IOTUNE_MAX_DEVICES) {
+    results = local;
+    max = IOTUNE_MAX_DEVICES;
+  }
+  if (writedir && stat(writedir,&s)==0) writedev = s.st_dev;
+  snprintf(writefile,sizeof(writefile),"%s/.iotune",writedir ? writedir : "");
+  memset(votes,0,sizeof(votes));
+  srand(time(NULL));
+  DIR* d = opendir("/sys/block");
+  if (!d) return 0;
+  while (count<max && (de = readdir(d))) {
+    if (!is_flash_device(de->d_name)) continue;
+    long long size = device_size(de->d_name);
+    // small ones are boot and config partitions, nothing to gain there
+    if (size<BENCH_MIN_SIZE) continue;
+    snprintf(path,sizeof(path),"/dev/block/%s",de->d_name);
+    if (access(path,R_OK)) continue;
+    IotuneResult* r = &results[count];
+    memset(r,0,sizeof(*r));
+    snprintf(r->device,sizeof(r->device),"%s",de->d_name);
+    int write = writedev && holds_dev(de->d_name,writedev);
+    for (i=0; i<IOTUNE_NUM_PROFILES; i++) {
+      apply_profile(de->d_name,&g_profiles[i]);
+      bench_profile(de->d_name,path,size,write ? writefile : NULL,&r->latency_us[i],&r->throughput_kb[i]);
+    }
+    r->profile = choose(r);
+    if (r->profile<0) continue;
+    votes[r->profile]++;
+    snprintf(key,sizeof(key),"tweaks.iosched.auto.%s",r->device);
+    set_conf(key,g_profiles[r->profile].name);
+    count++;
+  }
+  closedir(d);
+  if (count) {
+    int best = 0;
+    for (i=1; i<IOTUNE_NUM_PROFILES; i++) {
+      if (votes[i]>votes[best]) best = i;
+    }
+    set_conf("tweaks.iosched.auto",g_profiles[best].name);
+  }
+  // back to what's configured
+  iotune_apply();
+  return count;
+}
@@ -0,0 +1,30 @@
+#ifndef __STEAM_IOTUNE_H
+#define __STEAM_IOTUNE_H
+
+// Block device I/O scheduler profiles
+//
+// tweaks.iosched.profile selects the profile: custom (the tweaks.iosched.*
+// values), latency, throughput, battery, or auto. With auto each device uses
+// the profile the benchmark chose for it (tweaks.iosched.auto.<device>)
+
+#define IOTUNE_MAX_DEVICES 8
+#define IOTUNE_NUM_PROFILES 3
+
+typedef struct {
+  char device[32];
+  int profile;                              // index of the chosen profile
+  int latency_us[IOTUNE_NUM_PROFILES];      // average random read latency under load
+  int throughput_kb[IOTUNE_NUM_PROFILES];   // KB/s of the streaming reader and writer
+} IotuneResult;
+
+// name of a profile, index from 0 to IOTUNE_NUM_PROFILES-1
+const char* iotune_profile_name(int profile);
+// applies the configured profiles to every flash block device, in one pass
+void iotune_apply();
+// measures every profile on each large enough flash device and saves the
+// best one. Reads are done on the device, writes only into a temporary file
+// in writedir, and only on the device that holds it. Returns the number of
+// results
+int iotune_benchmark(const char* writedir, IotuneResult* results, int max);
+
+#endif
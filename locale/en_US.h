@@ -45,9 +45,18 @@
 #define FILEMANAGER_FILECMD_CAT "Cat file"
 #define FILEMANAGER_FILECMD_HEAD "Show head of file"
 #define FILEMANAGER_FILECMD_RM "Delete file"
+#define FILEMANAGER_FILECMD_TRACE "Show as command trace"
 
 #define FILEMANAGER_DIR "Dir: %s\n"
 
+#define TRACE_NOFILE "Could not read trace file %s\n"
+#define TRACE_HEADER "Command trace: %d commands, %d.%03d s total\n"
+#define TRACE_SLOWEST "Slowest commands (ms, type, status, command):\n"
+#define TRACE_BYAPPLET "Time spent per applet (ms, count, applet):\n"
+#define TRACE_TIMELINE "Boot timeline: %d events from %d.%03d s to %d.%03d s\n"
+#define TRACE_TIMELINE_COLUMNS "Start s, ms, type, pid, event (commands under %u ms hidden):\n"
+#define TRACE_USAGE "Usage: trace [-n count] [-t [-m ms]] [file]\n  Shows the slowest commands of a command trace, or with -t the timeline of the boot, leaving out commands faster than -m ms. Tracing is enabled by debug.trace=1 or debug.bootprofile=1 in the config or steam.trace=1 on the kernel command line\n"
+
 #define CONSOLE_BACK "Press back key to exit console\n"
 #define CONSOLE_BADDIR "Could not switch directory\n"
 
@@ -111,6 +120,23 @@
 #define MENU_TWEAKS_MISC_HELP "Manually set the starting dalvik heap size."
 #define MENU_TWEAKS_SYS_RW "Mount /system read-only"
 #define MENU_TWEAKS_SYS_RW_HELP "If this option is set /system will be remounted read-only during normal operation"
+#define MENU_TWEAKS_BOOTPROFILE "Record the boot profile"
+#define MENU_TWEAKS_BOOTPROFILE_HELP "Traces the commands of the next boots with their timing, to be viewed with the trace command"
+#define MENU_TWEAKS_SHOW "Show current kernel values"
+#define MENU_TWEAKS_SHOW_HELP "Lists the kernel tunables with their current value, and the value the tweaks set when enabled"
+#define MENU_TWEAKS_IOPROFILE "IO scheduler profile"
+#define MENU_TWEAKS_IOPROFILE_CUSTOM "Custom"
+#define MENU_TWEAKS_IOPROFILE_CUSTOM_HELP "The cfq tweaks from the config file (tweaks.iosched.* keys)"
+#define MENU_TWEAKS_IOPROFILE_LATENCY "Latency"
+#define MENU_TWEAKS_IOPROFILE_LATENCY_HELP "Deadline scheduler with short read deadlines. Reads are served first, the UI stays responsive during big writes"
+#define MENU_TWEAKS_IOPROFILE_THROUGHPUT "Throughput"
+#define MENU_TWEAKS_IOPROFILE_THROUGHPUT_HELP "Cfq scheduler with long time slices, bigger read-ahead and request queue. Best for copying large files"
+#define MENU_TWEAKS_IOPROFILE_BATTERY "Battery"
+#define MENU_TWEAKS_IOPROFILE_BATTERY_HELP "Noop scheduler with small read-ahead. The least CPU work per request"
+#define MENU_TWEAKS_IOPROFILE_AUTO "Automatic"
+#define MENU_TWEAKS_IOPROFILE_AUTO_HELP "Uses the profile the benchmark found best for each device. The benchmark runs on the first boot if it hasn't been run yet"
+#define MENU_TWEAKS_IOPROFILE_BENCH "Run IO benchmark now"
+#define MENU_TWEAKS_IOPROFILE_BENCH_HELP "Measures read latency and throughput with each profile on every flash device, and selects the automatic profile. Only a temporary file on /cache is written"
 
 #define MENU_FS_HEADER "Filesystem changer\nFilesystem will be changed on next boot"
 
@@ -160,6 +186,7 @@
 #define ADV_MENU_KEYTEST "Key Test"
 #define ADV_MENU_SCREENTEST "Screen Test"
 #define ADV_MENU_SECRETTEST "Secret Input Screen Test"
+#define ADV_MENU_BOOTPROFILE "Show Boot Timeline"
 #define ADV_MENU_PARTITION "Partition SD Card"
 #define ADV_MENU_FIXPERM "Fix Permissions"
 
@@ -271,9 +298,21 @@
 // mount logging
 
 #define PARTITION_INFORMATION "Partition information for %s: %d\n"
+#define PARTITION_PROBED "Superblock of %s: type %d, uuid %s, label %s\n"
+#define DETECT_CACHE_NO_MOUNT "Can't mount %s for the detection cache: %s\n"
+#define DETECT_CACHE_NO_SAVE "Can't save the detection cache to %s: %s\n"
+#define FSCK_FORCED "%s: check forced by fs.fsck.always\n"
+#define FSCK_UNKNOWN "%s: unknown superblock, checking\n"
+#define FSCK_DIRTY "%s: not cleanly unmounted, checking\n"
+#define FSCK_MAXMOUNT "%s: mounted %d times since the last check, checking\n"
+#define FSCK_INTERVAL "%s: last checked %d days ago, checking\n"
+#define FSCK_CLEAN "%s: clean, skipping check\n"
 
 // locale data for init/earlyinit/postinit
 
+#define INIT_DETECT_CACHED "Using the cached type of %s: %d\n"
+#define INIT_BOOTPLAN "Config unchanged since the last boot, skipping the checks\n"
+#define INIT_COLDPLUG "%d device nodes created\n"
 #define INIT_DEVICES_DONE "Done initializing devices\n"
 #define INIT_LOAD_GRAPHICS "Loading up graphics\n"
 #define INIT_CREATE_MOUNT "Creating mount points\n"
@@ -295,11 +334,19 @@
 #define CONVERT_NO_FM "File manager disabled for security reasons!\n"
 #define CONVERT_BACKUP_FAILED "Backup of partition failed!\n"
 #define CONVERT_RESTORE_FAILED "Restoring of partition failed!\n"
+#define CONVERT_TARGET_FAILED "Formatting or mounting the new system failed, nothing is restored!\n"
+#define CONVERT_STAGE_KEPT "The saved system is kept in %s\n"
+#define CONVERT_STAGED "Saved %d files, %lluMB in memory, %lluMB on the sdcard\n"
+#define CONVERT_STAGE_ERRORS "%d files couldn't be read!\n"
+#define CONVERT_RESTORE_ERRORS "%d files couldn't be restored!\n"
 #define CONVERT_CONTINUE_ANYWAY "Continuing anyway...\n"
 #define CONVERT_WAIT_REBOOT "Rebooting in 5 seconds...\n"
 #define CONVERT_SYSTEM_SURE "Converting filesystem on /system"
 #define CONVERT_SYSTEM_CONFIRM "Yes - convert /system"
 #define CONVERT_CRYPT_FAILED "Creation of crypt partition failed! Code: %d\n"
+#define FORMAT_START "Formatting %s...\n"
+#define FORMAT_FINISHED "%s formatted in %d s\n"
+#define FORMAT_FAILED "Formatting %s failed! Code: %d\n"
 
 #define CONVERT_FS_HEADER "Converting filesystems"
 #define CONVERT_FS_FULLBACKUP "Do a complete backup and restore\n(recommended)\001This option will create a nandroid backup of your partitions, and restores them from this backup after the filesystem conversion is done"
@@ -307,6 +354,10 @@
 #define CONVERT_FS_RMBACKUP "Backup and restore, but erase backup\001This option will erase your backup, after conversion for security reasons."
 #define CONVERT_FS_RMALL "No backup, just reformat\n(this will erase all your data)\001This option will erase all your data from the partitions. Chose this option, if you don't care about your data at all."
 #define CONVERT_FS_CANCEL "Changed my mind, don't reformat\nthe filesystem\001Chose this option, if you have changed your mind"
+#define CONVERT_FS_LIVE "Convert in place\n(fastest, no sdcard needed)\001This option builds the new filesystem next to the old files on the same partition, copies the files over directly and swaps them. Partitions where this isn't possible are backed up and restored."
+#define CONVERT_LIVE_START "Converting /%s in place...\n"
+#define CONVERT_LIVE_FAILED "In-place conversion of /%s failed, using a backup instead\n"
+#define CONVERT_LIVE_NOT_MOUNTED "/%s is converted, but the new filesystem couldn't be mounted\n"
 
 #define INSTALL_STEAM_HEADER "Steam doesn't seem to be installed, or it was\nrecently uninstalled. Without it some options\nwill not be available. Do you want to install\nSteam? (you can uninstall it anytime)"
 #define INSTALL_STEAM_YES "Yes, install Steam Kernel!\001This option will create a config file on your system partition, that will store all your steam configs. Without the config file a lot of Steam Kernel options, like some lagfix options, boot animations or tweaks will not work!"
@@ -337,6 +388,17 @@
 #define TWEAKS_ENABLE_KERNELVM "Enabling kernel VM tweaks\n"
 #define TWEAKS_ENABLE_KERNELSCHED "Enablink kernel scheduler tweaks\n"
 #define TWEAKS_ENABLE_MISC "Enabling miscelangeous tweaks\n"
+#define TWEAKS_INVALID "Invalid value %s for %s, using %s\n"
+#define TWEAKS_MISSING "%s not found\n"
+#define TWEAKS_WRITE_FAILED "Can't write %s: %s\n"
+#define TWEAKS_NOT_APPLIED "%s is %s instead of %s\n"
+#define TWEAKS_CURRENT "Kernel values (current / configured):\n"
+#define TWEAKS_CURRENT_VALUE "%s: %s / %s\n"
+#define IOTUNE_BENCH_START "Measuring the IO profiles, this takes a few seconds...\n"
+#define IOTUNE_BENCH_RESULT "%s: %s (%dus, %dKB/s)\n"
+#define IOTUNE_BENCH_NONE "No device could be measured!\n"
+#define IOTUNE_APPLIED "iotune: %s uses the %s profile\n"
+#define IOTUNE_MEASURED "iotune: %s latency %dus throughput %dKB/s\n"
 
 #define INITD_EARLYSTART "%s USER EARLY INIT START\n"
 #define INITD_EARLYDONE "%s USER EARLY INIT DONE\n"
@@ -344,6 +406,9 @@
 #define INITD_DONE "%s USER INIT DONE\n"
 #define INITD_STARTX "%s START %s\n"
 #define INITD_DONEX "%s DONE %s\n"
+#define INITD_FAILEDX "%s FAILED %s (%d), see %s/%s.log\n"
+#define INITD_KILLEDX "%s KILLED %s after %d s\n"
+#define INITD_CYCLE "init.d dependency cycle, starting %s anyway\n"
 
 #define EARLY_LOGAPP "Log display application\n\n\n"
 #define EARLY_USAGE "Tap screen to switch between logs.\n"
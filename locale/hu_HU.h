@@ -45,9 +45,18 @@
 #define FILEMANAGER_FILECMD_CAT "Fajl megtekintese"
 #define FILEMANAGER_FILECMD_HEAD "Fajl elejenek megtekintese"
 #define FILEMANAGER_FILECMD_RM "Fajl torlese"
+#define FILEMANAGER_FILECMD_TRACE "Megjelenites parancsnaplokent"
 
 #define FILEMANAGER_DIR "Konyvtar: %s\n"
 
+#define TRACE_NOFILE "A(z) %s parancsnaplo nem olvashato\n"
+#define TRACE_HEADER "Parancsnaplo: %d parancs, osszesen %d.%03d mp\n"
+#define TRACE_SLOWEST "Leglassabb parancsok (ms, tipus, kilepesi kod, parancs):\n"
+#define TRACE_BYAPPLET "Appletenkent eltoltott ido (ms, darab, applet):\n"
+#define TRACE_TIMELINE "Inditasi idovonal: %d esemeny, %d.%03d mp-tol %d.%03d mp-ig\n"
+#define TRACE_TIMELINE_COLUMNS "Kezdet mp, ms, tipus, pid, esemeny (a %u ms-nal rovidebb parancsok nelkul):\n"
+#define TRACE_USAGE "Hasznalat: trace [-n darab] [-t [-m ms]] [fajl]\n  Megmutatja a parancsnaplo leglassabb parancsait, vagy -t-vel az inditas idovonalat, a -m ms-nal gyorsabb parancsok nelkul. A naplozast a konfiguracioban a debug.trace=1 vagy a debug.bootprofile=1, vagy a kernel parancssoraban a steam.trace=1 kapcsolja be\n"
+
 #define CONSOLE_BACK "Nyomd meg a vissza gombot a kilepeshez\n"
 #define CONSOLE_BADDIR "A konyvtarvaltas sikertelen\n"
 
@@ -111,6 +120,23 @@
 #define MENU_TWEAKS_MISC_HELP "Egyeb inditasi finomhangolasok."
 #define MENU_TWEAKS_SYS_RW "/system iras joganak tiltasa"
 #define MENU_TWEAKS_SYS_RW_HELP "Bekapcsolt allapotban a rendszer nem engedi a /system irasat. Ez az alapertelmezett"
+#define MENU_TWEAKS_BOOTPROFILE "Inditasi profil rogzitese"
+#define MENU_TWEAKS_BOOTPROFILE_HELP "A kovetkezo inditasok parancsait idozitessel naplozza, a trace paranccsal megnezheto"
+#define MENU_TWEAKS_SHOW "Aktualis kernel ertekek"
+#define MENU_TWEAKS_SHOW_HELP "Kilistazza a kernel beallitasokat az aktualis ertekukkel, es azzal az ertekkel, amit a finomhangolas beallit"
+#define MENU_TWEAKS_IOPROFILE "IO utemezo profil"
+#define MENU_TWEAKS_IOPROFILE_CUSTOM "Egyedi"
+#define MENU_TWEAKS_IOPROFILE_CUSTOM_HELP "A cfq beallitasai a konfiguracios fajlbol (tweaks.iosched.* kulcsok)"
+#define MENU_TWEAKS_IOPROFILE_LATENCY "Valaszido"
+#define MENU_TWEAKS_IOPROFILE_LATENCY_HELP "Deadline utemezo rovid olvasasi hataridokkel. Az olvasasok elsobbseget kapnak, a felulet nagy irasok kozben is gyors marad"
+#define MENU_TWEAKS_IOPROFILE_THROUGHPUT "Atviteli sebesseg"
+#define MENU_TWEAKS_IOPROFILE_THROUGHPUT_HELP "Cfq utemezo hosszu idoszeletekkel, nagyobb elore olvasassal es keresi sorral. Nagy fajlok masolasahoz a legjobb"
+#define MENU_TWEAKS_IOPROFILE_BATTERY "Akkumulator"
+#define MENU_TWEAKS_IOPROFILE_BATTERY_HELP "Noop utemezo kis elore olvasassal. Keresenkent a legkevesebb processzormunka"
+#define MENU_TWEAKS_IOPROFILE_AUTO "Automatikus"
+#define MENU_TWEAKS_IOPROFILE_AUTO_HELP "Minden eszkozon azt a profilt hasznalja, amit a meres a legjobbnak talalt. Ha meg nem volt meres, az elso rendszerinditaskor lefut"
+#define MENU_TWEAKS_IOPROFILE_BENCH "IO meres inditasa"
+#define MENU_TWEAKS_IOPROFILE_BENCH_HELP "Minden flash eszkozon megmeri az olvasasi valaszidot es sebesseget az egyes profilokkal, es beallitja az automatikus profilt. Csak egy ideiglenes fajl irodik a /cache-re"
 
 #define MENU_FS_HEADER "Fajrendszer konvertalo\nA fajlrendszer a kovetkezo ujrainditasnal fog megvaltozni"
 
@@ -160,6 +186,7 @@
 #define ADV_MENU_KEYTEST "Billentyuzet teszt"
 #define ADV_MENU_SCREENTEST "Multi-touch teszt"
 #define ADV_MENU_SECRETTEST "Jelszobekero ablak teszt"
+#define ADV_MENU_BOOTPROFILE "Inditasi idovonal megjelenitese"
 #define ADV_MENU_PARTITION "SD kartya particionalasa"
 #define ADV_MENU_FIXPERM "Jogosultsagok ujrahuzasa"
 
@@ -271,9 +298,21 @@
 // mount logging
 
 #define PARTITION_INFORMATION "%s particio jelenleg %d modban fut\n"
+#define PARTITION_PROBED "%s szuperblokkja: tipus %d, uuid %s, cimke %s\n"
+#define DETECT_CACHE_NO_MOUNT "%s nem csatolhato a felismeresi gyorsitotarhoz: %s\n"
+#define DETECT_CACHE_NO_SAVE "A felismeresi gyorsitotar nem mentheto ide: %s: %s\n"
+#define FSCK_FORCED "%s: ellenorzes kikenyszeritve (fs.fsck.always)\n"
+#define FSCK_UNKNOWN "%s: ismeretlen szuperblokk, ellenorzes\n"
+#define FSCK_DIRTY "%s: nem megfeleloen lett lecsatolva, ellenorzes\n"
+#define FSCK_MAXMOUNT "%s: az utolso ellenorzes ota %d alkalommal lett felcsatolva, ellenorzes\n"
+#define FSCK_INTERVAL "%s: utoljara %d napja volt ellenorizve, ellenorzes\n"
+#define FSCK_CLEAN "%s: rendben van, nincs ellenorzes\n"
 
 // locale data for init/earlyinit/postinit
 
+#define INIT_DETECT_CACHED "A(z) %s tarolt tipusa: %d\n"
+#define INIT_BOOTPLAN "A beallitasok nem valtoztak az utolso inditas ota, ellenorzesek kihagyva\n"
+#define INIT_COLDPLUG "%d eszkozfajl letrehozva\n"
 #define INIT_DEVICES_DONE "Eszkozok betoltve\n"
 #define INIT_LOAD_GRAPHICS "Grafika inicializalasa\n"
 #define INIT_CREATE_MOUNT "Csatolasi pontok letrehozasa\n"
@@ -295,11 +334,19 @@
 #define CONVERT_NO_FM "Fajl manager letiltva biztonsagi okokbol!\n"
 #define CONVERT_BACKUP_FAILED "Particio mentese sikertelen!\n"
 #define CONVERT_RESTORE_FAILED "Particio visszatoltese sikertelen!\n"
+#define CONVERT_TARGET_FAILED "Az uj rendszer formazasa vagy csatolasa sikertelen, nincs visszatoltes!\n"
+#define CONVERT_STAGE_KEPT "A mentett rendszer megmaradt itt: %s\n"
+#define CONVERT_STAGED "%d fajl mentve, %lluMB a memoriaban, %lluMB az SD-kartyan\n"
+#define CONVERT_STAGE_ERRORS "%d fajlt nem sikerult beolvasni!\n"
+#define CONVERT_RESTORE_ERRORS "%d fajlt nem sikerult visszaallitani!\n"
 #define CONVERT_CONTINUE_ANYWAY "Ennek ellenere folytatas...\n"
 #define CONVERT_WAIT_REBOOT "Ujrainditas 5 masodperc mulva...\n"
 #define CONVERT_SYSTEM_SURE "/system konvertalasa"
 #define CONVERT_SYSTEM_CONFIRM "Igen - konvertald at a /system-et"
 #define CONVERT_CRYPT_FAILED "Nem sikerult titkositott particiot letrehozni. Hibakod:%d\n"
+#define FORMAT_START "%s formazasa...\n"
+#define FORMAT_FINISHED "%s formazva %d mp alatt\n"
+#define FORMAT_FAILED "%s formazasa nem sikerult. Hibakod:%d\n"
 
 #define CONVERT_FS_HEADER "Particio konvertalasa"
 #define CONVERT_FS_FULLBACKUP "Teljes mentes es visszatoltes\n(ajanlott)\001Ez az opcio konvertalas elott keszit egy mentest, amit majd a konvertalas utan visszatolt, igy az adatok tovabbra is megmaradnak"
@@ -307,6 +354,10 @@
 #define CONVERT_FS_RMBACKUP "Teljes mentes, visszatoltes,\nmajd a mentes torlese\001Ez az opcio megtartja az adatokat, de a visszatoltes utan biztonsagi okokbol torli az elkeszitett mentest."
 #define CONVERT_FS_RMALL "Csak formazd meg\n(ez minden adatot orolni fog)\001Ez az opcio minden adatot torolni fog, melyekrol mentes sem keszul."
 #define CONVERT_FS_CANCEL "Konvertalas visszavonasa\001Ez torli a konvertalasi kerelmet, es a rendszer tovabb fog menni a regi beallitasokkal"
+#define CONVERT_FS_LIVE "Helyben konvertalas\n(leggyorsabb, nem kell SD-kartya)\001Ez az opcio az uj fajlrendszert a regi fajlok melle epiti ugyanazon a particion, kozvetlenul atmasolja a fajlokat, majd kicsereli oket. Azokat a particiokat, ahol ez nem lehetseges, lementi es visszatolti."
+#define CONVERT_LIVE_START "/%s konvertalasa helyben...\n"
+#define CONVERT_LIVE_FAILED "/%s helyben konvertalasa nem sikerult, mentes hasznalata helyette\n"
+#define CONVERT_LIVE_NOT_MOUNTED "/%s konvertalva, de az uj fajlrendszert nem sikerult csatolni\n"
 
 #define INSTALL_STEAM_HEADER "Steam nincs feltelepitve, vagy nemreg lett\nletorolve. Telepites nelkul nehany opcio nem\nfog mukodni. Telepitsem a Steam Kernelt?\n(Barmikor le lehet torolni)"
 #define INSTALL_STEAM_YES "Igen, telepitsd!\001Ez az opcio feltelpiti a Steam kozponti konfiguracios allomanyat, mely lehetove teszi a rendszer teljes kihasznalasat."
@@ -337,6 +388,17 @@
 #define TWEAKS_ENABLE_KERNELVM "Kernel VM finomhangolasa\n"
 #define TWEAKS_ENABLE_KERNELSCHED "Kernel utemezo finomhangolasa\n"
 #define TWEAKS_ENABLE_MISC "Egyeb beallitasok\n"
+#define TWEAKS_INVALID "Hibas ertek (%s) a %s beallitasnal, %s lesz hasznalva\n"
+#define TWEAKS_MISSING "%s nem talalhato\n"
+#define TWEAKS_WRITE_FAILED "%s nem irhato: %s\n"
+#define TWEAKS_NOT_APPLIED "%s erteke %s a %s helyett\n"
+#define TWEAKS_CURRENT "Kernel ertekek (aktualis / beallitott):\n"
+#define TWEAKS_CURRENT_VALUE "%s: %s / %s\n"
+#define IOTUNE_BENCH_START "IO profilok merese, ez par masodpercig tart...\n"
+#define IOTUNE_BENCH_RESULT "%s: %s (%dus, %dKB/s)\n"
+#define IOTUNE_BENCH_NONE "Egyik eszkozt sem sikerult megmerni!\n"
+#define IOTUNE_APPLIED "iotune: %s a(z) %s profilt hasznalja\n"
+#define IOTUNE_MEASURED "iotune: %s kesleltetes %dus atvitel %dKB/s\n"
 
 #define INITD_EARLYSTART "%s USER EARLY INIT START\n"
 #define INITD_EARLYDONE "%s USER EARLY INIT DONE\n"
@@ -344,6 +406,9 @@
 #define INITD_DONE "%s USER INIT DONE\n"
 #define INITD_STARTX "%s START %s\n"
 #define INITD_DONEX "%s DONE %s\n"
+#define INITD_FAILEDX "%s HIBA %s (%d), naplo: %s/%s.log\n"
+#define INITD_KILLEDX "%s LELOVE %s %d mp utan\n"
+#define INITD_CYCLE "Korkoros init.d fuggoseg, %s inditasa mindenkeppen\n"
 
 #define EARLY_LOGAPP "Log nezegeto alkalmazas\n\n\n"
 #define EARLY_USAGE "Kattints a logok kozotti valtashoz.\n"
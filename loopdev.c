@@ -0,0 +1,195 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Loop device management through the LOOP_* ioctls
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <linux/loop.h>
+
+#include "loopdev.h"
+
+#define LOOP_MAJOR 7
+#define MAX_LOOP_DEVICES 8
+#define LOOP_DEVICE_DIR "/dev/block"
+
+// not in every kernel header we build with
+#ifndef LO_FLAGS_AUTOCLEAR
+#define LO_FLAGS_AUTOCLEAR 4
+#endif
+#ifndef LOOP_SET_DIRECT_IO
+#define LOOP_SET_DIRECT_IO 0x4C08
+#endif
+#ifndef LOOP_CTL_GET_FREE
+#define LOOP_CTL_GET_FREE 0x4C82
+#endif
+
+// attaching is find-free-then-set, so keep our own threads from racing
+static pthread_mutex_t g_loop_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int parse_loop_number(const char* name)
+{
+  int n;
+  if (!name) return -1;
+  if (strncmp(name,LOOP_DEVICE_DIR "/",strlen(LOOP_DEVICE_DIR)+1)==0) name += strlen(LOOP_DEVICE_DIR)+1;
+  if (sscanf(name,"loop%d",&n)!=1) return -1;
+  return n;
+}
+
+static int try_attach(int n, int ffd, const char* file, int flags, char* loopdev, size_t len)
+{
+  char path[32];
+  struct stat s;
+  sprintf(path,LOOP_DEVICE_DIR "/loop%d",n);
+  if (stat(path,&s)) mknod(path,S_IFBLK|0600,makedev(LOOP_MAJOR,n));
+  int lfd = open(path,(flags&LOOPDEV_READONLY) ? O_RDONLY : O_RDWR);
+  if (lfd<0) return -1;
+  // fails with EBUSY if it's in use
+  if (ioctl(lfd,LOOP_SET_FD,ffd)) {
+    close(lfd);
+    return -1;
+  }
+  struct loop_info64 info;
+  memset(&info,0,sizeof(info));
+  strncpy((char*)info.lo_file_name,file,LO_NAME_SIZE-1);
+  if (flags&LOOPDEV_AUTOCLEAR) info.lo_flags |= LO_FLAGS_AUTOCLEAR;
+  if (ioctl(lfd,LOOP_SET_STATUS64,&info)) {
+    ioctl(lfd,LOOP_CLR_FD,0);
+    close(lfd);
+    return -1;
+  }
+  // only newer kernels have this, it's just slower without it
+  if (flags&LOOPDEV_DIRECT_IO) ioctl(lfd,LOOP_SET_DIRECT_IO,1);
+  snprintf(loopdev,len,"%s",path);
+  return lfd;
+}
+
+int loopdev_attach(const char* file, const char* hint, int flags, char* loopdev, size_t len)
+{
+  int ffd = open(file,(flags&LOOPDEV_READONLY) ? O_RDONLY : O_RDWR);
+  if (ffd<0) return -1;
+  pthread_mutex_lock(&g_loop_mutex);
+  int lfd = -1;
+  int n = parse_loop_number(hint);
+  if (n>=0) lfd = try_attach(n,ffd,file,flags,loopdev,len);
+  if (lfd<0) {
+    int cfd = open("/dev/loop-control",O_RDWR);
+    if (cfd>=0) {
+      int tries;
+      // someone else might grab it between the two ioctls
+      for (tries=0; tries<3 && lfd<0; tries++) {
+        n = ioctl(cfd,LOOP_CTL_GET_FREE);
+        if (n<0) break;
+        lfd = try_attach(n,ffd,file,flags,loopdev,len);
+      }
+      close(cfd);
+    }
+  }
+  for (n=0; n<MAX_LOOP_DEVICES && lfd<0; n++) {
+    lfd = try_attach(n,ffd,file,flags,loopdev,len);
+  }
+  pthread_mutex_unlock(&g_loop_mutex);
+  close(ffd);
+  return lfd;
+}
+
+int loopdev_detach(const char* loopdev)
+{
+  int lfd = open(loopdev,O_RDONLY);
+  if (lfd<0) return -1;
+  int ret = ioctl(lfd,LOOP_CLR_FD,0);
+  close(lfd);
+  return ret;
+}
+
+int loopdev_find(const char* file, char* loopdev, size_t len)
+{
+  struct stat s;
+  if (stat(file,&s)) return -1;
+  DIR* dir = opendir(LOOP_DEVICE_DIR);
+  if (!dir) return -1;
+  int ret = -1;
+  struct dirent* de;
+  while (ret && (de = readdir(dir))) {
+    if (parse_loop_number(de->d_name)<0) continue;
+    char path[PATH_MAX];
+    snprintf(path,sizeof(path),LOOP_DEVICE_DIR "/%s",de->d_name);
+    int lfd = open(path,O_RDONLY);
+    if (lfd<0) continue;
+    struct loop_info64 info;
+    // the name might be truncated, the inode is what counts
+    if (ioctl(lfd,LOOP_GET_STATUS64,&info)==0 && info.lo_device==s.st_dev && info.lo_inode==s.st_ino) {
+      snprintf(loopdev,len,"%s",path);
+      ret = 0;
+    }
+    close(lfd);
+  }
+  closedir(dir);
+  return ret;
+}
+
+static int do_fallocate(int fd, long long size)
+{
+#if defined(__NR_fallocate) && defined(__arm__)
+  // EABI passes the 64 bit offset and length in register pairs
+  return syscall(__NR_fallocate,fd,0,0,0,(unsigned int)size,(unsigned int)(size>>32));
+#elif defined(__NR_fallocate) && defined(__LP64__)
+  return syscall(__NR_fallocate,fd,0,0L,(long)size);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+int loopdev_create_file(const char* file, long long size, void (*progress)(void* ctx, float fraction), void* ctx)
+{
+  int fd = open(file,O_WRONLY|O_CREAT|O_TRUNC,0600);
+  if (fd<0) return -1;
+  int ret = do_fallocate(fd,size);
+  if (ret) {
+    // rfs and vfat can't preallocate, write it out instead
+    static const char zeros[65536];
+    long long done = 0;
+    ret = 0;
+    while (done<size) {
+      size_t chunk = size-done<(long long)sizeof(zeros) ? (size_t)(size-done) : sizeof(zeros);
+      ssize_t w = write(fd,zeros,chunk);
+      if (w<0 && errno==EINTR) continue;
+      if (w<=0) {
+        ret = -1;
+        break;
+      }
+      done += w;
+      // every 4MB is enough
+      if (progress && (done&0x3fffff)==0) progress(ctx,(float)done/size);
+    }
+  }
+  if (progress) progress(ctx,1.0);
+  if (fsync(fd)) ret = -1;
+  close(fd);
+  return ret;
+}
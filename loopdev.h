@@ -0,0 +1,23 @@
+#ifndef __STEAM_LOOPDEV_H
+#define __STEAM_LOOPDEV_H
+
+#include <stddef.h>
+
+// flags for loopdev_attach
+#define LOOPDEV_READONLY 1
+#define LOOPDEV_AUTOCLEAR 2   // detached by the kernel when the last user goes away
+#define LOOPDEV_DIRECT_IO 4   // bypass the page cache of the backing file, if the kernel can
+
+// attaches file to a free loop device. hint (like "loop1") is tried first, so
+// names stay the same between boots if possible. The device path is returned
+// in loopdev. Returns an open fd of the loop device, which has to be kept open
+// until it's mounted, otherwise autoclear detaches it right away. -1 on error
+int loopdev_attach(const char* file, const char* hint, int flags, char* loopdev, size_t len);
+int loopdev_detach(const char* loopdev);
+// looks for the loop device file is attached to. Returns 0 if found
+int loopdev_find(const char* file, char* loopdev, size_t len);
+// creates a file of size bytes with all blocks allocated, so it's neither
+// sparse nor fragmented by later writes. progress may be NULL
+int loopdev_create_file(const char* file, long long size, void (*progress)(void* ctx, float fraction), void* ctx);
+
+#endif
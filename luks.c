@@ -0,0 +1,523 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// LUKS1 unlocking without cryptsetup. The key slots are decrypted through a
+// temporary read-only dm-crypt mapping (like cryptsetup 1.x does), so we
+// don't need any cipher code here, only PBKDF2 and the AF splitter, which are
+// both SHA1 based for the partitions we create.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <linux/dm-ioctl.h>
+#include <linux/fs.h>
+
+#include "mincrypt/sha.h"
+#include "luks.h"
+
+#define LUKS_MAGIC "LUKS\xba\xbe"
+#define LUKS_HEADER_SIZE 592
+#define LUKS_NUM_SLOTS 8
+#define LUKS_SLOT_OFFSET 208
+#define LUKS_SLOT_SIZE 48
+#define LUKS_SLOT_ACTIVE 0x00AC71F3
+#define LUKS_SALT_SIZE 32
+#define LUKS_DIGEST_SIZE 20
+#define LUKS_MAX_KEY_BYTES 64
+#define LUKS_MAX_STRIPES 4000
+#define SECTOR_SIZE 512
+
+#define DM_BUFFER_SIZE 4096
+#define MAX_CACHED_KEYS 8
+
+typedef struct {
+  char cipher[33];
+  char mode[33];
+  char hash[33];
+  unsigned int payload_offset;
+  unsigned int key_bytes;
+  unsigned char mk_digest[LUKS_DIGEST_SIZE];
+  unsigned char mk_digest_salt[LUKS_SALT_SIZE];
+  unsigned int mk_digest_iter;
+  char uuid[41];
+  struct {
+    unsigned int active;
+    unsigned int iterations;
+    unsigned char salt[LUKS_SALT_SIZE];
+    unsigned int offset;
+    unsigned int stripes;
+  } slots[LUKS_NUM_SLOTS];
+} LuksHeader;
+
+// master keys we already derived in this session
+typedef struct {
+  char uuid[41];
+  unsigned char mk_digest[LUKS_DIGEST_SIZE];
+  unsigned char check[SHA_DIGEST_SIZE];  // HMAC(passphrase, digest salt)
+  unsigned int key_bytes;
+  unsigned char key[LUKS_MAX_KEY_BYTES];
+} CachedKey;
+
+static CachedKey g_keys[MAX_CACHED_KEYS];
+static int g_num_keys = 0;
+static pthread_mutex_t g_keys_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// memset that the compiler won't optimize away
+static void wipe(void* p, size_t len)
+{
+  volatile unsigned char* v = p;
+  while (len--) *v++ = 0;
+}
+
+static unsigned int be32(const unsigned char* p)
+{
+  return ((unsigned int)p[0]<<24) | (p[1]<<16) | (p[2]<<8) | p[3];
+}
+
+static void put_be32(unsigned char* p, unsigned int v)
+{
+  p[0] = v>>24; p[1] = v>>16; p[2] = v>>8; p[3] = v;
+}
+
+static void copy_string(char* out, const unsigned char* in, int len)
+{
+  memcpy(out,in,len);
+  out[len] = '\0';
+}
+
+static int parse_header(const unsigned char* buf, LuksHeader* hdr)
+{
+  if (memcmp(buf,LUKS_MAGIC,6) || buf[6]!=0 || buf[7]!=1) return -1;
+  copy_string(hdr->cipher,buf+8,32);
+  copy_string(hdr->mode,buf+40,32);
+  copy_string(hdr->hash,buf+72,32);
+  hdr->payload_offset = be32(buf+104);
+  hdr->key_bytes = be32(buf+108);
+  memcpy(hdr->mk_digest,buf+112,LUKS_DIGEST_SIZE);
+  memcpy(hdr->mk_digest_salt,buf+132,LUKS_SALT_SIZE);
+  hdr->mk_digest_iter = be32(buf+164);
+  copy_string(hdr->uuid,buf+168,40);
+  int i;
+  for (i=0; i<LUKS_NUM_SLOTS; i++) {
+    const unsigned char* s = buf+LUKS_SLOT_OFFSET+i*LUKS_SLOT_SIZE;
+    hdr->slots[i].active = be32(s);
+    hdr->slots[i].iterations = be32(s+4);
+    memcpy(hdr->slots[i].salt,s+8,LUKS_SALT_SIZE);
+    hdr->slots[i].offset = be32(s+40);
+    hdr->slots[i].stripes = be32(s+44);
+  }
+  if (hdr->key_bytes==0 || hdr->key_bytes>LUKS_MAX_KEY_BYTES) return -1;
+  // the cipher names end up in the dm table
+  if (strchr(hdr->cipher,' ') || strchr(hdr->mode,' ')) return -1;
+  return 0;
+}
+
+//////////////////////////////
+// PBKDF2-HMAC-SHA1
+
+typedef struct {
+  SHA_CTX inner;
+  SHA_CTX outer;
+} HmacKey;
+
+static void hmac_init(HmacKey* h, const unsigned char* key, int keylen)
+{
+  unsigned char k[64];
+  unsigned char pad[64];
+  int i;
+  memset(k,0,sizeof(k));
+  if (keylen>64) {
+    SHA(key,keylen,k);
+  } else {
+    memcpy(k,key,keylen);
+  }
+  for (i=0; i<64; i++) pad[i] = k[i]^0x36;
+  SHA_init(&h->inner);
+  SHA_update(&h->inner,pad,64);
+  for (i=0; i<64; i++) pad[i] = k[i]^0x5c;
+  SHA_init(&h->outer);
+  SHA_update(&h->outer,pad,64);
+  wipe(k,sizeof(k));
+  wipe(pad,sizeof(pad));
+}
+
+// the padded key blocks are hashed only once in hmac_init, every iteration
+// just continues from a copy of those states
+static void hmac(const HmacKey* h, const unsigned char* data, int len, unsigned char* out)
+{
+  unsigned char inner[SHA_DIGEST_SIZE];
+  SHA_CTX ctx = h->inner;
+  SHA_update(&ctx,data,len);
+  memcpy(inner,SHA_final(&ctx),SHA_DIGEST_SIZE);
+  ctx = h->outer;
+  SHA_update(&ctx,inner,SHA_DIGEST_SIZE);
+  memcpy(out,SHA_final(&ctx),SHA_DIGEST_SIZE);
+  wipe(&ctx,sizeof(ctx));
+}
+
+static void pbkdf2_sha1(const unsigned char* pass, int passlen, const unsigned char* salt, int saltlen,
+                        unsigned int iterations, unsigned char* out, int outlen)
+{
+  HmacKey h;
+  unsigned char block[LUKS_SALT_SIZE+4];
+  unsigned char u[SHA_DIGEST_SIZE];
+  unsigned char t[SHA_DIGEST_SIZE];
+  unsigned int n,j;
+  int k;
+  hmac_init(&h,pass,passlen);
+  memcpy(block,salt,saltlen);
+  for (n=1; outlen>0; n++) {
+    put_be32(block+saltlen,n);
+    hmac(&h,block,saltlen+4,u);
+    memcpy(t,u,SHA_DIGEST_SIZE);
+    for (j=1; j<iterations; j++) {
+      hmac(&h,u,SHA_DIGEST_SIZE,u);
+      for (k=0; k<SHA_DIGEST_SIZE; k++) t[k] ^= u[k];
+    }
+    int len = outlen<SHA_DIGEST_SIZE ? outlen : SHA_DIGEST_SIZE;
+    memcpy(out,t,len);
+    out += len;
+    outlen -= len;
+  }
+  wipe(&h,sizeof(h));
+  wipe(u,sizeof(u));
+  wipe(t,sizeof(t));
+}
+
+//////////////////////////////
+// anti-forensic splitter
+
+static void af_diffuse(unsigned char* buf, unsigned int size)
+{
+  unsigned char iv[4];
+  unsigned int blocks = size/SHA_DIGEST_SIZE;
+  unsigned int padding = size%SHA_DIGEST_SIZE;
+  unsigned int i;
+  SHA_CTX ctx;
+  for (i=0; i<blocks+(padding?1:0); i++) {
+    unsigned int len = i<blocks ? SHA_DIGEST_SIZE : padding;
+    put_be32(iv,i);
+    SHA_init(&ctx);
+    SHA_update(&ctx,iv,4);
+    SHA_update(&ctx,buf+i*SHA_DIGEST_SIZE,len);
+    memcpy(buf+i*SHA_DIGEST_SIZE,SHA_final(&ctx),len);
+  }
+  wipe(&ctx,sizeof(ctx));
+}
+
+static void af_merge(const unsigned char* src, unsigned char* dst, unsigned int size, unsigned int stripes)
+{
+  unsigned int i,j;
+  memset(dst,0,size);
+  for (i=0; i<stripes-1; i++) {
+    for (j=0; j<size; j++) dst[j] ^= src[i*size+j];
+    af_diffuse(dst,size);
+  }
+  for (j=0; j<size; j++) dst[j] ^= src[i*size+j];
+}
+
+//////////////////////////////
+// device-mapper
+
+static int dm_control()
+{
+  int fd = open("/dev/mapper/control",O_RDWR);
+  if (fd<0) fd = open("/dev/device-mapper",O_RDWR);
+  if (fd>=0) return fd;
+  // create the control node ourselves
+  FILE* f = fopen("/proc/misc","r");
+  if (!f) return -1;
+  int minor = -1;
+  int m;
+  char name[64];
+  while (fscanf(f,"%d %63s",&m,name)==2) {
+    if (strcmp(name,"device-mapper")==0) {
+      minor = m;
+      break;
+    }
+  }
+  fclose(f);
+  if (minor<0) return -1;
+  mkdir("/dev/mapper",0755);
+  mknod("/dev/mapper/control",S_IFCHR|0600,makedev(10,minor));
+  return open("/dev/mapper/control",O_RDWR);
+}
+
+static void dm_init_io(struct dm_ioctl* io, const char* name, unsigned int flags)
+{
+  memset(io,0,DM_BUFFER_SIZE);
+  io->version[0] = DM_VERSION_MAJOR;
+  io->version[1] = 0;
+  io->version[2] = 0;
+  io->data_size = DM_BUFFER_SIZE;
+  io->data_start = sizeof(struct dm_ioctl);
+  io->flags = flags;
+  strncpy(io->name,name,sizeof(io->name)-1);
+}
+
+static int dm_remove(const char* name)
+{
+  char buffer[DM_BUFFER_SIZE];
+  struct dm_ioctl* io = (struct dm_ioctl*)buffer;
+  char path[PATH_MAX];
+  int fd = dm_control();
+  if (fd<0) return -1;
+  int r,tries = 0;
+  do {
+    dm_init_io(io,name,0);
+    r = ioctl(fd,DM_DEV_REMOVE,io);
+    // the device might still be held for a moment after the last close
+    if (r<0 && errno==EBUSY) usleep(50000);
+  } while (r<0 && errno==EBUSY && ++tries<20);
+  // nothing to do if it doesn't exist
+  if (r<0 && errno==ENXIO) r = 0;
+  close(fd);
+  snprintf(path,sizeof(path),"/dev/mapper/%s",name);
+  unlink(path);
+  return r<0 ? -1 : 0;
+}
+
+// creates /dev/mapper/<name> as a dm-crypt mapping of <sectors> sectors of
+// the device, starting at <offset>
+static int dm_create_crypt(const char* name, const char* device, unsigned long long offset,
+                           unsigned long long sectors, const LuksHeader* hdr,
+                           const unsigned char* key, int readonly)
+{
+  char buffer[DM_BUFFER_SIZE];
+  struct dm_ioctl* io = (struct dm_ioctl*)buffer;
+  char path[PATH_MAX];
+  struct stat s;
+  if (stat(device,&s) || !S_ISBLK(s.st_mode)) return -1;
+  int fd = dm_control();
+  if (fd<0) return -1;
+
+  dm_init_io(io,name,0);
+  if (ioctl(fd,DM_DEV_CREATE,io)<0) {
+    close(fd);
+    return -1;
+  }
+
+  dm_init_io(io,name,readonly ? DM_READONLY_FLAG : 0);
+  io->target_count = 1;
+  struct dm_target_spec* spec = (struct dm_target_spec*)(buffer+sizeof(struct dm_ioctl));
+  spec->sector_start = 0;
+  spec->length = sectors;
+  strcpy(spec->target_type,"crypt");
+  char* params = (char*)(spec+1);
+  int len = sprintf(params,"%s-%s ",hdr->cipher,hdr->mode);
+  unsigned int i;
+  for (i=0; i<hdr->key_bytes; i++) len += sprintf(params+len,"%02x",key[i]);
+  sprintf(params+len," 0 %u:%u %llu",major(s.st_rdev),minor(s.st_rdev),offset);
+  int r = ioctl(fd,DM_TABLE_LOAD,io);
+  wipe(buffer,sizeof(buffer));
+  if (r==0) {
+    // resuming the device activates the table
+    dm_init_io(io,name,0);
+    r = ioctl(fd,DM_DEV_SUSPEND,io);
+  }
+  close(fd);
+  if (r<0) {
+    dm_remove(name);
+    return -1;
+  }
+  unsigned int dev_major = (io->dev&0xfff00)>>8;
+  unsigned int dev_minor = (io->dev&0xff)|((io->dev>>12)&0xfff00);
+  mkdir("/dev/mapper",0755);
+  snprintf(path,sizeof(path),"/dev/mapper/%s",name);
+  unlink(path);
+  if (mknod(path,S_IFBLK|0600,makedev(dev_major,dev_minor))) {
+    dm_remove(name);
+    return -1;
+  }
+  return 0;
+}
+
+//////////////////////////////
+// key slots
+
+// reads the decrypted key material of a slot through a temporary mapping
+static int read_key_material(const char* device, const char* name, const LuksHeader* hdr, int slot,
+                             const unsigned char* key, unsigned char* material, unsigned int sectors)
+{
+  char tmpname[128];
+  char path[PATH_MAX];
+  snprintf(tmpname,sizeof(tmpname),"tmp%s",name);
+  if (dm_create_crypt(tmpname,device,hdr->slots[slot].offset,sectors,hdr,key,1)) return -1;
+  snprintf(path,sizeof(path),"/dev/mapper/%s",tmpname);
+  int ret = -1;
+  int fd = open(path,O_RDONLY);
+  if (fd>=0) {
+    size_t size = sectors*SECTOR_SIZE;
+    size_t done = 0;
+    while (done<size) {
+      ssize_t r = read(fd,material+done,size-done);
+      if (r<0 && errno==EINTR) continue;
+      if (r<=0) break;
+      done += r;
+    }
+    if (done==size) ret = 0;
+    close(fd);
+  }
+  dm_remove(tmpname);
+  return ret;
+}
+
+static int verify_master_key(const LuksHeader* hdr, const unsigned char* mk)
+{
+  unsigned char digest[LUKS_DIGEST_SIZE];
+  pbkdf2_sha1(mk,hdr->key_bytes,hdr->mk_digest_salt,LUKS_SALT_SIZE,hdr->mk_digest_iter,digest,LUKS_DIGEST_SIZE);
+  int ok = memcmp(digest,hdr->mk_digest,LUKS_DIGEST_SIZE)==0;
+  wipe(digest,sizeof(digest));
+  return ok;
+}
+
+static int unlock_master_key(const char* device, const char* name, const LuksHeader* hdr,
+                             const char* passphrase, unsigned char* mk)
+{
+  int ret = LUKS_BADKEY;
+  int i;
+  for (i=0; i<LUKS_NUM_SLOTS && ret==LUKS_BADKEY; i++) {
+    if (hdr->slots[i].active!=LUKS_SLOT_ACTIVE) continue;
+    unsigned int stripes = hdr->slots[i].stripes;
+    if (stripes==0 || stripes>LUKS_MAX_STRIPES) return LUKS_UNSUPPORTED;
+    unsigned int size = hdr->key_bytes*stripes;
+    unsigned int sectors = (size+SECTOR_SIZE-1)/SECTOR_SIZE;
+    unsigned char* material = malloc(sectors*SECTOR_SIZE);
+    if (!material) return LUKS_UNSUPPORTED;
+    unsigned char key[LUKS_MAX_KEY_BYTES];
+    pbkdf2_sha1((const unsigned char*)passphrase,strlen(passphrase),hdr->slots[i].salt,LUKS_SALT_SIZE,
+                hdr->slots[i].iterations,key,hdr->key_bytes);
+    if (read_key_material(device,name,hdr,i,key,material,sectors)) {
+      // no device-mapper or the kernel doesn't know the cipher
+      ret = LUKS_UNSUPPORTED;
+    } else {
+      af_merge(material,mk,hdr->key_bytes,stripes);
+      if (verify_master_key(hdr,mk)) ret = LUKS_OK;
+    }
+    wipe(key,sizeof(key));
+    wipe(material,sectors*SECTOR_SIZE);
+    free(material);
+  }
+  if (ret!=LUKS_OK) wipe(mk,LUKS_MAX_KEY_BYTES);
+  return ret;
+}
+
+//////////////////////////////
+// key cache
+
+static void passphrase_check(const LuksHeader* hdr, const char* passphrase, unsigned char* check)
+{
+  HmacKey h;
+  hmac_init(&h,(const unsigned char*)passphrase,strlen(passphrase));
+  hmac(&h,hdr->mk_digest_salt,LUKS_SALT_SIZE,check);
+  wipe(&h,sizeof(h));
+}
+
+static CachedKey* find_cached_key(const LuksHeader* hdr)
+{
+  int i;
+  for (i=0; i<g_num_keys; i++) {
+    if (strcmp(g_keys[i].uuid,hdr->uuid)==0 && g_keys[i].key_bytes==hdr->key_bytes &&
+        memcmp(g_keys[i].mk_digest,hdr->mk_digest,LUKS_DIGEST_SIZE)==0) {
+      return &g_keys[i];
+    }
+  }
+  return NULL;
+}
+
+static int get_cached_key(const LuksHeader* hdr, const char* passphrase, unsigned char* mk)
+{
+  unsigned char check[SHA_DIGEST_SIZE];
+  int found = 0;
+  passphrase_check(hdr,passphrase,check);
+  pthread_mutex_lock(&g_keys_mutex);
+  CachedKey* k = find_cached_key(hdr);
+  if (k && memcmp(k->check,check,SHA_DIGEST_SIZE)==0) {
+    memcpy(mk,k->key,hdr->key_bytes);
+    found = 1;
+  }
+  pthread_mutex_unlock(&g_keys_mutex);
+  wipe(check,sizeof(check));
+  return found;
+}
+
+static void cache_key(const LuksHeader* hdr, const char* passphrase, const unsigned char* mk)
+{
+  pthread_mutex_lock(&g_keys_mutex);
+  CachedKey* k = find_cached_key(hdr);
+  if (!k && g_num_keys<MAX_CACHED_KEYS) k = &g_keys[g_num_keys++];
+  if (k) {
+    strcpy(k->uuid,hdr->uuid);
+    memcpy(k->mk_digest,hdr->mk_digest,LUKS_DIGEST_SIZE);
+    passphrase_check(hdr,passphrase,k->check);
+    k->key_bytes = hdr->key_bytes;
+    memcpy(k->key,mk,hdr->key_bytes);
+  }
+  pthread_mutex_unlock(&g_keys_mutex);
+}
+
+void luks_forget_keys()
+{
+  pthread_mutex_lock(&g_keys_mutex);
+  wipe(g_keys,sizeof(g_keys));
+  g_num_keys = 0;
+  pthread_mutex_unlock(&g_keys_mutex);
+}
+
+//////////////////////////////
+
+int luks_open(const char* device, const char* name, const char* passphrase)
+{
+  unsigned char buf[LUKS_HEADER_SIZE];
+  unsigned long long size = 0;
+  LuksHeader hdr;
+  int fd = open(device,O_RDONLY);
+  if (fd<0) return LUKS_UNSUPPORTED;
+  int r = pread(fd,buf,LUKS_HEADER_SIZE,0);
+  if (ioctl(fd,BLKGETSIZE64,&size)<0) size = 0;
+  close(fd);
+  if (r!=LUKS_HEADER_SIZE || parse_header(buf,&hdr)) return LUKS_UNSUPPORTED;
+  // only sha1 is implemented here, that's what our luksFormat uses
+  if (strcmp(hdr.hash,"sha1")) return LUKS_UNSUPPORTED;
+  if (size/SECTOR_SIZE<=hdr.payload_offset) return LUKS_UNSUPPORTED;
+
+  unsigned char mk[LUKS_MAX_KEY_BYTES];
+  int ret = LUKS_OK;
+  if (!get_cached_key(&hdr,passphrase,mk)) {
+    ret = unlock_master_key(device,name,&hdr,passphrase,mk);
+    if (ret==LUKS_OK) cache_key(&hdr,passphrase,mk);
+  }
+  if (ret==LUKS_OK) {
+    if (dm_create_crypt(name,device,hdr.payload_offset,size/SECTOR_SIZE-hdr.payload_offset,&hdr,mk,0)) {
+      ret = LUKS_UNSUPPORTED;
+    }
+  }
+  wipe(mk,sizeof(mk));
+  return ret;
+}
+
+int luks_close(const char* name)
+{
+  return dm_remove(name);
+}
@@ -0,0 +1,19 @@
+#ifndef __STEAM_LUKS_H
+#define __STEAM_LUKS_H
+
+// in-process LUKS1 unlocking using device-mapper directly
+
+#define LUKS_OK 0
+#define LUKS_BADKEY -1       // none of the key slots could be opened with the passphrase
+#define LUKS_UNSUPPORTED -2  // header, hash or cipher we can't handle, use cryptsetup
+
+// opens the LUKS partition as /dev/mapper/<name>. Master keys are kept for the
+// session, so reopening the same partition doesn't need a key derivation
+int luks_open(const char* device, const char* name, const char* passphrase);
+// removes the /dev/mapper/<name> mapping. Returns 0 on success, or if there was
+// no such mapping
+int luks_close(const char* name);
+// wipes the cached master keys. Call before handing over to another program
+void luks_forget_keys();
+
+#endif
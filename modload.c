@@ -0,0 +1,156 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "modload.h"
+#include "native.h"
+#include "system.h"
+
+#define MODULE_WAITING 0
+#define MODULE_DONE 1
+
+typedef struct {
+  const ModloadEntry* modules;
+  int num;
+  int state[MODLOAD_MAX];
+  int failed;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} ModloadJob;
+
+typedef struct {
+  ModloadJob* job;
+  int index;
+} ModloadThread;
+
+int modload_is_loaded(const char* name)
+{
+  char line[256];
+  int len = strlen(name);
+  int found = 0;
+  FILE* f = fopen("/proc/modules","r");
+  if (!f) return 0;
+  while (!found && fgets(line,sizeof(line),f)) {
+    int i;
+    // the kernel lists names with '_' where the file had '-'
+    for (i=0; i<len; i++) {
+      char c = name[i]=='-' ? '_' : name[i];
+      if (line[i]!=c) break;
+    }
+    if (i==len && line[len]==' ') found = 1;
+  }
+  fclose(f);
+  return found;
+}
+
+// finit_module saves reading the file into memory, if the kernel has it
+static int load_module(const char* path, const char* params)
+{
+#ifdef __NR_finit_module
+  int fd = open(path,O_RDONLY);
+  if (fd>=0) {
+    int r = syscall(__NR_finit_module,fd,params?params:"",0);
+    int e = errno;
+    close(fd);
+    if (r==0 || e!=ENOSYS) {
+      errno = e;
+      return r;
+    }
+  }
+#endif
+  return native_insmod(path,params);
+}
+
+static int find_module(ModloadJob* job, const char* name)
+{
+  int i;
+  for (i=0; i<job->num; i++) {
+    if (strcmp(job->modules[i].name,name)==0) return i;
+  }
+  return -1;
+}
+
+static void* load_thread(void* arg)
+{
+  ModloadThread* t = arg;
+  ModloadJob* job = t->job;
+  const ModloadEntry* m = &job->modules[t->index];
+  unsigned long long start;
+  int r;
+
+  if (m->after) {
+    int dep = find_module(job,m->after);
+    pthread_mutex_lock(&job->mutex);
+    while (dep>=0 && job->state[dep]!=MODULE_DONE) pthread_cond_wait(&job->cond,&job->mutex);
+    pthread_mutex_unlock(&job->mutex);
+  }
+
+  start = system_trace_now();
+  r = load_module(m->path,m->params);
+  if (r && errno==EEXIST) r = 0;
+  if (r) fprintf(stderr,"insmod: can't insert '%s': %s\n",m->path,strerror(errno));
+  system_trace_span(SYSTEM_TRACE_MODULE,m->path,start,r);
+
+  pthread_mutex_lock(&job->mutex);
+  job->state[t->index] = MODULE_DONE;
+  if (r) job->failed++;
+  pthread_cond_broadcast(&job->cond);
+  pthread_mutex_unlock(&job->mutex);
+  return NULL;
+}
+
+int modload(const ModloadEntry* modules, int num)
+{
+  ModloadJob job;
+  ModloadThread threads[MODLOAD_MAX];
+  pthread_t tids[MODLOAD_MAX];
+  int started[MODLOAD_MAX];
+  int i;
+
+  if (num>MODLOAD_MAX) num = MODLOAD_MAX;
+  job.modules = modules;
+  job.num = num;
+  job.failed = 0;
+  pthread_mutex_init(&job.mutex,NULL);
+  pthread_cond_init(&job.cond,NULL);
+  for (i=0; i<num; i++) {
+    job.state[i] = modload_is_loaded(modules[i].name) ? MODULE_DONE : MODULE_WAITING;
+  }
+  for (i=0; i<num; i++) {
+    started[i] = 0;
+    if (job.state[i]==MODULE_DONE) continue;
+    threads[i].job = &job;
+    threads[i].index = i;
+    if (pthread_create(&tids[i],NULL,load_thread,&threads[i])==0) {
+      started[i] = 1;
+    } else {
+      // no thread, load it right here. Its dependency was started earlier
+      load_thread(&threads[i]);
+    }
+  }
+  for (i=0; i<num; i++) {
+    if (started[i]) pthread_join(tids[i],NULL);
+  }
+  pthread_cond_destroy(&job.cond);
+  pthread_mutex_destroy(&job.mutex);
+  return job.failed;
+}
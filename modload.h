@@ -0,0 +1,22 @@
+#ifndef __STEAM_MODLOAD_H
+#define __STEAM_MODLOAD_H
+
+// kernel module loader. Modules of a list are loaded at the same time, each
+// one waiting only for the module it depends on, so the init functions of
+// independent drivers can run in parallel
+
+typedef struct {
+  const char* name;     // as in /proc/modules
+  const char* path;
+  const char* after;    // name of a module earlier in the list that has to be loaded first, or NULL
+  const char* params;   // may be NULL
+} ModloadEntry;
+
+#define MODLOAD_MAX 32
+
+// returns 1 if the module is loaded already
+int modload_is_loaded(const char* name);
+// loads the modules that aren't loaded yet. Returns the number of failures
+int modload(const ModloadEntry* modules, int num);
+
+#endif
@@ -41,6 +41,7 @@
 
 #include "extendedcommands.h"
 #include "nandroid.h"
+#include "partitions.h"
 
 #ifndef BOARD_USES_BMLUTILS
 int write_raw_image(const char* partition, const char* filename) {
@@ -126,6 +127,43 @@ int nandroid_backup(const char* backup_path) {
   return nandroid_backup_flags(backup_path,BACKUP_ALL);
 }
 
+// estimates the size of a backup. Raw images are as big as their
+// partitions, filesystems are estimated from their used space (if they are
+// mounted already)
+static uint64_t nandroid_estimate_size(int flags)
+{
+    static const struct { int flag; char* root; } roots[] = {
+        { BACKUP_SYSTEM, "SYSTEM:" },
+        { BACKUP_DATA, "DATA:" },
+#ifdef HAS_DATADATA
+        { BACKUP_DATADATA, "DATADATA:" },
+#endif
+        { BACKUP_CACHE, "CACHE:" },
+        { BACKUP_EFS, "EFS:" },
+        { 0, NULL }
+    };
+    uint64_t size = 0;
+    int i;
+#ifndef BOARD_RECOVERY_IGNORE_BOOTABLES
+    if (flags & BACKUP_BOOTABLES) {
+        const PartitionInfo* p;
+        if ((p = find_partition_by_name("boot")) != NULL) size += p->size;
+        if ((p = find_partition_by_name("recovery")) != NULL) size += p->size;
+    }
+#endif
+    for (i = 0; roots[i].root; i++) {
+        struct statfs s;
+        char mount_point[PATH_MAX];
+        if (!(flags & roots[i].flag) || is_root_path_mounted(roots[i].root) <= 0)
+            continue;
+        if (translate_root_path(roots[i].root, mount_point, PATH_MAX) == NULL)
+            continue;
+        if (statfs(mount_point, &s) == 0)
+            size += (uint64_t)(s.f_blocks - s.f_bfree) * s.f_bsize;
+    }
+    return size;
+}
+
 int nandroid_backup_flags(const char* backup_path, int flags)
 {
     ui_set_background(BACKGROUND_ICON_INSTALLING);
@@ -142,8 +180,11 @@ int nandroid_backup_flags(const char* backup_path, int flags)
     uint64_t bsize = s.f_bsize;
     uint64_t sdcard_free = bavail * bsize;
     uint64_t sdcard_free_mb = sdcard_free / (uint64_t)(1024 * 1024);
+    uint64_t estimate_mb = nandroid_estimate_size(flags) / (uint64_t)(1024 * 1024);
     ui_print("SD Card space free: %lluMB\n", sdcard_free_mb);
-    if (sdcard_free_mb < 150)
+    if (estimate_mb)
+        ui_print("Estimated backup size: at least %lluMB\n", estimate_mb);
+    if (sdcard_free_mb < 150 || sdcard_free_mb < estimate_mb)
         ui_print("There may not be enough free space to complete backup... continuing...\n");
     
     char tmp[PATH_MAX];
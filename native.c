@@ -0,0 +1,837 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// In-process implementation of the busybox applets that are called most
+// during init and in recovery. Every call to busybox costs a vfork and an
+// exec, and init does hundreds of them for trivial things like mknod. These
+// implementations only cover the argument forms we actually use, anything
+// else is handed back to busybox.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <linux/loop.h>
+
+#include "native.h"
+#include "system.h"
+
+#ifndef MS_RELATIME
+#define MS_RELATIME (1<<21)
+#endif
+
+#ifndef MNT_DETACH
+#define MNT_DETACH 2
+#endif
+
+//////////////////////////////
+// direct interfaces
+
+int native_mkdir_p(const char* path, mode_t mode)
+{
+  char tmp[PATH_MAX];
+  char* p;
+  struct stat s;
+  if (strlen(path)>=PATH_MAX) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(tmp,path);
+  for (p = tmp+1; *p; p++) {
+    if (*p=='/') {
+      *p = '\0';
+      if (mkdir(tmp,0755) && errno!=EEXIST) return -1;
+      *p = '/';
+    }
+  }
+  if (mkdir(tmp,mode)) {
+    if (errno==EEXIST && stat(tmp,&s)==0 && S_ISDIR(s.st_mode)) return 0;
+    return -1;
+  }
+  return 0;
+}
+
+int native_rm_rf(const char* path)
+{
+  struct stat s;
+  if (lstat(path,&s)) {
+    return errno==ENOENT ? 0 : -1;
+  }
+  if (!S_ISDIR(s.st_mode)) {
+    return unlink(path);
+  }
+  DIR* d = opendir(path);
+  int ret = 0;
+  if (d) {
+    struct dirent* entry;
+    char npath[PATH_MAX];
+    while ((entry = readdir(d))!=NULL) {
+      if (strcmp(entry->d_name,".")==0 || strcmp(entry->d_name,"..")==0) continue;
+      snprintf(npath,PATH_MAX,"%s/%s",path,entry->d_name);
+      if (native_rm_rf(npath)) ret = -1;
+    }
+    closedir(d);
+  }
+  if (rmdir(path)) ret = -1;
+  return ret;
+}
+
+static void copy_attributes(const char* to, const struct stat* s, int flags)
+{
+  struct timeval times[2];
+  if (flags&NATIVE_COPY_PRESERVE) {
+    lchown(to,s->st_uid,s->st_gid);
+    if (!S_ISLNK(s->st_mode)) {
+      chmod(to,s->st_mode&07777);
+      times[0].tv_sec = s->st_atime; times[0].tv_usec = 0;
+      times[1].tv_sec = s->st_mtime; times[1].tv_usec = 0;
+      utimes(to,times);
+    }
+  }
+}
+
+static int copy_file(const char* from, const char* to, const struct stat* s, int flags)
+{
+  char buf[65536];
+  int in = open(from,O_RDONLY);
+  if (in<0) return -1;
+  int out = open(to,O_WRONLY|O_CREAT|O_TRUNC,s->st_mode&0777);
+  if (out<0 && errno==EACCES) {
+    // busybox cp -f semantics: try removing the target first
+    unlink(to);
+    out = open(to,O_WRONLY|O_CREAT|O_TRUNC,s->st_mode&0777);
+  }
+  if (out<0) {
+    close(in);
+    return -1;
+  }
+  int ret = 0;
+  ssize_t r;
+  while ((r = read(in,buf,sizeof(buf)))!=0) {
+    if (r<0) {
+      if (errno==EINTR) continue;
+      ret = -1;
+      break;
+    }
+    char* p = buf;
+    while (r>0) {
+      ssize_t w = write(out,p,r);
+      if (w<0) {
+        if (errno==EINTR) continue;
+        ret = -1;
+        break;
+      }
+      p += w;
+      r -= w;
+    }
+    if (ret) break;
+  }
+  close(in);
+  if (close(out)) ret = -1;
+  if (ret==0) copy_attributes(to,s,flags);
+  return ret;
+}
+
+static int copy_entry(const char* from, const char* to, int flags)
+{
+  struct stat s;
+  int r = (flags&NATIVE_COPY_NODEREF) ? lstat(from,&s) : stat(from,&s);
+  if (r) return -1;
+  if (S_ISDIR(s.st_mode)) {
+    if (!(flags&NATIVE_COPY_RECURSIVE)) {
+      fprintf(stderr,"cp: omitting directory '%s'\n",from);
+      errno = EISDIR;
+      return -1;
+    }
+    if (mkdir(to,(s.st_mode&0777)|0700) && errno!=EEXIST) return -1;
+    DIR* d = opendir(from);
+    if (!d) return -1;
+    int ret = 0;
+    struct dirent* entry;
+    char nfrom[PATH_MAX];
+    char nto[PATH_MAX];
+    while ((entry = readdir(d))!=NULL) {
+      if (strcmp(entry->d_name,".")==0 || strcmp(entry->d_name,"..")==0) continue;
+      snprintf(nfrom,PATH_MAX,"%s/%s",from,entry->d_name);
+      snprintf(nto,PATH_MAX,"%s/%s",to,entry->d_name);
+      // only the command line arguments may be dereferenced
+      if (copy_entry(nfrom,nto,flags|NATIVE_COPY_NODEREF)) ret = -1;
+    }
+    closedir(d);
+    if (flags&NATIVE_COPY_PRESERVE) {
+      copy_attributes(to,&s,flags);
+    } else {
+      chmod(to,s.st_mode&0777);
+    }
+    return ret;
+  } else if (S_ISLNK(s.st_mode)) {
+    char target[PATH_MAX];
+    ssize_t l = readlink(from,target,PATH_MAX-1);
+    if (l<0) return -1;
+    target[l] = '\0';
+    unlink(to);
+    if (symlink(target,to)) return -1;
+    copy_attributes(to,&s,flags);
+    return 0;
+  } else if (S_ISREG(s.st_mode)) {
+    return copy_file(from,to,&s,flags);
+  } else if (flags&NATIVE_COPY_RECURSIVE) {
+    // device nodes, fifos and sockets
+    unlink(to);
+    if (mknod(to,s.st_mode,s.st_rdev)) return -1;
+    copy_attributes(to,&s,flags);
+    return 0;
+  }
+  errno = EINVAL;
+  return -1;
+}
+
+int native_copy(const char* from, const char* to, int flags)
+{
+  struct stat s;
+  char target[PATH_MAX];
+  if (stat(to,&s)==0 && S_ISDIR(s.st_mode)) {
+    // copy into the directory
+    char name[PATH_MAX];
+    strncpy(name,from,PATH_MAX-1);
+    name[PATH_MAX-1] = '\0';
+    int l = strlen(name);
+    while (l>1 && name[l-1]=='/') name[--l] = '\0';
+    char* base = strrchr(name,'/');
+    snprintf(target,PATH_MAX,"%s/%s",to,base?base+1:name);
+  } else {
+    strncpy(target,to,PATH_MAX-1);
+    target[PATH_MAX-1] = '\0';
+  }
+  return copy_entry(from,target,flags);
+}
+
+static const struct {
+  const char* name;
+  unsigned long flag;
+  int clear;
+} mount_flags[] = {
+  { "defaults", 0, 0 },
+  { "ro", MS_RDONLY, 0 },
+  { "rw", MS_RDONLY, 1 },
+  { "nosuid", MS_NOSUID, 0 },
+  { "suid", MS_NOSUID, 1 },
+  { "nodev", MS_NODEV, 0 },
+  { "dev", MS_NODEV, 1 },
+  { "noexec", MS_NOEXEC, 0 },
+  { "exec", MS_NOEXEC, 1 },
+  { "sync", MS_SYNCHRONOUS, 0 },
+  { "async", MS_SYNCHRONOUS, 1 },
+  { "remount", MS_REMOUNT, 0 },
+  { "noatime", MS_NOATIME, 0 },
+  { "atime", MS_NOATIME, 1 },
+  { "nodiratime", MS_NODIRATIME, 0 },
+  { "diratime", MS_NODIRATIME, 1 },
+  { "relatime", MS_RELATIME, 0 },
+  { "norelatime", MS_RELATIME, 1 },
+  { "bind", MS_BIND, 0 },
+  { "rbind", MS_BIND|MS_REC, 0 },
+  { "move", MS_MOVE, 0 },
+  { NULL, 0, 0 }
+};
+
+// splits a busybox style option string to mount flags and filesystem data
+// returns -1 if an option is found which we can't handle in-process
+static int parse_mount_options(const char* options, unsigned long* flags, char* data, int datalen)
+{
+  char opts[PATH_MAX];
+  char* opt;
+  char* save = NULL;
+  data[0] = '\0';
+  if (!options) return 0;
+  strncpy(opts,options,PATH_MAX-1);
+  opts[PATH_MAX-1] = '\0';
+  for (opt = strtok_r(opts,",",&save); opt; opt = strtok_r(NULL,",",&save)) {
+    int i;
+    int found = 0;
+    if (strcmp(opt,"loop")==0 || strncmp(opt,"loop=",5)==0) return -1;
+    for (i=0; mount_flags[i].name; i++) {
+      if (strcmp(opt,mount_flags[i].name)==0) {
+        if (mount_flags[i].clear) {
+          *flags &= ~mount_flags[i].flag;
+        } else {
+          *flags |= mount_flags[i].flag;
+        }
+        found = 1;
+        break;
+      }
+    }
+    if (!found) {
+      int l = strlen(data);
+      if (l+strlen(opt)+2>datalen) return -1;
+      if (l) strcat(data,",");
+      strcat(data,opt);
+    }
+  }
+  return 0;
+}
+
+int native_mount(const char* type, const char* options, const char* device, const char* dir)
+{
+  unsigned long flags = 0;
+  char data[PATH_MAX];
+  if (parse_mount_options(options,&flags,data,PATH_MAX)) {
+    errno = EINVAL;
+    return -1;
+  }
+  return mount(device,dir,type,flags,data[0]?data:NULL);
+}
+
+int native_umount(const char* dir, int force)
+{
+  return umount2(dir,force?MNT_FORCE:0);
+}
+
+int native_losetup(const char* loopdev, const char* file)
+{
+  int ffd = open(file,O_RDWR);
+  if (ffd<0) ffd = open(file,O_RDONLY);
+  if (ffd<0) return -1;
+  int lfd = open(loopdev,O_RDWR);
+  if (lfd<0) {
+    close(ffd);
+    return -1;
+  }
+  int ret = ioctl(lfd,LOOP_SET_FD,ffd);
+  if (ret==0) {
+#ifdef LOOP_SET_STATUS64
+    struct loop_info64 info;
+    memset(&info,0,sizeof(info));
+    strncpy((char*)info.lo_file_name,file,LO_NAME_SIZE-1);
+    ioctl(lfd,LOOP_SET_STATUS64,&info);
+#else
+    struct loop_info info;
+    memset(&info,0,sizeof(info));
+    strncpy(info.lo_name,file,LO_NAME_SIZE-1);
+    ioctl(lfd,LOOP_SET_STATUS,&info);
+#endif
+  }
+  close(lfd);
+  close(ffd);
+  return ret;
+}
+
+int native_losetup_detach(const char* loopdev)
+{
+  int lfd = open(loopdev,O_RDONLY);
+  if (lfd<0) return -1;
+  int ret = ioctl(lfd,LOOP_CLR_FD,0);
+  close(lfd);
+  return ret;
+}
+
+int native_insmod(const char* path, const char* params)
+{
+  struct stat s;
+  int fd = open(path,O_RDONLY);
+  if (fd<0) return -1;
+  if (fstat(fd,&s)) {
+    close(fd);
+    return -1;
+  }
+  char* image = malloc(s.st_size);
+  if (!image) {
+    close(fd);
+    errno = ENOMEM;
+    return -1;
+  }
+  off_t pos = 0;
+  while (pos<s.st_size) {
+    ssize_t r = read(fd,image+pos,s.st_size-pos);
+    if (r<0 && errno==EINTR) continue;
+    if (r<=0) break;
+    pos += r;
+  }
+  close(fd);
+  int ret = -1;
+  if (pos==s.st_size) {
+    ret = syscall(__NR_init_module,image,(unsigned long)s.st_size,params?params:"");
+  } else {
+    errno = EIO;
+  }
+  free(image);
+  return ret;
+}
+
+//////////////////////////////
+// applets
+// these return the exit code of the applet, or NATIVE_FALLBACK
+
+// parses an octal mode. returns -1 for symbolic modes
+static int parse_mode(const char* str, mode_t* mode)
+{
+  char* end;
+  long m = strtol(str,&end,8);
+  if (*str=='\0' || *end!='\0' || m<0 || m>07777) return -1;
+  *mode = m;
+  return 0;
+}
+
+static int applet_mkdir(int argc, char** argv)
+{
+  int i = 1;
+  int parents = 0;
+  mode_t mode = 0777;
+  for (; i<argc && argv[i][0]=='-'; i++) {
+    if (strcmp(argv[i],"-p")==0) parents = 1;
+    else if (strcmp(argv[i],"-m")==0 && i+1<argc) { if (parse_mode(argv[++i],&mode)) return NATIVE_FALLBACK; }
+    else return NATIVE_FALLBACK;
+  }
+  if (i>=argc) return NATIVE_FALLBACK;
+  int ret = 0;
+  for (; i<argc; i++) {
+    int r = parents ? native_mkdir_p(argv[i],mode) : mkdir(argv[i],mode);
+    if (r) {
+      fprintf(stderr,"mkdir: can't create directory '%s': %s\n",argv[i],strerror(errno));
+      ret = 1;
+    } else if (mode!=0777) {
+      chmod(argv[i],mode);
+    }
+  }
+  return ret;
+}
+
+static int applet_mknod(int argc, char** argv)
+{
+  int i = 1;
+  mode_t mode = 0666;
+  if (i+1<argc && strcmp(argv[i],"-m")==0) {
+    if (parse_mode(argv[i+1],&mode)) return NATIVE_FALLBACK;
+    i += 2;
+  }
+  if (argc-i!=4 && argc-i!=2) return NATIVE_FALLBACK;
+  const char* name = argv[i];
+  const char* type = argv[i+1];
+  unsigned int major = 0, minor = 0;
+  if (type[0]=='b' && type[1]=='\0') mode |= S_IFBLK;
+  else if ((type[0]=='c' || type[0]=='u') && type[1]=='\0') mode |= S_IFCHR;
+  else if (type[0]=='p' && type[1]=='\0') mode |= S_IFIFO;
+  else return NATIVE_FALLBACK;
+  if (S_ISFIFO(mode)) {
+    if (argc-i!=2) return NATIVE_FALLBACK;
+  } else {
+    if (argc-i!=4) return NATIVE_FALLBACK;
+    major = strtoul(argv[i+2],NULL,10);
+    minor = strtoul(argv[i+3],NULL,10);
+  }
+  if (mknod(name,mode,makedev(major,minor))) {
+    fprintf(stderr,"mknod: %s: %s\n",name,strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+static int applet_chmod(int argc, char** argv)
+{
+  mode_t mode;
+  if (argc<3 || argv[1][0]=='-' || parse_mode(argv[1],&mode)) return NATIVE_FALLBACK;
+  int i, ret = 0;
+  for (i=2; i<argc; i++) {
+    if (chmod(argv[i],mode)) {
+      fprintf(stderr,"chmod: %s: %s\n",argv[i],strerror(errno));
+      ret = 1;
+    }
+  }
+  return ret;
+}
+
+static int applet_chown(int argc, char** argv)
+{
+  if (argc<3 || argv[1][0]=='-') return NATIVE_FALLBACK;
+  char* end;
+  uid_t uid = strtoul(argv[1],&end,10);
+  gid_t gid = -1;
+  if (end==argv[1]) return NATIVE_FALLBACK;
+  if (*end=='.' || *end==':') {
+    char* gstr = end+1;
+    gid = strtoul(gstr,&end,10);
+    if (end==gstr) return NATIVE_FALLBACK;
+  }
+  if (*end!='\0') return NATIVE_FALLBACK;
+  int i, ret = 0;
+  for (i=2; i<argc; i++) {
+    if (chown(argv[i],uid,gid)) {
+      fprintf(stderr,"chown: %s: %s\n",argv[i],strerror(errno));
+      ret = 1;
+    }
+  }
+  return ret;
+}
+
+static int applet_mount(int argc, char** argv)
+{
+  const char* type = NULL;
+  char options[PATH_MAX];
+  const char* args[2];
+  int nargs = 0;
+  int i;
+  options[0] = '\0';
+  for (i=1; i<argc; i++) {
+    if (strcmp(argv[i],"-t")==0 && i+1<argc) {
+      type = argv[++i];
+    } else if (strcmp(argv[i],"-o")==0 && i+1<argc) {
+      if (strlen(options)+strlen(argv[i+1])+2>=PATH_MAX) return NATIVE_FALLBACK;
+      if (options[0]) strcat(options,",");
+      strcat(options,argv[++i]);
+    } else if (strcmp(argv[i],"-r")==0) {
+      if (options[0]) strcat(options,",");
+      strcat(options,"ro");
+    } else if (strcmp(argv[i],"-w")==0) {
+      if (options[0]) strcat(options,",");
+      strcat(options,"rw");
+    } else if (argv[i][0]=='-') {
+      return NATIVE_FALLBACK;
+    } else {
+      if (nargs>=2) return NATIVE_FALLBACK;
+      args[nargs++] = argv[i];
+    }
+  }
+  unsigned long flags = 0;
+  char data[PATH_MAX];
+  if (parse_mount_options(options,&flags,data,PATH_MAX)) return NATIVE_FALLBACK;
+  const char* device;
+  const char* dir;
+  if (nargs==2) {
+    device = args[0];
+    dir = args[1];
+  } else if (nargs==1 && (flags&MS_REMOUNT)) {
+    // the device is ignored by the kernel when remounting
+    device = NULL;
+    dir = args[0];
+  } else {
+    // listing mounts, or looking up fstab
+    return NATIVE_FALLBACK;
+  }
+  if (!(flags&(MS_REMOUNT|MS_BIND|MS_MOVE))) {
+    struct stat s;
+    // autodetection and loop files are done by busybox
+    if (!type || strcmp(type,"auto")==0) return NATIVE_FALLBACK;
+    if (stat(device,&s)==0 && S_ISREG(s.st_mode)) return NATIVE_FALLBACK;
+  }
+  if (mount(device,dir,type,flags,data[0]?data:NULL)) {
+    fprintf(stderr,"mount: mounting %s on %s failed: %s\n",device?device:"",dir,strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+// unmounts every mount point the block device is mounted on, the last
+// mounted first
+static int umount_device(const dev_t dev, int flags)
+{
+  char mounts[32][256];
+  int count = 0;
+  char line[1024];
+  FILE* f = fopen("/proc/mounts","r");
+  if (!f) return -1;
+  while (count<32 && fgets(line,sizeof(line),f)) {
+    char source[256];
+    struct stat s;
+    if (sscanf(line,"%255s %255s",source,mounts[count])!=2) continue;
+    if (stat(source,&s)==0 && S_ISBLK(s.st_mode) && s.st_rdev==dev) count++;
+  }
+  fclose(f);
+  if (!count) {
+    errno = EINVAL;
+    return -1;
+  }
+  int ret = 0;
+  while (count--) {
+    if (umount2(mounts[count],flags)) ret = -1;
+  }
+  return ret;
+}
+
+static int applet_umount(int argc, char** argv)
+{
+  int i = 1;
+  int flags = 0;
+  for (; i<argc && argv[i][0]=='-'; i++) {
+    if (strcmp(argv[i],"-f")==0) flags |= MNT_FORCE;
+    else if (strcmp(argv[i],"-l")==0) flags |= MNT_DETACH;
+    else return NATIVE_FALLBACK;
+  }
+  if (i>=argc) return NATIVE_FALLBACK;
+  int ret = 0;
+  for (; i<argc; i++) {
+    struct stat s;
+    if (stat(argv[i],&s)==0 && S_ISBLK(s.st_mode)) {
+      if (umount_device(s.st_rdev,flags)) {
+        fprintf(stderr,"umount: can't umount %s: %s\n",argv[i],strerror(errno));
+        ret = 1;
+      }
+      continue;
+    }
+    // busybox knows what to do with the rest
+    if (stat(argv[i],&s)==0 && !S_ISDIR(s.st_mode)) return NATIVE_FALLBACK;
+    if (umount2(argv[i],flags)) {
+      fprintf(stderr,"umount: can't umount %s: %s\n",argv[i],strerror(errno));
+      ret = 1;
+    }
+  }
+  return ret;
+}
+
+static int applet_losetup(int argc, char** argv)
+{
+  if (argc==3 && strcmp(argv[1],"-d")==0) {
+    if (native_losetup_detach(argv[2])) {
+      fprintf(stderr,"losetup: %s: %s\n",argv[2],strerror(errno));
+      return 1;
+    }
+    return 0;
+  }
+  if (argc==3 && argv[1][0]!='-') {
+    if (native_losetup(argv[1],argv[2])) {
+      fprintf(stderr,"losetup: %s: %s\n",argv[1],strerror(errno));
+      return 1;
+    }
+    return 0;
+  }
+  return NATIVE_FALLBACK;
+}
+
+static int applet_rm(int argc, char** argv)
+{
+  int i = 1;
+  int recursive = 0;
+  int force = 0;
+  for (; i<argc && argv[i][0]=='-' && argv[i][1]; i++) {
+    const char* c;
+    for (c = argv[i]+1; *c; c++) {
+      if (*c=='r' || *c=='R') recursive = 1;
+      else if (*c=='f') force = 1;
+      else return NATIVE_FALLBACK;
+    }
+  }
+  int ret = 0;
+  for (; i<argc; i++) {
+    struct stat s;
+    int r;
+    if (lstat(argv[i],&s)) {
+      if (!force || errno!=ENOENT) {
+        fprintf(stderr,"rm: can't remove '%s': %s\n",argv[i],strerror(errno));
+        ret = 1;
+      }
+      continue;
+    }
+    if (S_ISDIR(s.st_mode)) {
+      if (!recursive) {
+        fprintf(stderr,"rm: '%s' is a directory\n",argv[i]);
+        ret = 1;
+        continue;
+      }
+      r = native_rm_rf(argv[i]);
+    } else {
+      r = unlink(argv[i]);
+    }
+    if (r) {
+      fprintf(stderr,"rm: can't remove '%s': %s\n",argv[i],strerror(errno));
+      ret = 1;
+    }
+  }
+  return ret;
+}
+
+static int applet_rmdir(int argc, char** argv)
+{
+  int i, ret = 0;
+  if (argc<2 || argv[1][0]=='-') return NATIVE_FALLBACK;
+  for (i=1; i<argc; i++) {
+    if (rmdir(argv[i])) {
+      fprintf(stderr,"rmdir: '%s': %s\n",argv[i],strerror(errno));
+      ret = 1;
+    }
+  }
+  return ret;
+}
+
+static int applet_cp(int argc, char** argv)
+{
+  int i = 1;
+  int flags = 0;
+  for (; i<argc && argv[i][0]=='-' && argv[i][1]; i++) {
+    const char* c;
+    for (c = argv[i]+1; *c; c++) {
+      if (*c=='a') flags |= NATIVE_COPY_RECURSIVE|NATIVE_COPY_PRESERVE|NATIVE_COPY_NODEREF;
+      else if (*c=='R' || *c=='r') flags |= NATIVE_COPY_RECURSIVE|NATIVE_COPY_NODEREF;
+      else if (*c=='p') flags |= NATIVE_COPY_PRESERVE;
+      else if (*c=='d' || *c=='P') flags |= NATIVE_COPY_NODEREF;
+      else if (*c=='f') {}
+      else return NATIVE_FALLBACK;
+    }
+  }
+  if (argc-i<2) return NATIVE_FALLBACK;
+  const char* dest = argv[argc-1];
+  struct stat s;
+  if (argc-i>2 && (stat(dest,&s) || !S_ISDIR(s.st_mode))) {
+    fprintf(stderr,"cp: '%s' is not a directory\n",dest);
+    return 1;
+  }
+  int ret = 0;
+  for (; i<argc-1; i++) {
+    // only the top level source is dereferenced unless asked otherwise
+    if (native_copy(argv[i],dest,flags&~NATIVE_COPY_NODEREF)) {
+      fprintf(stderr,"cp: can't copy '%s': %s\n",argv[i],strerror(errno));
+      ret = 1;
+    }
+  }
+  return ret;
+}
+
+static int applet_ln(int argc, char** argv)
+{
+  int i = 1;
+  int sym = 0;
+  int force = 0;
+  for (; i<argc && argv[i][0]=='-' && argv[i][1]; i++) {
+    const char* c;
+    for (c = argv[i]+1; *c; c++) {
+      if (*c=='s') sym = 1;
+      else if (*c=='f') force = 1;
+      else return NATIVE_FALLBACK;
+    }
+  }
+  // hard links are left to busybox
+  if (!sym || argc-i!=2) return NATIVE_FALLBACK;
+  const char* target = argv[i];
+  char link[PATH_MAX];
+  struct stat s;
+  if (stat(argv[i+1],&s)==0 && S_ISDIR(s.st_mode)) {
+    // link is created inside the directory
+    char name[PATH_MAX];
+    strncpy(name,target,PATH_MAX-1);
+    name[PATH_MAX-1] = '\0';
+    int l = strlen(name);
+    while (l>1 && name[l-1]=='/') name[--l] = '\0';
+    char* base = strrchr(name,'/');
+    snprintf(link,PATH_MAX,"%s/%s",argv[i+1],base?base+1:name);
+  } else {
+    strncpy(link,argv[i+1],PATH_MAX-1);
+    link[PATH_MAX-1] = '\0';
+  }
+  if (force) unlink(link);
+  if (symlink(target,link)) {
+    fprintf(stderr,"ln: %s: %s\n",link,strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+static int applet_insmod(int argc, char** argv)
+{
+  char params[PATH_MAX];
+  int i;
+  if (argc<2 || argv[1][0]=='-') return NATIVE_FALLBACK;
+  params[0] = '\0';
+  for (i=2; i<argc; i++) {
+    if (strlen(params)+strlen(argv[i])+2>=PATH_MAX) return NATIVE_FALLBACK;
+    if (params[0]) strcat(params," ");
+    strcat(params,argv[i]);
+  }
+  if (native_insmod(argv[1],params)) {
+    fprintf(stderr,"insmod: can't insert '%s': %s\n",argv[1],strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+static int applet_touch(int argc, char** argv)
+{
+  int i, ret = 0;
+  if (argc<2 || argv[1][0]=='-') return NATIVE_FALLBACK;
+  for (i=1; i<argc; i++) {
+    int fd = open(argv[i],O_WRONLY|O_CREAT,0666);
+    if (fd<0) {
+      fprintf(stderr,"touch: %s: %s\n",argv[i],strerror(errno));
+      ret = 1;
+      continue;
+    }
+    close(fd);
+    utimes(argv[i],NULL);
+  }
+  return ret;
+}
+
+static const struct {
+  const char* name;
+  int (*func)(int argc, char** argv);
+} applets[] = {
+  { "mkdir", applet_mkdir },
+  { "mknod", applet_mknod },
+  { "chmod", applet_chmod },
+  { "chown", applet_chown },
+  { "mount", applet_mount },
+  { "umount", applet_umount },
+  { "losetup", applet_losetup },
+  { "rm", applet_rm },
+  { "rmdir", applet_rmdir },
+  { "cp", applet_cp },
+  { "ln", applet_ln },
+  { "insmod", applet_insmod },
+  { "touch", applet_touch },
+  { NULL, NULL }
+};
+
+int native_main(int argc, char** argv)
+{
+  int i;
+  for (i=0; applets[i].name; i++) {
+    if (strcmp(applets[i].name,argv[0])==0) {
+      unsigned long long start = system_trace_enabled() ? system_trace_now() : 0;
+      int ret = applets[i].func(argc,argv);
+      if (ret!=NATIVE_FALLBACK) {
+        if (start) system_trace_record(SYSTEM_TRACE_NATIVE,argv,start,ret);
+        return ret;
+      }
+      break;
+    }
+  }
+  return __system_argv(argv);
+}
+
+int call_native(const char* applet, ...)
+{
+  int count = 1;
+  int argc = 0;
+  va_list ap;
+  // counted first, so no argument is ever dropped
+  va_start(ap,applet);
+  while (va_arg(ap,char*)) count++;
+  va_end(ap);
+  char* argv[count+1];
+  argv[argc++] = (char*)applet;
+  va_start(ap,applet);
+  while (argc<count) argv[argc++] = va_arg(ap,char*);
+  va_end(ap);
+  argv[argc] = NULL;
+  return native_main(argc,argv);
+}
@@ -0,0 +1,30 @@
+#ifndef __STEAM_NATIVE_H
+#define __STEAM_NATIVE_H
+
+#include <sys/types.h>
+
+// returned by an in-process applet if it can't handle the given arguments
+#define NATIVE_FALLBACK -2
+
+// runs a busybox applet in-process if it's covered, otherwise falls back to
+// busybox. Parameters are the same as call_busybox's (NULL terminated)
+int call_native(const char* applet, ...);
+// same as call_native, but using an argv array. argv[0] is the applet name
+int native_main(int argc, char** argv);
+
+// direct interfaces. These return 0 on success, and -1 on failure (errno is set)
+int native_mkdir_p(const char* path, mode_t mode);
+int native_rm_rf(const char* path);
+// flags for native_copy
+#define NATIVE_COPY_RECURSIVE 1
+#define NATIVE_COPY_PRESERVE 2
+#define NATIVE_COPY_NODEREF 4
+int native_copy(const char* from, const char* to, int flags);
+// options is a busybox style option list, like "noatime,nodev,check=no"
+int native_mount(const char* type, const char* options, const char* device, const char* dir);
+int native_umount(const char* dir, int force);
+int native_losetup(const char* loopdev, const char* file);
+int native_losetup_detach(const char* loopdev);
+int native_insmod(const char* path, const char* params);
+
+#endif
@@ -0,0 +1,268 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Partition index. mtdutils and mmcutils rescan /proc every time they are
+// asked about a partition, so every mount, format and dump paid for a full
+// scan. The index is built once and holds everything we need to know about
+// the MTD, STL/BML and MMC partitions and the roots living on them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "partitions.h"
+#include "device.h"
+
+#define MAX_PARTITIONS 64
+
+static PartitionInfo g_partitions[MAX_PARTITIONS];
+static int g_num_partitions = -1;
+static pthread_mutex_t g_partitions_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int get_num_roots();
+
+static unsigned int read_sysfs_uint(const char* path)
+{
+  unsigned int value = 0;
+  FILE* f = fopen(path,"r");
+  if (f) {
+    if (fscanf(f,"%u",&value)!=1) value = 0;
+    fclose(f);
+  }
+  return value;
+}
+
+static PartitionInfo* add_partition()
+{
+  if (g_num_partitions>=MAX_PARTITIONS) return NULL;
+  PartitionInfo* p = &g_partitions[g_num_partitions++];
+  memset(p,0,sizeof(*p));
+  return p;
+}
+
+static void scan_mtd()
+{
+  char line[256];
+  FILE* f = fopen("/proc/mtd","r");
+  if (!f) return;
+  mtd_scan_partitions();
+  // dev:    size   erasesize  name
+  while (fgets(line,sizeof(line),f)) {
+    int index;
+    unsigned int size, erase_size;
+    char name[64];
+    if (sscanf(line,"mtd%d: %x %x \"%63[^\"]\"",&index,&size,&erase_size,name)!=4) continue;
+    PartitionInfo* p = add_partition();
+    if (!p) break;
+    strncpy(p->name,name,sizeof(p->name)-1);
+    snprintf(p->device,sizeof(p->device),"/dev/block/mtdblock%d",index);
+    p->type = PARTITION_MTD;
+    p->index = index;
+    p->size = size;
+    p->erase_size = erase_size;
+    p->mtd = mtd_find_partition_by_name(p->name);
+  }
+  fclose(f);
+}
+
+static void scan_block()
+{
+  char line[256];
+  FILE* f = fopen("/proc/partitions","r");
+  if (!f) return;
+  // major minor  #blocks  name
+  while (fgets(line,sizeof(line),f)) {
+    int major, minor;
+    unsigned long long blocks;
+    char name[32];
+    char path[PATH_MAX];
+    int type;
+    if (sscanf(line," %d %d %llu %31s",&major,&minor,&blocks,name)!=4) continue;
+    if (strncmp(name,"stl",3)==0) type = PARTITION_STL;
+    else if (strncmp(name,"bml",3)==0) type = PARTITION_BML;
+    else if (strncmp(name,"mmcblk",6)==0) type = PARTITION_MMC;
+    else continue;
+    PartitionInfo* p = add_partition();
+    if (!p) break;
+    strcpy(p->name,name);
+    snprintf(p->device,sizeof(p->device),"/dev/block/%s",name);
+    p->type = type;
+    p->index = minor;
+    p->size = blocks*1024;
+    if (type==PARTITION_MMC) {
+      // the erase geometry is a property of the card, not of the partition
+      char disk[32];
+      strcpy(disk,name);
+      char* c = strchr(disk+6,'p');
+      if (c) *c = '\0';
+      snprintf(path,PATH_MAX,"/sys/block/%s/device/preferred_erase_size",disk);
+      p->erase_size = read_sysfs_uint(path);
+      if (!p->erase_size) {
+        snprintf(path,PATH_MAX,"/sys/block/%s/device/erase_size",disk);
+        p->erase_size = read_sysfs_uint(path);
+      }
+    } else {
+      snprintf(path,PATH_MAX,"/sys/block/%s/queue/discard_granularity",name);
+      p->erase_size = read_sysfs_uint(path);
+    }
+  }
+  fclose(f);
+}
+
+static void scan_roots()
+{
+  int i, j;
+  int mmc_scanned = 0;
+  for (i=0; i<get_num_roots(); i++) {
+    const RootInfo* info = &g_roots[i];
+    if (info->device==NULL) continue;
+    if (info->device==g_mtd_device) {
+      if (info->partition_name==NULL) continue;
+      for (j=0; j<g_num_partitions; j++) {
+        if (g_partitions[j].type==PARTITION_MTD && strcmp(g_partitions[j].name,info->partition_name)==0) {
+          if (!g_partitions[j].root) g_partitions[j].root = info;
+          break;
+        }
+      }
+    } else if (info->device==g_mmc_device) {
+      if (info->partition_name==NULL) continue;
+      if (!mmc_scanned) {
+        mmc_scan_partitions();
+        mmc_scanned = 1;
+      }
+      const MmcPartition* mmc = mmc_find_partition_by_name(info->partition_name);
+      if (!mmc) continue;
+      PartitionInfo* p = add_partition();
+      if (!p) break;
+      strncpy(p->name,info->partition_name,sizeof(p->name)-1);
+      p->type = PARTITION_MMC;
+      p->mmc = mmc;
+      p->root = info;
+    } else {
+      for (j=0; j<g_num_partitions; j++) {
+        if (strcmp(g_partitions[j].device,info->device)==0) {
+          if (!g_partitions[j].root) g_partitions[j].root = info;
+          break;
+        }
+      }
+    }
+  }
+}
+
+// must be called with g_partitions_mutex held
+static void scan_locked()
+{
+  if (g_num_partitions<0) {
+    g_num_partitions = 0;
+    scan_mtd();
+    scan_block();
+    scan_roots();
+  }
+}
+
+int partitions_rescan()
+{
+  int num;
+  // readers hold the lock while they look at the index
+  pthread_mutex_lock(&g_partitions_mutex);
+  g_num_partitions = -1;
+  scan_locked();
+  num = g_num_partitions;
+  pthread_mutex_unlock(&g_partitions_mutex);
+  return num;
+}
+
+int get_num_partitions()
+{
+  int num;
+  pthread_mutex_lock(&g_partitions_mutex);
+  scan_locked();
+  num = g_num_partitions;
+  pthread_mutex_unlock(&g_partitions_mutex);
+  return num;
+}
+
+const PartitionInfo* get_partition(int i)
+{
+  const PartitionInfo* p = NULL;
+  pthread_mutex_lock(&g_partitions_mutex);
+  scan_locked();
+  if (i>=0 && i<g_num_partitions) p = &g_partitions[i];
+  pthread_mutex_unlock(&g_partitions_mutex);
+  return p;
+}
+
+// the first partition match() accepts, with the index scanned and locked
+static const PartitionInfo* find_partition(int (*match)(const PartitionInfo* p, const void* key), const void* key)
+{
+  const PartitionInfo* found = NULL;
+  int i;
+  pthread_mutex_lock(&g_partitions_mutex);
+  scan_locked();
+  for (i=0; i<g_num_partitions && !found; i++) {
+    if (match(&g_partitions[i],key)) found = &g_partitions[i];
+  }
+  pthread_mutex_unlock(&g_partitions_mutex);
+  return found;
+}
+
+static int match_name(const PartitionInfo* p, const void* name)
+{
+  return strcmp(p->name,name)==0;
+}
+
+static int match_device(const PartitionInfo* p, const void* device)
+{
+  return strcmp(p->device,device)==0;
+}
+
+static int match_root(const PartitionInfo* p, const void* info)
+{
+  return p->root==info;
+}
+
+static int match_mtd_name(const PartitionInfo* p, const void* name)
+{
+  return p->type==PARTITION_MTD && strcmp(p->name,name)==0;
+}
+
+const PartitionInfo* find_partition_by_name(const char* name)
+{
+  return find_partition(match_name,name);
+}
+
+const PartitionInfo* find_partition_by_device(const char* device)
+{
+  return find_partition(match_device,device);
+}
+
+const PartitionInfo* find_partition_by_root(const char* root_path)
+{
+  const PartitionInfo* p;
+  const RootInfo* info = get_root_info_for_path(root_path);
+  if (info==NULL) return NULL;
+  p = find_partition(match_root,info);
+  if (p) return p;
+  // another root on the same partition might have been registered first
+  if (info->device==g_mtd_device) {
+    return info->partition_name ? find_partition(match_mtd_name,info->partition_name) : NULL;
+  }
+  if (info->device!=NULL && info->device!=g_mmc_device) {
+    return find_partition_by_device(info->device);
+  }
+  return NULL;
+}
@@ -0,0 +1,37 @@
+#ifndef __STEAM_PARTITIONS_H
+#define __STEAM_PARTITIONS_H
+
+#include "mtdutils/mtdutils.h"
+#include "mmcutils/mmcutils.h"
+#include "roots.h"
+
+// partition types
+#define PARTITION_MTD 1
+#define PARTITION_STL 2
+#define PARTITION_BML 3
+#define PARTITION_MMC 4
+
+typedef struct {
+  char name[32];              // mtd name ("boot"), or the block name ("stl9")
+  char device[64];            // block device (/dev/block/mtdblock0, /dev/block/stl9)
+  int type;
+  int index;                  // mtd number for mtd, minor number otherwise
+  unsigned long long size;    // in bytes
+  unsigned int erase_size;    // in bytes, 0 if unknown
+  const MtdPartition* mtd;    // only for mtd partitions
+  const MmcPartition* mmc;    // only for mmc partitions known by mmcutils
+  const RootInfo* root;       // the root living on this partition, if any
+} PartitionInfo;
+
+// the index is built on the first query, from /proc/mtd, /proc/partitions
+// and sysfs. Only call rescan if the partition layout has changed
+int partitions_rescan();
+int get_num_partitions();
+const PartitionInfo* get_partition(int i);
+
+const PartitionInfo* find_partition_by_name(const char* name);
+const PartitionInfo* find_partition_by_device(const char* device);
+// accepts root paths like "SYSTEM:" or "SDCARD:/foo"
+const PartitionInfo* find_partition_by_root(const char* root_path);
+
+#endif
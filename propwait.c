@@ -0,0 +1,72 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
+#include <sys/_system_properties.h>
+
+#include "propwait.h"
+
+// set up by libc from the ANDROID_PROPERTY_WORKSPACE init passes to us
+extern prop_area* __system_property_area__;
+
+static prop_area* get_area()
+{
+  prop_area* pa = __system_property_area__;
+  if (!pa || pa->magic!=PROP_AREA_MAGIC) return NULL;
+  return pa;
+}
+
+unsigned property_serial()
+{
+  prop_area* pa = get_area();
+  return pa ? pa->serial : 0;
+}
+
+int property_wait(unsigned serial, int timeout_ms)
+{
+  prop_area* pa = get_area();
+  struct timespec now, end;
+  if (!pa) {
+    usleep(timeout_ms*1000);
+    return 1;
+  }
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  end.tv_sec += timeout_ms/1000;
+  end.tv_nsec += (timeout_ms%1000)*1000000L;
+  if (end.tv_nsec>=1000000000L) {
+    end.tv_sec++;
+    end.tv_nsec -= 1000000000L;
+  }
+  while (pa->serial==serial) {
+    struct timespec left;
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    left.tv_sec = end.tv_sec-now.tv_sec;
+    left.tv_nsec = end.tv_nsec-now.tv_nsec;
+    if (left.tv_nsec<0) {
+      left.tv_sec--;
+      left.tv_nsec += 1000000000L;
+    }
+    if (left.tv_sec<0) return 1;
+    // returns right away if the serial has changed meanwhile
+    syscall(__NR_futex,&pa->serial,FUTEX_WAIT,serial,&left,NULL,0);
+  }
+  return 0;
+}
@@ -0,0 +1,16 @@
+#ifndef __STEAM_PROPWAIT_H
+#define __STEAM_PROPWAIT_H
+
+// waiting for system property changes without polling
+//
+// init bumps the serial of the property area and wakes its futex whenever a
+// property is added. Read the serial, check the properties, then wait with
+// the serial read, so no change can be missed in between
+
+// current serial of the property area, 0 if it's not available
+unsigned property_serial();
+// sleeps until the serial differs from serial, or timeout_ms passes. Without
+// a property area it just sleeps. Returns 0 on change, 1 on timeout
+int property_wait(unsigned serial, int timeout_ms);
+
+#endif
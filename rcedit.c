@@ -0,0 +1,275 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "rcedit.h"
+
+typedef struct {
+  char* text;           // without the newline
+  int orig;             // line number when read, 0 for inserted lines
+} RcLine;
+
+struct RcFile {
+  RcLine* lines;
+  int num, size;
+  mode_t mode;
+};
+
+static int rc_grow(RcFile* rc, int count)
+{
+  if (rc->num+count<=rc->size) return 0;
+  int size = rc->size ? rc->size : 256;
+  while (size<rc->num+count) size *= 2;
+  RcLine* l = realloc(rc->lines,size*sizeof(RcLine));
+  if (!l) return -1;
+  rc->lines = l;
+  rc->size = size;
+  return 0;
+}
+
+// inserts the lines of text at position pos. Returns the number of lines
+static int rc_insert(RcFile* rc, int pos, const char* text)
+{
+  const char* p = text;
+  int count = 0;
+  while (*p) {
+    const char* e = strchr(p,'\n');
+    int len = e ? e-p : (int)strlen(p);
+    if (rc_grow(rc,1)) break;
+    memmove(&rc->lines[pos+count+1],&rc->lines[pos+count],(rc->num-pos-count)*sizeof(RcLine));
+    rc->lines[pos+count].text = strndup(p,len);
+    rc->lines[pos+count].orig = 0;
+    rc->num++;
+    count++;
+    p += len;
+    if (*p=='\n') p++;
+  }
+  return count;
+}
+
+static void rc_remove(RcFile* rc, int pos, int count)
+{
+  int i;
+  for (i=pos; i<pos+count; i++) free(rc->lines[i].text);
+  memmove(&rc->lines[pos],&rc->lines[pos+count],(rc->num-pos-count)*sizeof(RcLine));
+  rc->num -= count;
+}
+
+static int is_section_header(const char* line)
+{
+  while (*line==' ' || *line=='\t') line++;
+  return strncmp(line,"on ",3)==0 || strncmp(line,"service ",8)==0 || strncmp(line,"import ",7)==0;
+}
+
+// index of the line after the section starting at start
+static int section_end(RcFile* rc, int start)
+{
+  int i;
+  for (i=start+1; i<rc->num && !is_section_header(rc->lines[i].text); i++);
+  return i;
+}
+
+RcFile* rc_load(const char* path)
+{
+  struct stat s;
+  FILE* f = fopen(path,"r");
+  RcFile* rc;
+  char* buf;
+  if (!f) return NULL;
+  if (fstat(fileno(f),&s) || !(rc = calloc(1,sizeof(RcFile)))) {
+    fclose(f);
+    return NULL;
+  }
+  rc->mode = s.st_mode&07777;
+  buf = malloc(s.st_size+1);
+  if (buf && fread(buf,1,s.st_size,f)==(size_t)s.st_size) {
+    int i;
+    buf[s.st_size] = '\0';
+    rc_insert(rc,0,buf);
+    for (i=0; i<rc->num; i++) rc->lines[i].orig = i+1;
+  } else {
+    rc_free(rc);
+    rc = NULL;
+  }
+  free(buf);
+  fclose(f);
+  return rc;
+}
+
+int rc_save(RcFile* rc, const char* path)
+{
+  char tmp[PATH_MAX];
+  FILE* f;
+  int i, ok = 1;
+  snprintf(tmp,sizeof(tmp),"%s.tmp",path);
+  f = fopen(tmp,"w");
+  if (!f) return -1;
+  for (i=0; i<rc->num; i++) {
+    if (fputs(rc->lines[i].text,f)<0 || fputc('\n',f)<0) ok = 0;
+  }
+  fchmod(fileno(f),rc->mode);
+  if (fclose(f) || !ok || rename(tmp,path)) {
+    unlink(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+void rc_free(RcFile* rc)
+{
+  int i;
+  if (!rc) return;
+  for (i=0; i<rc->num; i++) free(rc->lines[i].text);
+  free(rc->lines);
+  free(rc);
+}
+
+static int rc_apply_one(RcFile* rc, const RcEdit* e)
+{
+  int changed = 0;
+  int i;
+  switch (e->op) {
+    case RC_INSERT_AFTER:
+      for (i=0; i<rc->num; i++) {
+        if (!strstr(rc->lines[i].text,e->match)) continue;
+        i += rc_insert(rc,i+1,e->text);
+        changed++;
+      }
+      break;
+    case RC_INSERT_BEFORE:
+      for (i=0; i<rc->num; i++) {
+        if (!strstr(rc->lines[i].text,e->match)) continue;
+        i += rc_insert(rc,i,e->text);
+        changed++;
+      }
+      break;
+    case RC_ADD_SECTION: {
+      int pos = rc->num;
+      if (e->match) {
+        for (i=0; i<rc->num; i++) {
+          if (is_section_header(rc->lines[i].text) && strstr(rc->lines[i].text,e->match)) break;
+        }
+        if (i==rc->num) break;
+        pos = i;
+      }
+      // keep a blank line between sections
+      if (pos>0 && rc->lines[pos-1].text[0]) pos += rc_insert(rc,pos,"\n");
+      pos += rc_insert(rc,pos,e->text);
+      if (pos<rc->num && rc->lines[pos-1].text[0]) rc_insert(rc,pos,"\n");
+      changed++;
+      break;
+    }
+    case RC_DELETE_SECTION:
+      for (i=0; i<rc->num; i++) {
+        if (!is_section_header(rc->lines[i].text) || !strstr(rc->lines[i].text,e->match)) continue;
+        rc_remove(rc,i,section_end(rc,i)-i);
+        i--;
+        changed++;
+      }
+      break;
+    case RC_COMMENT:
+      for (i=0; i<rc->num; i++) {
+        char* t = rc->lines[i].text;
+        int indent = strspn(t," \t");
+        char* n;
+        if (t[indent]=='#' || !strstr(t,e->match)) continue;
+        n = malloc(strlen(t)+2);
+        if (!n) continue;
+        memcpy(n,t,indent);
+        n[indent] = '#';
+        strcpy(n+indent+1,t+indent);
+        free(t);
+        rc->lines[i].text = n;
+        changed++;
+      }
+      break;
+    case RC_DELETE:
+      for (i=0; i<rc->num; i++) {
+        if (!strstr(rc->lines[i].text,e->match)) continue;
+        rc_remove(rc,i--,1);
+        changed++;
+      }
+      break;
+    case RC_REPLACE: {
+      int mlen = strlen(e->match);
+      int tlen = strlen(e->text);
+      for (i=0; i<rc->num; i++) {
+        char* t = rc->lines[i].text;
+        char* p = strstr(t,e->match);
+        char* n;
+        if (!p) continue;
+        n = malloc(strlen(t)-mlen+tlen+1);
+        if (!n) continue;
+        memcpy(n,t,p-t);
+        memcpy(n+(p-t),e->text,tlen);
+        strcpy(n+(p-t)+tlen,p+mlen);
+        free(t);
+        rc->lines[i].text = n;
+        changed++;
+      }
+      break;
+    }
+    case RC_REPLACE_LINE:
+      for (i=0; i<rc->num; i++) {
+        char* t = rc->lines[i].text;
+        int indent = strspn(t," \t");
+        char* n;
+        if (!strstr(t,e->match)) continue;
+        n = malloc(indent+strlen(e->text)+1);
+        if (!n) continue;
+        memcpy(n,t,indent);
+        strcpy(n+indent,e->text);
+        free(t);
+        rc->lines[i].text = n;
+        changed++;
+      }
+      break;
+    case RC_DELETE_LINES:
+      for (i=0; i<rc->num; i++) {
+        if (rc->lines[i].orig<e->from || rc->lines[i].orig>e->to) continue;
+        rc_remove(rc,i--,1);
+        changed++;
+      }
+      break;
+  }
+  return changed;
+}
+
+int rc_apply(RcFile* rc, const RcEdit* edits, int num)
+{
+  int i, unchanged = 0;
+  for (i=0; i<num; i++) {
+    if (!rc_apply_one(rc,&edits[i])) unchanged++;
+  }
+  return unchanged;
+}
+
+int rc_edit_file(const char* path, const RcEdit* edits, int num)
+{
+  RcFile* rc = rc_load(path);
+  int r;
+  if (!rc) return -1;
+  r = rc_apply(rc,edits,num);
+  if (rc_save(rc,path)) r = -1;
+  rc_free(rc);
+  return r;
+}
@@ -0,0 +1,41 @@
+#ifndef __STEAM_RCEDIT_H
+#define __STEAM_RCEDIT_H
+
+// in-memory editing of init.rc style files
+//
+// The file is read once, the edits are applied to the lines in order, and
+// the result is written back once. A section starts at an "on", "service"
+// or "import" line and lasts until the next one. Matches are plain
+// substrings of a line, not regular expressions
+
+// edit operations
+#define RC_INSERT_AFTER 1     // text after every line containing match
+#define RC_INSERT_BEFORE 2    // text before every line containing match
+#define RC_ADD_SECTION 3      // text as a new section before the section whose header contains match (at the end if match is NULL)
+#define RC_DELETE_SECTION 4   // removes every section whose header contains match
+#define RC_COMMENT 5          // comments out every line containing match, if not commented already
+#define RC_DELETE 6           // removes every line containing match
+#define RC_REPLACE 7          // replaces the first occurrence of match in every line with text
+#define RC_REPLACE_LINE 8     // replaces every line containing match with text, keeping its indentation
+#define RC_DELETE_LINES 9     // removes lines from to to (numbers in the file as it was read)
+
+typedef struct {
+  int op;
+  const char* match;
+  const char* text;     // may contain several lines
+  int from, to;         // only for RC_DELETE_LINES
+} RcEdit;
+
+typedef struct RcFile RcFile;
+
+// NULL if the file can't be read
+RcFile* rc_load(const char* path);
+// writes through a temporary file, keeping the mode of the loaded file
+int rc_save(RcFile* rc, const char* path);
+void rc_free(RcFile* rc);
+// returns the number of edits that didn't change anything
+int rc_apply(RcFile* rc, const RcEdit* edits, int num);
+// load, apply and save. Returns -1 if the file couldn't be read or written
+int rc_edit_file(const char* path, const RcEdit* edits, int num);
+
+#endif
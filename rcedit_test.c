@@ -0,0 +1,99 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// host test of rcedit: applies one edit of each kind to testdata/rcedit.rc
+// and compares the result with testdata/rcedit.rc.expected
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rcedit.h"
+
+static const RcEdit edits[] = {
+  { RC_DELETE_LINES, NULL, NULL, 6, 7 },
+  { RC_INSERT_AFTER, "export TMPDIR", "    class_start earlyinitclass" },
+  { RC_COMMENT, "mount rfs", NULL },
+  { RC_DELETE, "mount tmpfs nodev /tmp", NULL },
+  { RC_REPLACE, "/system/bin/playlogos1", "/sbin/steam postinit" },
+  { RC_REPLACE, "/sbin/adbd recovery", "/sbin/adbd" },
+  { RC_REPLACE_LINE, "service console", "service console /sbin/sh" },
+  { RC_ADD_SECTION, "service playlogos1", "service earlyinit /sbin/steam earlyinit\n    user root\n    oneshot\n" },
+  { RC_DELETE_SECTION, "service debuggerd", NULL },
+  // these don't match anything
+  { RC_COMMENT, "mount yaffs2", NULL },
+  { RC_ADD_SECTION, "service nothere", "service x /x\n" },
+};
+#define NUM_EDITS (sizeof(edits)/sizeof(edits[0]))
+#define NUM_UNMATCHED 2
+
+static char* read_file(const char* path)
+{
+  FILE* f = fopen(path,"r");
+  char* buf;
+  long len;
+  if (!f) return NULL;
+  fseek(f,0,SEEK_END);
+  len = ftell(f);
+  fseek(f,0,SEEK_SET);
+  buf = malloc(len+1);
+  if (buf) {
+    buf[fread(buf,1,len,f)] = '\0';
+  }
+  fclose(f);
+  return buf;
+}
+
+int main(int argc, char** argv)
+{
+  char in[1024], out[1024], expected[1024];
+  char* result;
+  char* wanted;
+  char* orig;
+  FILE* f;
+  int r;
+
+  if (argc!=2) {
+    fprintf(stderr,"Usage: %s <testdata dir>\n",argv[0]);
+    return 2;
+  }
+  snprintf(in,sizeof(in),"%s/rcedit.rc",argv[1]);
+  snprintf(expected,sizeof(expected),"%s/rcedit.rc.expected",argv[1]);
+  snprintf(out,sizeof(out),"/tmp/rcedit_test.%d.rc",(int)getpid());
+
+  orig = read_file(in);
+  if (!orig || !(f = fopen(out,"w"))) {
+    printf("can't set up %s\n",out);
+    return 3;
+  }
+  fputs(orig,f);
+  fclose(f);
+
+  r = rc_edit_file(out,edits,NUM_EDITS);
+  result = read_file(out);
+  wanted = read_file(expected);
+  unlink(out);
+  if (r!=NUM_UNMATCHED) {
+    printf("FAILURE: %d edits didn't match, expected %d\n",r,NUM_UNMATCHED);
+    return 1;
+  }
+  if (!result || !wanted || strcmp(result,wanted)) {
+    printf("FAILURE: result differs from %s:\n%s",expected,result ? result : "");
+    return 1;
+  }
+  printf("SUCCESS\n");
+  return 0;
+}
@@ -45,6 +45,7 @@
 #include "extendedcommands.h"
 #include "commands.h"
 #include "steamext.h"
+#include "system.h"
 
 static const struct option OPTIONS[] = {
   { "send_intent", required_argument, NULL, 's' },
@@ -467,6 +468,11 @@ int main(int argc, char **argv) {
     create_fstab();
     init_conf();
 
+    char trace[VALUE_MAX_LENGTH];
+    if (strcmp(get_conf_def("debug.trace",trace,"0"),"1")==0) {
+      system_trace_open(SYSTEM_TRACE_FILE);
+    }
+
     int is_user_initiated_recovery = 0;
 
     ui_init();
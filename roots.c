@@ -19,9 +19,14 @@
 #include <stdlib.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
+#include <sys/statfs.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <time.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 
 #include <limits.h>
 
@@ -37,10 +42,133 @@
 #include "device.h"
 #include "config.h"
 #include "system.h"
+#include "native.h"
+#include "partitions.h"
+#include "fsprobe.h"
+#include "luks.h"
+#include "loopdev.h"
+#include "format.h"
+#include "sysconv.h"
+#include "detectcache.h"
 #include "../steam_main/steam.h"
 
 int get_num_roots();
-int truncate(const char* path, off_t length);
+
+/* Steam: hash maps for the root and partition tables. They are built once,
+ * the tables are compile-time constants.
+ */
+#define LOOKUP_SIZE 64 // power of two, at least twice as big as the tables
+
+typedef struct {
+    const char *key[LOOKUP_SIZE];
+    int index[LOOKUP_SIZE];
+} LookupMap;
+
+static LookupMap g_roots_by_name;
+static LookupMap g_parts_by_root;
+static LookupMap g_parts_by_mount_point;
+static LookupMap g_parts_by_block;
+static LookupMap g_parts_by_loop;
+static pthread_once_t g_lookup_once = PTHREAD_ONCE_INIT;
+
+static unsigned int
+lookup_hash(const char *key, size_t len)
+{
+    unsigned int h = 2166136261u;
+    while (len--) {
+        h = (h ^ (unsigned char)*key++) * 16777619u;
+    }
+    return h & (LOOKUP_SIZE - 1);
+}
+
+static void
+lookup_add(LookupMap *map, const char *key, int index)
+{
+    if (key == NULL) {
+        return;
+    }
+    unsigned int h = lookup_hash(key, strlen(key));
+    int n;
+    for (n = 0; n < LOOKUP_SIZE && map->key[h] != NULL; n++) {
+        h = (h + 1) & (LOOKUP_SIZE - 1);
+    }
+    if (n == LOOKUP_SIZE) {
+        LOGE("Lookup map is full, %s is not added\n", key);
+        return;
+    }
+    map->key[h] = key;
+    map->index[h] = index;
+}
+
+// returns the index of the entry with the first len characters of key, or -1
+static int
+lookup_find(const LookupMap *map, const char *key, size_t len)
+{
+    unsigned int h = lookup_hash(key, len);
+    int n;
+    for (n = 0; n < LOOKUP_SIZE && map->key[h] != NULL; n++) {
+        if (strncmp(map->key[h], key, len) == 0 && map->key[h][len] == '\0') {
+            return map->index[h];
+        }
+        h = (h + 1) & (LOOKUP_SIZE - 1);
+    }
+    return -1;
+}
+
+static void
+build_lookup_maps()
+{
+    int i;
+    for (i = 0; i < get_num_roots(); i++) {
+        lookup_add(&g_roots_by_name, g_roots[i].name, i);
+    }
+    for (i = 0; i < get_num_partition_descs(); i++) {
+        const PartitionDesc *desc = &g_partition_table[i];
+        lookup_add(&g_parts_by_root, desc->root, i);
+        lookup_add(&g_parts_by_mount_point, desc->mount_point, i);
+        lookup_add(&g_parts_by_mount_point, desc->temp_mount_point, i);
+        lookup_add(&g_parts_by_block, desc->block, i);
+        lookup_add(&g_parts_by_loop, desc->loop, i);
+    }
+}
+
+static const PartitionDesc *
+find_partition_desc(const LookupMap *map, const char *key)
+{
+    if (key == NULL) {
+        return NULL;
+    }
+    pthread_once(&g_lookup_once, build_lookup_maps);
+    int i = lookup_find(map, key, strlen(key));
+    return i < 0 ? NULL : &g_partition_table[i];
+}
+
+const PartitionDesc *
+get_partition_desc_by_root(const char *root)
+{
+    return find_partition_desc(&g_parts_by_root, root);
+}
+
+const PartitionDesc *
+get_partition_desc_by_mount_point(const char *mount_point)
+{
+    return find_partition_desc(&g_parts_by_mount_point, mount_point);
+}
+
+const PartitionDesc *
+get_partition_desc_by_block(const char *block)
+{
+    return find_partition_desc(&g_parts_by_block, block);
+}
+
+const PartitionDesc *
+get_partition_desc_by_loop(const char *loop)
+{
+    if (loop != NULL && strncmp(loop, "/dev/block/", 11) == 0) {
+        loop += 11;
+    }
+    return find_partition_desc(&g_parts_by_loop, loop);
+}
 
 const RootInfo *
 get_root_info_for_path(const char *root_path)
@@ -57,14 +185,9 @@ get_root_info_for_path(const char *root_path)
         return NULL;
     }
     size_t len = c - root_path + 1;
-    size_t i;
-    for (i = 0; i < get_num_roots(); i++) {
-        RootInfo *info = &g_roots[i];
-        if (strncmp(info->name, root_path, len) == 0) {
-            return info;
-        }
-    }
-    return NULL;
+    pthread_once(&g_lookup_once, build_lookup_maps);
+    int i = lookup_find(&g_roots_by_name, root_path, len);
+    return i < 0 ? NULL : &g_roots[i];
 }
 
 static const ZipArchive *g_package = NULL;
@@ -157,6 +280,68 @@ translate_root_path(const char *root_path, char *out_buf, size_t out_buf_len)
     return out_buf;
 }
 
+/* Cached mount table.
+ * /proc/self/mounts is kept open and polled: the kernel reports POLLPRI on it
+ * whenever the mount table of the namespace changes. The table is only
+ * rescanned when that happens, or when we mounted/unmounted something
+ * ourselves. The mounted state of each root is cached with the generation
+ * of the table it was looked up in.
+ */
+static int g_mounts_fd = -1;
+static int g_mounts_generation = 0;
+static int g_mounts_scanned = -1;
+static int *g_root_mounted = NULL;
+static int *g_root_generation = NULL;
+static pthread_mutex_t g_mounts_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void
+invalidate_mounted_volumes()
+{
+    pthread_mutex_lock(&g_mounts_mutex);
+    g_mounts_generation++;
+    pthread_mutex_unlock(&g_mounts_mutex);
+}
+
+static int
+mounts_changed()
+{
+    struct pollfd p;
+    if (g_mounts_fd < 0) {
+        g_mounts_fd = open("/proc/self/mounts", O_RDONLY);
+        if (g_mounts_fd < 0) {
+            // no way to know, rescan every time
+            return 1;
+        }
+        fcntl(g_mounts_fd, F_SETFD, FD_CLOEXEC);
+        return 1;
+    }
+    p.fd = g_mounts_fd;
+    p.events = POLLPRI;
+    p.revents = 0;
+    // the kernel rearms the event itself when it's reported
+    if (poll(&p, 1, 0) > 0 && (p.revents & (POLLPRI | POLLERR))) {
+        return 1;
+    }
+    return 0;
+}
+
+// must be called with g_mounts_mutex held
+static int
+refresh_mounted_volumes()
+{
+    if (mounts_changed()) {
+        g_mounts_generation++;
+    }
+    if (g_mounts_scanned != g_mounts_generation) {
+        int ret = scan_mounted_volumes();
+        if (ret < 0) {
+            return ret;
+        }
+        g_mounts_scanned = g_mounts_generation;
+    }
+    return 0;
+}
+
 static int
 internal_root_mounted(const RootInfo *info)
 {
@@ -167,18 +352,36 @@ internal_root_mounted(const RootInfo *info)
 
     /* See if this root is already mounted.
      */
-    int ret = scan_mounted_volumes();
+    pthread_mutex_lock(&g_mounts_mutex);
+    int ret = refresh_mounted_volumes();
     if (ret < 0) {
+        pthread_mutex_unlock(&g_mounts_mutex);
         return ret;
     }
-    const MountedVolume *volume;
-    volume = find_mounted_volume_by_mount_point(info->mount_point);
-    if (volume != NULL) {
-        /* It's already mounted.
+    int index = info - g_roots;
+    if (g_root_mounted == NULL) {
+        g_root_mounted = calloc(get_num_roots(), sizeof(int));
+        g_root_generation = calloc(get_num_roots(), sizeof(int));
+        if (g_root_generation != NULL) {
+            memset(g_root_generation, 0xff, get_num_roots() * sizeof(int));
+        }
+    }
+    if (g_root_mounted != NULL && g_root_generation != NULL &&
+            g_root_generation[index] == g_mounts_scanned) {
+        ret = g_root_mounted[index];
+    } else {
+        const MountedVolume *volume;
+        volume = find_mounted_volume_by_mount_point(info->mount_point);
+        /* 0 if it's already mounted.
          */
-        return 0;
+        ret = volume != NULL ? 0 : -1;
+        if (g_root_mounted != NULL && g_root_generation != NULL) {
+            g_root_mounted[index] = ret;
+            g_root_generation[index] = g_mounts_scanned;
+        }
     }
-    return -1;
+    pthread_mutex_unlock(&g_mounts_mutex);
+    return ret;
 }
 
 int
@@ -195,32 +398,17 @@ static int mount_internal(const char* device, const char* mount_point, const cha
 {
     if (filesystem==g_auto) {
       char keyname[KEY_MAX_LENGTH];
-      char loopname[10];
-      char mtname[10];
-      if (strcmp(device,SYSTEM_BLOCK_NAME)==0) {
-        strcpy(loopname,"loop4");
-        strcpy(mtname,"system");
-      } else if (strcmp(device,CACHE_BLOCK_NAME)==0) {
-        strcpy(loopname,"loop1");
-        strcpy(mtname,"cache");
-#ifdef HAS_DATADATA
-      } else if (strcmp(device,DBDATA_BLOCK_NAME)==0) {
-        strcpy(loopname,"loop3");
-        strcpy(mtname,"dbdata");
-#endif
-      } else if (strcmp(device,DATA_BLOCK_NAME)==0) {
-        strcpy(loopname,"loop2");
-        strcpy(mtname,"data");
-      } else {
-        strcpy(loopname,"loop5");
-        strcpy(mtname,"xxx");
+      const PartitionDesc* desc = get_partition_desc_by_block(device);
+      if (!desc) {
+        LOGE("%s is not in the partition table\n", device);
+        return -1;
       }
-      sprintf(keyname,"fs.%s.type",mtname);
-      int fstype = mount_from_config_or_autodetect(keyname,device,loopname,mtname,NULL);
+      sprintf(keyname,"fs.%s.type",desc->name);
+      int fstype = mount_from_config_or_autodetect(keyname,device,desc->loop,desc->name,NULL);
       if (fstype&TYPE_FSTYPE_MASK) {
         return 0;
       } else {
-        LOGE("Couldn't mount autodetected filesystem. Parameters: %s; %s; %s\n",keyname,loopname,mtname);
+        LOGE("Couldn't mount autodetected filesystem. Parameters: %s; %s; %s\n",keyname,desc->loop,desc->name);
         return -1;
       }
     } else
@@ -258,16 +446,16 @@ ensure_root_path_mounted(const char *root_path)
             LOGE("Partition name was NULL");
             return -1;
         }
-//TODO: make the mtd stuff scan once when it needs to
-        mtd_scan_partitions();
-        const MtdPartition *partition;
-        partition = mtd_find_partition_by_name(info->partition_name);
+        const PartitionInfo *pinfo = find_partition_by_root(root_path);
+        const MtdPartition *partition = pinfo != NULL ? pinfo->mtd : NULL;
         if (partition == NULL) {
             LOGE("Partition was NULL");
             return -1;
         }
-        return mtd_mount_partition(partition, info->mount_point,
+        ret = mtd_mount_partition(partition, info->mount_point,
                 info->filesystem, 0);
+        invalidate_mounted_volumes();
+        return ret;
     }
 
     if (info->device == NULL || info->mount_point == NULL ||
@@ -290,6 +478,7 @@ ensure_root_path_mounted(const char *root_path)
             return -1;
         }
     }
+    invalidate_mounted_volumes();
     return 0;
 }
 
@@ -309,22 +498,24 @@ ensure_root_path_unmounted(const char *root_path)
 
     /* See if this root is already mounted.
      */
-    int ret = scan_mounted_volumes();
-    if (ret < 0) {
-        return ret;
-    }
-    const MountedVolume *volume;
-    volume = find_mounted_volume_by_mount_point(info->mount_point);
-    if (volume == NULL) {
+    if (internal_root_mounted(info) < 0) {
         /* It's not mounted.
          */
         return 0;
     }
 
-    ret = 0;
+    int ret = 0;
     if (info->filesystem==g_auto) ret = unmount_filesystem(info->mount_point);
     if (ret) {
-      return unmount_mounted_volume(volume);
+      pthread_mutex_lock(&g_mounts_mutex);
+      const MountedVolume *volume = NULL;
+      if (refresh_mounted_volumes() == 0) {
+          volume = find_mounted_volume_by_mount_point(info->mount_point);
+      }
+      ret = volume != NULL ? unmount_mounted_volume(volume) : 0;
+      g_mounts_generation++;
+      pthread_mutex_unlock(&g_mounts_mutex);
+      return ret;
     } else {
       return 0;
     }
@@ -344,8 +535,14 @@ get_root_mtd_partition(const char *root_path)
         return NULL;
 #endif
     }
-    mtd_scan_partitions();
-    return mtd_find_partition_by_name(info->partition_name);
+    if (info == NULL || info->partition_name == NULL) {
+        return NULL;
+    }
+    const PartitionInfo *pinfo = find_partition_by_name(info->partition_name);
+    if (pinfo == NULL || pinfo->type != PARTITION_MTD) {
+        return NULL;
+    }
+    return pinfo->mtd;
 }
 
 int
@@ -383,9 +580,8 @@ format_root_device(const char *root)
     /* Format the device.
      */
     if (info->device == g_mtd_device) {
-        mtd_scan_partitions();
-        const MtdPartition *partition;
-        partition = mtd_find_partition_by_name(info->partition_name);
+        const PartitionInfo *pinfo = find_partition_by_root(root);
+        const MtdPartition *partition = pinfo != NULL ? pinfo->mtd : NULL;
         if (partition == NULL) {
             LOGW("format_root_device: can't find mtd partition \"%s\"\n",
                     info->partition_name);
@@ -411,9 +607,8 @@ format_root_device(const char *root)
 
     //Handle MMC device types
     if(info->device == g_mmc_device) {
-        mmc_scan_partitions();
-        const MmcPartition *partition;
-        partition = mmc_find_partition_by_name(info->partition_name);
+        const PartitionInfo *pinfo = find_partition_by_root(root);
+        const MmcPartition *partition = pinfo != NULL ? pinfo->mmc : NULL;
         if (partition == NULL) {
             LOGE("format_root_device: can't find mmc partition \"%s\"\n",
                     info->partition_name);
@@ -454,45 +649,81 @@ void cryptformat_popen(const char* command)
 
 int is_encrypted_partition(const char* partition)
 {
-  int iscrypt = 0;
-#ifdef STEAM_HAS_CRYPTSETUP
-  if (call_cryptsetup("cryptsetup","isLuks",partition,NULL)==0) iscrypt=TYPE_CRYPT;
-#else
-  // we might not yet have cryptsetup to load, so we'll check the magic number
-  int fd = open(partition,O_RDONLY);
-  if (fd>=0) {
-    char magic[7];
-    read(fd,partition,6);
-    magic[6]='\0';
-    if (strcmp(magic,"LUKS\xBA\xBE")==0) iscrypt=TYPE_CRYPT;
-    close(fd);
-  }
-#endif
-  return iscrypt;
+  // the LUKS header is checked directly, as we might not yet have cryptsetup to load
+  return fsprobe(partition,NULL)==TYPE_CRYPT ? TYPE_CRYPT : 0;
 }
 
+// serializes everything that might need the user: password prompts and
+// the filesystem creation menu. Partitions can be mounted in parallel.
+// Recursive, as the creation menu formats and mounts, which may prompt again
+static pthread_mutex_t g_interaction_mutex;
+static pthread_once_t g_interaction_once = PTHREAD_ONCE_INIT;
+
+static void interaction_init(void)
+{
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr,PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&g_interaction_mutex,&attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+static void interaction_lock(void)
+{
+  pthread_once(&g_interaction_once,interaction_init);
+  pthread_mutex_lock(&g_interaction_mutex);
+}
+
+static void interaction_unlock(void)
+{
+  pthread_mutex_unlock(&g_interaction_mutex);
+}
+
+static int open_encrypted_partition_locked(const char* partition, char* secret);
+
 int open_encrypted_partition(const char* partition, char* secret)
 {
-  if (is_encrypted_partition(partition)) {
-    if (secret && strlen(secret)>0) {
-      // first try with the supplied password
-      int sin = -1;
-      int sout = -1;
-      pid_t pid;
+  interaction_lock();
+  int ret = open_encrypted_partition_locked(partition,secret);
+  interaction_unlock();
+  return ret;
+}
+
+// the passphrase is tried in-process first, cryptsetup is only started if
+// the header uses something luks.c doesn't handle. Returns 0 on success
+static int unlock_encrypted_partition(const char* partition, const char* secret)
+{
+  char secname[32];
+  sprintf(secname,"sec%s",strrchr(partition,'/')+1);
+  int r = luks_open(partition,secname,secret);
+  if (r!=LUKS_UNSUPPORTED) return r;
+  int sin = -1;
+  int sout = -1;
+  pid_t pid;
 #ifdef STEAM_HAS_CRYPTSETUP
-      pid = popen3func(&sin,&sout,NULL,POPEN_JOINSTDERR,partition,cryptsetup_popen);
+  pid = popen3func(&sin,&sout,NULL,POPEN_JOINSTDERR,partition,cryptsetup_popen);
 #else
-      char command[255];
-      sprintf(command,"/sbin/cryptsetup luksOpen -q %s sec%s",partition,strrchr(partition,'/')+1);
-      pid = popen3(&sin,&sout,NULL,POPEN_JOINSTDERR,command);
+  char command[255];
+  sprintf(command,"/sbin/cryptsetup luksOpen -q %s %s",partition,secname);
+  pid = popen3(&sin,&sout,NULL,POPEN_JOINSTDERR,command);
 #endif
-      write(sin,secret,strlen(secret));
-      write(sin,"\n",1);
-      close(sin);
-      char d;while(read(sout,&d,1)>0) printf("%c",d);
-      int r = pclose3(pid,&sin,&sout,NULL,0);
-      if (r==0) return 1;
-    }
+  write(sin,secret,strlen(secret));
+  write(sin,"\n",1);
+  close(sin);
+  char d;while(read(sout,&d,1)>0) printf("%c",d);
+  return pclose3(pid,&sin,&sout,NULL,0);
+}
+
+void close_encrypted_partition(const char* partition)
+{
+  char secname[32];
+  sprintf(secname,"sec%s",strrchr(partition,'/')+1);
+  if (luks_close(secname)) call_cryptsetup("cryptsetup","luksClose",secname,NULL);
+}
+
+static int open_encrypted_partition_locked(const char* partition, char* secret)
+{
+  if (is_encrypted_partition(partition)) {
     struct stat s;
     char path[PATH_MAX];
     sprintf(path,"/dev/mapper/sec%s",strrchr(partition,'/')+1);
@@ -500,6 +731,10 @@ int open_encrypted_partition(const char* partition, char* secret)
       // already opened
       return 1;
     }
+    if (secret && strlen(secret)>0) {
+      // first try with the supplied password
+      if (unlock_encrypted_partition(partition,secret)==0) return 1;
+    }
     int was_initialized = get_ui_state();
     if (!was_initialized) ui_init();
     set_console_cmd("");
@@ -513,22 +748,7 @@ int open_encrypted_partition(const char* partition, char* secret)
       int key = ui_wait_key();
       int action = device_handle_key(key, 1);
       if (action == SELECT_ITEM) {
-        int sin = -1;
-        int sout = -1;
-        pid_t pid;
-#ifdef STEAM_HAS_CRYPTSETUP
-        pid = popen3func(&sin,&sout,NULL,POPEN_JOINSTDERR,partition,cryptsetup_popen);
-#else
-        char command[255];
-        sprintf(command,"/sbin/cryptsetup luksOpen -q %s sec%s",partition,strrchr(partition,'/')+1);
-        pid = popen3(&sin,&sout,NULL,POPEN_JOINSTDERR,command);
-#endif
-        write(sin,get_console_cmd(),strlen(get_console_cmd()));
-        write(sin,"\n",1);
-        close(sin);
-        char d;while(read(sout,&d,1)>0) printf("%c",d);
-        int r = pclose3(pid,&sin,&sout,NULL,0);
-        if (r==0) {
+        if (unlock_encrypted_partition(partition,get_console_cmd())==0) {
           if (secret) {
             strcpy(secret,get_console_cmd());
           }
@@ -553,6 +773,78 @@ int open_encrypted_partition(const char* partition, char* secret)
   return 0;
 }
 
+#define FSCK_NONE 0
+#define FSCK_CHECK 1      // the filesystem isn't clean
+#define FSCK_FORCE 2      // clean, but due by our own rules: fsck would skip it without -f
+
+// runs fsck for the filesystem type, recorded in the boot profile
+static int run_fsck(int type, const char* device, int reason)
+{
+  unsigned long long start = system_trace_now();
+  char label[PATH_MAX];
+  const char* opts = reason==FSCK_FORCE ? "-pf" : "-p";
+  int r;
+  if (type==TYPE_JFS) {
+    r = call_fsck_jfs("fsck.jfs",opts,device,NULL);
+    snprintf(label,sizeof(label),"fsck.jfs %s",device);
+  } else {
+    const char* tool = type==TYPE_EXT4 ? "fsck.ext4" : "fsck.ext2";
+    r = call_e2fsck(tool,opts,device,NULL);
+    snprintf(label,sizeof(label),"%s %s",tool,device);
+  }
+  system_trace_span(SYSTEM_TRACE_FSCK,label,start,r);
+  return r;
+}
+
+// true if the rfs mounted on dir is flagged or looks inconsistent
+static int rfs_marked_bad(const char* dir)
+{
+  char path[PATH_MAX];
+  char value[VALUE_MAX_LENGTH];
+  struct stat s;
+  sprintf(path,"%s/etc/steam.conf",dir);
+  if ((get_conf_ro("fs.system.rfs",value) && strcmp(value,"bad")==0) ||
+      (get_conf_ro_from(path,"fs.system.rfs",value) && strcmp(value,"bad")==0)) {
+    return 1;
+  }
+  // if we found these we will think it's a bad rfs.
+  sprintf(path,"%s/BIN",dir);      if (stat(path,&s)==0) return 1;
+  sprintf(path,"%s/APP",dir);      if (stat(path,&s)==0) return 1;
+  sprintf(path,"%s/DATA",dir);     if (stat(path,&s)==0) return 1;
+  sprintf(path,"%s/SYSTEM",dir);   if (stat(path,&s)==0) return 1;
+  sprintf(path,"%s/RECOVERY",dir); if (stat(path,&s)==0) return 1;
+  return 0;
+}
+
+int filesystem_rfs_bad(int fstype, const char* mtname)
+{
+  char dir[PATH_MAX];
+  char mtnamec[PATH_MAX];
+  char* p;
+  if (!(fstype&TYPE_RFS)) return 0;
+  strcpy(mtnamec,mtname);
+  while ((p = strchr(mtnamec,'/'))) *p = '_';
+  // with a loop file the rfs itself is below the loop (see mount_partition)
+  if (fstype&TYPE_LOOP) sprintf(dir,"/res/.orig_%s",mtnamec);
+  else sprintf(dir,"/%s",mtname);
+  return rfs_marked_bad(dir);
+}
+
+// mounts the base filesystem of type for detection. Returns 0 if it's mounted
+static int trial_mount(int type, const char* from, const char* to, int dirty)
+{
+  switch (type) {
+    case TYPE_EXT2: return call_native("mount","-t","ext2","-o",TYPE_EXT2_DEFAULT_MOUNT,from,to,NULL);
+    case TYPE_EXT4: return call_native("mount","-t","ext4","-o",TYPE_EXT4_DEFAULT_MOUNT,from,to,NULL);
+    case TYPE_RFS: return call_native("mount","-t","rfs","-o",TYPE_RFS_DEFAULT_MOUNT,from,to,NULL);
+    case TYPE_JFS:
+      // jfs won't mount if dirty without being checked first
+      if (dirty) run_fsck(TYPE_JFS,from,FSCK_CHECK);
+      return call_native("mount","-t","jfs","-o",TYPE_JFS_DEFAULT_MOUNT,from,to,NULL);
+  }
+  return -1;
+}
+
 int filesystem_check(const char* partition) {
   int iscrypt = is_encrypted_partition(partition);
   struct stat s;
@@ -569,38 +861,38 @@ int filesystem_check(const char* partition) {
   } else {
     strcpy(frommount,partition);
   }
-  char* loopmount = "/res/.tmp";
+  // every partition gets its own directory, as they might be checked in parallel
+  char loopmount[PATH_MAX];
   char path[PATH_MAX];
-  call_busybox("mkdir","/res/.tmp",NULL);
-  call_busybox("chmod","700","/res/.tmp",NULL);
+  sprintf(loopmount,"/res/.tmp_%s",strrchr(partition,'/')+1);
+  call_native("mkdir",loopmount,NULL);
+  call_native("chmod","700",loopmount,NULL);
 
-  if (stat(frommount,&s)==0 && S_ISDIR(s.st_mode) && call_busybox("mount","-o","bind",frommount,loopmount,NULL)==0) {
+  // the type comes from the superblock, the filesystem is only mounted to
+  // look for the marker files
+  FsProbeInfo probe;
+  int probed = 0;
+  memset(&probe,0,sizeof(probe));
+  if (!(stat(frommount,&s)==0 && S_ISDIR(s.st_mode))) {
+    probed = fsprobe(frommount,&probe);
+    if (probed<0) probed = 0;
+    printf(PARTITION_PROBED,frommount,probed,probe.uuid,probe.label);
+  }
+
+  if (stat(frommount,&s)==0 && S_ISDIR(s.st_mode) && call_native("mount","-o","bind",frommount,loopmount,NULL)==0) {
     fstype = TYPE_DIRECTORY;
-  } else if (call_busybox("mount","-t","ext2","-o",TYPE_EXT2_DEFAULT_MOUNT,frommount,loopmount,NULL)==0) {
-    // ext3/4 won't mount as ext2, so we can differentiate them by trying ext2 first
-    fstype = TYPE_EXT2;
-  } else if (call_busybox("mount","-t","ext4","-o",TYPE_EXT4_DEFAULT_MOUNT,frommount,loopmount,NULL)==0) {
-    fstype = TYPE_EXT4;
-  } else if (call_busybox("mount","-t","rfs","-o",TYPE_RFS_DEFAULT_MOUNT,frommount,loopmount,NULL)==0) {
-    fstype = TYPE_RFS;
-    char value[VALUE_MAX_LENGTH];
-    if ((get_conf_ro("fs.system.rfs",value) && strcmp(value,"bad")==0) ||
-        (get_conf_ro_from("/res/.tmp/etc/steam.conf","fs.system.rfs",value) && strcmp(value,"bad")==0)) {
-      fstype = TYPE_RFS|TYPE_RFS_BAD;
-    }
-    // if we found these we will think it's a bad rfs.
-    sprintf(path,"%s/BIN",loopmount);      if (stat(path,&s)==0) { fstype = TYPE_RFS|TYPE_RFS_BAD; }
-    sprintf(path,"%s/APP",loopmount);      if (stat(path,&s)==0) { fstype = TYPE_RFS|TYPE_RFS_BAD; }
-    sprintf(path,"%s/DATA",loopmount);     if (stat(path,&s)==0) { fstype = TYPE_RFS|TYPE_RFS_BAD; }
-    sprintf(path,"%s/SYSTEM",loopmount);   if (stat(path,&s)==0) { fstype = TYPE_RFS|TYPE_RFS_BAD; }
-    sprintf(path,"%s/RECOVERY",loopmount); if (stat(path,&s)==0) { fstype = TYPE_RFS|TYPE_RFS_BAD; }
+  } else if (probed) {
+    if (trial_mount(probed,frommount,loopmount,probe.dirty)==0) fstype = probed;
   } else {
-    // jfs won't mount if dirty without being checked first
-    call_fsck_jfs("fsck.jfs","-p",frommount,NULL);
-    if (call_busybox("mount","-t","jfs","-o",TYPE_JFS_DEFAULT_MOUNT,frommount,loopmount,NULL)==0) {
-      fstype = TYPE_JFS;
+    // unknown superblock, try them in turn. ext3/4 won't mount as ext2, so
+    // we can differentiate them by trying ext2 first
+    static const int trials[] = { TYPE_EXT2, TYPE_EXT4, TYPE_RFS, TYPE_JFS };
+    int i;
+    for (i=0; i<(int)(sizeof(trials)/sizeof(trials[0])) && !fstype; i++) {
+      if (trial_mount(trials[i],frommount,loopmount,1)==0) fstype = trials[i];
     }
   }
+  if (fstype==TYPE_RFS && rfs_marked_bad(loopmount)) fstype |= TYPE_RFS_BAD;
 
   int isloop = 0;
   int isbind = 0;
@@ -611,18 +903,60 @@ int filesystem_check(const char* partition) {
     sprintf(path,"%s/.data",loopmount);
     if (stat(path,&s)==0) isbind = TYPE_BIND;
     sync();
-    call_busybox("umount","-f",frommount,NULL);
-    call_busybox("umount","-f",loopmount,NULL);
+    call_native("umount","-f",frommount,NULL);
+    call_native("umount","-f",loopmount,NULL);
   }
-  call_busybox("rmdir","/res/.tmp",NULL);
+  call_native("rmdir",loopmount,NULL);
 
-  if (fstype&TYPE_CRYPT) { char secname[32];sprintf(secname,"sec%s",strrchr(partition,'/')+1);call_cryptsetup("cryptsetup","luksClose",secname,NULL); }
+  if (fstype&TYPE_CRYPT) close_encrypted_partition(partition);
 
   printf(PARTITION_INFORMATION,partition,fstype|iscrypt|isloop|isbind);
   return fstype|iscrypt|isloop|isbind;
 }
 
-int check_and_mount(int fstype, const char* partition, const char* loopname, const char* mtname, char* secret) {
+// decides from the superblock whether the filesystem has to be checked
+// before mounting. Returns FSCK_NONE, FSCK_CHECK or FSCK_FORCE
+static int needs_fsck(const char* device)
+{
+  FsProbeInfo probe;
+  char value[VALUE_MAX_LENGTH];
+  if (strcmp(get_conf_def("fs.fsck.always",value,"0"),"1")==0) {
+    printf(FSCK_FORCED,device);
+    return FSCK_FORCE;
+  }
+  int type = fsprobe(device,&probe);
+  if (type!=TYPE_EXT2 && type!=TYPE_EXT4 && type!=TYPE_JFS) {
+    printf(FSCK_UNKNOWN,device);
+    return FSCK_CHECK;
+  }
+  if (probe.dirty) {
+    printf(FSCK_DIRTY,device);
+    return FSCK_CHECK;
+  }
+  if (type==TYPE_JFS) {
+    // jfs doesn't keep mount counts, being clean is all we can check
+    printf(FSCK_CLEAN,device);
+    return FSCK_NONE;
+  }
+  int maxmount = atoi(get_conf_def("fs.fsck.maxmount",value,"20"));
+  if (maxmount>0 && probe.ext_mount_count>=maxmount) {
+    printf(FSCK_MAXMOUNT,device,probe.ext_mount_count);
+    return FSCK_FORCE;
+  }
+  int interval = atoi(get_conf_def("fs.fsck.interval",value,"30"));
+  time_t now = time(NULL);
+  // don't trust the clock if it's before the last check
+  if (interval>0 && now>(time_t)probe.ext_last_check &&
+      now-(time_t)probe.ext_last_check>(time_t)interval*24*60*60) {
+    printf(FSCK_INTERVAL,device,(int)((now-(time_t)probe.ext_last_check)/(24*60*60)));
+    return FSCK_FORCE;
+  }
+  printf(FSCK_CLEAN,device);
+  return FSCK_NONE;
+}
+
+static int mount_partition(int fstype, const char* partition, const char* loopname, const char* mtname, char* secret) {
+  int reason;
   printf(INIT_MOUNTING,fstype,partition);
   if (fstype&TYPE_FSTYPE_MASK) {
     char mtnamec[PATH_MAX];
@@ -642,60 +976,68 @@ int check_and_mount(int fstype, const char* partition, const char* loopname, con
     }
     if (fstype&TYPE_LOOP) {
       sprintf(topath,"/res/.orig_%s",mtnamec);
-      call_busybox("mkdir",topath,NULL);
-      call_busybox("chmod","700",topath,NULL);
+      call_native("mkdir",topath,NULL);
+      call_native("chmod","700",topath,NULL);
     } else {
       sprintf(topath,"/%s",mtname);
       struct stat s;
       if (stat(topath,&s))
-        call_busybox("mkdir",topath,NULL);
+        call_native("mkdir",topath,NULL);
     }
     // mount base fs
     if (fstype&TYPE_RFS) {
       // no fsck. duh
-      if (call_busybox("mount","-t","rfs","-o",TYPE_RFS_DEFAULT_MOUNT,frompath,topath,NULL)) {
-        if (fstype&TYPE_CRYPT) { char secname[32];sprintf(secname,"sec%s",strrchr(partition,'/')+1);call_cryptsetup("cryptsetup","luksClose",secname,NULL); }
+      if (call_native("mount","-t","rfs","-o",TYPE_RFS_DEFAULT_MOUNT,frompath,topath,NULL)) {
+        if (fstype&TYPE_CRYPT) close_encrypted_partition(partition);
         return 2;
       }
     } else if (fstype&TYPE_EXT2) {
-      call_e2fsck("fsck.ext2","-p",frompath,NULL);
-      if (call_busybox("mount","-t","ext2","-o",TYPE_EXT2_DEFAULT_MOUNT,frompath,topath,NULL)) {
-        if (fstype&TYPE_CRYPT) { char secname[32];sprintf(secname,"sec%s",strrchr(partition,'/')+1);call_cryptsetup("cryptsetup","luksClose",secname,NULL); }
+      if ((reason = needs_fsck(frompath))) run_fsck(TYPE_EXT2,frompath,reason);
+      if (call_native("mount","-t","ext2","-o",TYPE_EXT2_DEFAULT_MOUNT,frompath,topath,NULL)) {
+        if (fstype&TYPE_CRYPT) close_encrypted_partition(partition);
         return 3;
       }
     } else if (fstype&TYPE_EXT4) {
-      call_e2fsck("fsck.ext4","-p",frompath,NULL);
-      if (call_busybox("mount","-t","ext4","-o",TYPE_EXT4_DEFAULT_MOUNT,frompath,topath,NULL)) {
-        if (fstype&TYPE_CRYPT) { char secname[32];sprintf(secname,"sec%s",strrchr(partition,'/')+1);call_cryptsetup("cryptsetup","luksClose",secname,NULL); }
+      if ((reason = needs_fsck(frompath))) run_fsck(TYPE_EXT4,frompath,reason);
+      if (call_native("mount","-t","ext4","-o",TYPE_EXT4_DEFAULT_MOUNT,frompath,topath,NULL)) {
+        if (fstype&TYPE_CRYPT) close_encrypted_partition(partition);
         return 4;
       }
     } else if (fstype&TYPE_JFS) {
-      call_fsck_jfs("fsck.jfs","-p",frompath,NULL);
-      if (call_busybox("mount","-t","jfs","-o",TYPE_JFS_DEFAULT_MOUNT,frompath,topath,NULL)) {
-        if (fstype&TYPE_CRYPT) { char secname[32];sprintf(secname,"sec%s",strrchr(partition,'/')+1);call_cryptsetup("cryptsetup","luksClose",secname,NULL); }
+      if ((reason = needs_fsck(frompath))) run_fsck(TYPE_JFS,frompath,reason);
+      if (call_native("mount","-t","jfs","-o",TYPE_JFS_DEFAULT_MOUNT,frompath,topath,NULL)) {
+        if (fstype&TYPE_CRYPT) close_encrypted_partition(partition);
         return 5;
       }
     } else if (fstype&TYPE_DIRECTORY) {
-      if (call_busybox("mount","-o","bind",frompath,topath,NULL)) {
+      if (call_native("mount","-o","bind",frompath,topath,NULL)) {
         return 32766;
       }
     }
     // mount loop
     if (fstype&TYPE_LOOP) {
+      char value[VALUE_MAX_LENGTH];
+      int flags = LOOPDEV_AUTOCLEAR;
+      if (strcmp(get_conf_def("fs.loop.directio",value,"1"),"1")==0) flags |= LOOPDEV_DIRECT_IO;
       sprintf(frompath,"/res/.orig_%s/.extfs",mtnamec);
-      sprintf(topath,"/dev/block/%s",loopname);
-      if (call_busybox("losetup",topath,frompath,NULL)) {
-        call_busybox("umount","-f",topath,NULL);
-        if (fstype&TYPE_CRYPT) { char secname[32];sprintf(secname,"sec%s",strrchr(partition,'/')+1);call_cryptsetup("cryptsetup","luksClose",secname,NULL); }
+      // loopname is only a preference, any free loop device will do
+      int lfd = loopdev_attach(frompath,loopname,flags,topath,sizeof(topath));
+      if (lfd<0) {
+        sprintf(topath,"/res/.orig_%s",mtnamec);
+        call_native("umount","-f",topath,NULL);
+        if (fstype&TYPE_CRYPT) close_encrypted_partition(partition);
         return 6;
       }
       sprintf(frompath,"/%s",mtname);
-      call_e2fsck("fsck.ext2","-p",topath,NULL);
-      if (call_busybox("mount","-t","ext2","-o",TYPE_EXT2_DEFAULT_MOUNT,topath,frompath,NULL)) {
-        call_busybox("losetup","-d",topath,NULL);
+      if ((reason = needs_fsck(topath))) run_fsck(TYPE_EXT2,topath,reason);
+      int r = call_native("mount","-t","ext2","-o",TYPE_EXT2_DEFAULT_MOUNT,topath,frompath,NULL);
+      // with autoclear the loop device goes away when it's unmounted
+      close(lfd);
+      if (r) {
+        loopdev_detach(topath);
         sprintf(topath,"/res/.orig_%s",mtnamec);
-        call_busybox("umount","-f",topath,NULL);
-        if (fstype&TYPE_CRYPT) { char secname[32];sprintf(secname,"sec%s",strrchr(partition,'/')+1);call_cryptsetup("cryptsetup","luksClose",secname,NULL); }
+        call_native("umount","-f",topath,NULL);
+        if (fstype&TYPE_CRYPT) close_encrypted_partition(partition);
         return 7;
       }
     }
@@ -707,7 +1049,82 @@ int check_and_mount(int fstype, const char* partition, const char* loopname, con
   return 0;
 }
 
+int check_and_mount(int fstype, const char* partition, const char* loopname, const char* mtname, char* secret) {
+  unsigned long long start = system_trace_now();
+  char label[PATH_MAX];
+  int r = mount_partition(fstype,partition,loopname,mtname,secret);
+  snprintf(label,sizeof(label),"mount %s /%s",partition,mtname);
+  system_trace_span(SYSTEM_TRACE_MOUNT,label,start,r);
+  return r;
+}
+
+void filesystem_ask_secret(char* ss)
+{
+  interaction_lock();
+  int was_initialized = get_ui_state();
+  if (!was_initialized) ui_init();
+  set_console_cmd("");
+  ui_clear_num_screen(0);
+  ui_set_secret_screen(1);
+  ui_set_show_text(1);
+  ui_print(SECRET_ENTER_PASS);
+  ui_print(SECRET_HOWTO);
+  ui_clear_key_queue();
+  int type = 0;
+  do {
+    int key = ui_wait_key();
+    int action = device_handle_key(key, 1);
+    if (action == SELECT_ITEM && strlen(get_console_cmd())>0) {
+      if (type==0) {
+        strcpy(ss,get_console_cmd());
+        type = 1;
+        ui_clear_key_queue();
+        set_console_cmd("");
+        ui_print(SECRET_PASSWORD_AGAIN);
+      } else {
+        if (strcmp(ss,get_console_cmd())==0) {
+          break;
+        } else {
+          ui_print(SECRET_PASSWORD_MISMATCH);
+          type = 0;
+          ui_clear_key_queue();
+          set_console_cmd("");
+        }
+      }
+    }
+    if (action == GO_BACK) {
+      type = 0;
+      set_console_cmd("");
+      ui_clear_key_queue();
+    }
+  } while (true);
+  ui_set_secret_screen(0);
+  ui_set_show_text(0);
+  if (!was_initialized) ui_done();
+  interaction_unlock();
+}
+
+// maps the progress of one step into its part of the whole
+typedef struct {
+  void (*progress)(void* ctx, float fraction);
+  void* ctx;
+  float base;
+  float span;
+} ProgressStep;
+
+static void step_progress(void* ctx, float fraction)
+{
+  ProgressStep* step = ctx;
+  if (step->progress) step->progress(step->ctx,step->base+step->span*fraction);
+}
+
 int filesystem_format(int fstype, const char* partition, const char* loopname, const char* mtname, char* secret)
+{
+  return filesystem_format_progress(fstype,partition,loopname,mtname,secret,NULL,NULL);
+}
+
+int filesystem_format_progress(int fstype, const char* partition, const char* loopname, const char* mtname, char* secret,
+                               void (*progress)(void* ctx, float fraction), void* ctx)
 {
   char fromname[PATH_MAX];
   strcpy(fromname,partition);
@@ -716,46 +1133,7 @@ int filesystem_format(int fstype, const char* partition, const char* loopname, c
   printf(INIT_CREATE,fstype,partition);
   if (fstype&TYPE_CRYPT) {
     if (!secret || strlen(secret)==0) {
-      int was_initialized = get_ui_state();
-      if (!was_initialized) ui_init();
-      set_console_cmd("");
-      ui_clear_num_screen(0);
-      ui_set_secret_screen(1);
-      ui_set_show_text(1);
-      ui_print(SECRET_ENTER_PASS);
-      ui_print(SECRET_HOWTO);
-      ui_clear_key_queue();
-      int type = 0;
-      do {
-        int key = ui_wait_key();
-        int action = device_handle_key(key, 1);
-        if (action == SELECT_ITEM && strlen(get_console_cmd())>0) {
-          if (type==0) {
-            strcpy(ss,get_console_cmd());
-            type = 1;
-            ui_clear_key_queue();
-            set_console_cmd("");
-            ui_print(SECRET_PASSWORD_AGAIN);
-          } else {
-            if (strcmp(ss,get_console_cmd())==0) {
-              break;
-            } else {
-              ui_print(SECRET_PASSWORD_MISMATCH);
-              type = 0;
-              ui_clear_key_queue();
-              set_console_cmd("");
-            }
-          }
-        }
-        if (action == GO_BACK) {
-          type = 0;
-          set_console_cmd("");
-          ui_clear_key_queue();
-        }
-      } while (true);
-      ui_set_secret_screen(0);
-      ui_set_show_text(0);
-      if (!was_initialized) ui_done();
+      filesystem_ask_secret(ss);
       if (secret) {
         strcpy(secret,ss);
       }
@@ -785,71 +1163,187 @@ int filesystem_format(int fstype, const char* partition, const char* loopname, c
     sprintf(fromname,"/dev/mapper/sec%s",strrchr(partition,'/')+1);
   }
 
-  if (fstype&TYPE_RFS) {
-    char header[255];
-    if (strcmp(partition,DATA_BLOCK_NAME)==0) {
-      sprintf(header,"/sbin/fat.format -v -F 32 -S 4096 -s 4 %s",fromname);
-#ifdef HAS_DATADATA
-    } else if (strcmp(partition,DBDATA_BLOCK_NAME)==0) {
-      sprintf(header,"/sbin/fat.format -v -F 16 -S 4096 -s 1 %s",fromname);
-#endif
-    } else if (strcmp(partition,CACHE_BLOCK_NAME)==0) {
-      sprintf(header,"/sbin/fat.format -v -F 16 -S 4096 -s 1 %s",fromname);
-    } else if (strcmp(partition,SYSTEM_BLOCK_NAME)==0) {
-      sprintf(header,"/sbin/fat.format -v -F 32 -S 4096 -s 1 %s",fromname);
-    } else {
-      sprintf(header,"/sbin/fat.format -v %s",fromname);
-    }
-    sh(header);
-  } else if (fstype&TYPE_EXT2) {
-    if (strcmp(partition,DATA_BLOCK_NAME)==0) {
-      call_mke2fs("mkfs.ext2","-L",mtname,"-b","4096","-m","0","-F",fromname,NULL);
-    } else {
-      call_mke2fs("mkfs.ext2","-L",mtname,"-b","1024","-m","0","-F",fromname,NULL);
-    }
-  } else if (fstype&TYPE_EXT4) {
-    if (strcmp(partition,DATA_BLOCK_NAME)==0) {
-      call_mke2fs("mkfs.ext4","-L",mtname,"-b","4096","-m","0","-F",fromname,NULL);
-    } else {
-      call_mke2fs("mkfs.ext4","-L",mtname,"-b","1024","-J","size=4","-m","0","-F",fromname,NULL);
-    }
-  } else if (fstype&TYPE_JFS) {
-    call_mkfs_jfs("mkfs.jfs","-q","-L",mtname,fromname,NULL);
+  const PartitionDesc* desc = get_partition_desc_by_block(partition);
+  int failed = 0;
+  // with a loop file, most of the time goes to writing the file
+  ProgressStep step = { progress, ctx, 0, (fstype&TYPE_LOOP) ? 0.1 : 1.0 };
+  if (fstype&(TYPE_RFS|TYPE_EXT2|TYPE_EXT4|TYPE_JFS)) {
+    if (format_mkfs(fstype&TYPE_FSTYPE_MASK,fromname,mtname,desc,0,step_progress,&step)) failed = 1;
   } else if (fstype&TYPE_DIRECTORY) {
-    call_busybox("rm","-rf",fromname,NULL);
-    call_busybox("mkdir",fromname,NULL);
+    call_native("rm","-rf",fromname,NULL);
+    call_native("mkdir",fromname,NULL);
   }
 
-  if (fstype&TYPE_LOOP) {
-    // for this we have to mount it first...
-    call_busybox("mkdir","/res/.tmp",NULL);
-    call_busybox("chmod","700","/res/.tmp",NULL);
-    if (check_and_mount(fstype&TYPE_FSTYPE_MASK,fromname,"loop0","res/.tmp",ss)==0) {
-      int loopsize = 0;
-      if (strcmp(partition,DATA_BLOCK_NAME)==0) {
-        loopsize = BLOCK_DATA_LOOP_SIZE;
-#ifdef HAS_DATADATA
-      } else if (strcmp(partition,DBDATA_BLOCK_NAME)==0) {
-        loopsize = BLOCK_DBDATA_LOOP_SIZE;
-#endif
-      } else if (strcmp(partition,CACHE_BLOCK_NAME)==0) {
-        loopsize = BLOCK_CACHE_LOOP_SIZE;
-      }
+  if ((fstype&TYPE_LOOP) && !failed) {
+    // for this we have to mount it first. The names are per partition, as
+    // several partitions can be formatted at once
+    char tmpname[PATH_MAX];
+    char tmpmount[PATH_MAX];
+    char extfs[PATH_MAX];
+    sprintf(tmpname,"res/.fmt_%s",strrchr(partition,'/')+1);
+    sprintf(tmpmount,"/%s",tmpname);
+    sprintf(extfs,"%s/.extfs",tmpmount);
+    call_native("mkdir",tmpmount,NULL);
+    call_native("chmod","700",tmpmount,NULL);
+    // only the base filesystem is mounted here, it needs no loop device
+    if (check_and_mount(fstype&TYPE_FSTYPE_MASK,fromname,NULL,tmpname,ss)==0) {
+      long long loopsize = desc ? desc->loop_size : 0;
       if (loopsize) {
-        call_busybox("touch","/res/.tmp/.extfs",NULL);
-        truncate("/res/.tmp/.extfs",loopsize);
-        call_busybox("losetup","/dev/block/loop0","/res/.tmp/.extfs",NULL);
-        call_mke2fs("mkfs.ext2","-L",mtname,"-b","4096","-m","0","-F","/dev/block/loop0",NULL);
-        call_busybox("losetup","-d","/dev/block/loop0",NULL);
+        char loopdev[PATH_MAX];
+        // preallocated, so the image isn't scattered all over the partition
+        step.base = 0.1;
+        step.span = 0.6;
+        int lfd = -1;
+        if (loopdev_create_file(extfs,loopsize,step_progress,&step)==0) {
+          lfd = loopdev_attach(extfs,NULL,0,loopdev,sizeof(loopdev));
+        }
+        if (lfd>=0) {
+          step.base = 0.7;
+          step.span = 0.3;
+          if (format_mkfs(TYPE_EXT2,loopdev,mtname,desc,loopsize,step_progress,&step)) failed = 1;
+          close(lfd);
+          loopdev_detach(loopdev);
+        } else {
+          // a partial image would be taken for the filesystem at next mount
+          unlink(extfs);
+          failed = 1;
+        }
       }
-      call_busybox("umount","-f","/res/.tmp/.extfs",NULL);
-      call_busybox("umount","-f","/res/.tmp",NULL);
+      call_native("umount","-f",tmpmount,NULL);
+    } else {
+      failed = 1;
     }
-    call_busybox("rm","-rf","/res/.tmp",NULL);
+    call_native("rm","-rf",tmpmount,NULL);
   }
-  if (fstype&TYPE_CRYPT) { char secname[32];sprintf(secname,"sec%s",strrchr(partition,'/')+1);call_cryptsetup("cryptsetup","luksClose",secname,NULL); }
+  if (fstype&TYPE_CRYPT) close_encrypted_partition(partition);
   memset(ss,0,sizeof(ss));
-  return fstype;
+  return failed ? 0 : fstype;
+}
+
+int filesystem_can_convert_live(int oldtype, int newtype)
+{
+  // only the loop file is added or removed, the base filesystem stays
+  if ((oldtype&~TYPE_LOOP)!=(newtype&~TYPE_LOOP)) return 0;
+  if (!(oldtype&(TYPE_RFS|TYPE_EXT2|TYPE_EXT4|TYPE_JFS))) return 0;
+  return (oldtype&TYPE_LOOP)!=(newtype&TYPE_LOOP);
+}
+
+// removes everything from dir, except keep
+static void remove_contents(const char* dir, const char* keep)
+{
+  char path[PATH_MAX];
+  struct dirent* de;
+  DIR* d = opendir(dir);
+  if (!d) return;
+  while ((de = readdir(d))) {
+    if (strcmp(de->d_name,".")==0 || strcmp(de->d_name,"..")==0) continue;
+    if (strcmp(de->d_name,"lost+found")==0 || (keep && strcmp(de->d_name,keep)==0)) continue;
+    snprintf(path,sizeof(path),"%s/%s",dir,de->d_name);
+    call_native("rm","-rf",path,NULL);
+  }
+  closedir(d);
+}
+
+static long long free_space(const char* path)
+{
+  struct statfs s;
+  if (statfs(path,&s)) return 0;
+  return (long long)s.f_bavail*s.f_bsize;
+}
+
+static long long used_space(const char* path)
+{
+  struct statfs s;
+  if (statfs(path,&s)) return -1;
+  return (long long)(s.f_blocks-s.f_bfree)*s.f_bsize;
+}
+
+int filesystem_convert_live(int oldtype, int newtype, const char* partition, const char* loopname, const char* mtname, char* secret,
+                            void (*progress)(void* ctx, float fraction), void* ctx)
+{
+  char root[PATH_MAX];
+  char base[PATH_MAX];
+  char mtnamec[PATH_MAX];
+  char key[64];
+  char value[16];
+  char* p;
+  const PartitionDesc* desc = get_partition_desc_by_block(partition);
+  if (!desc || !filesystem_can_convert_live(oldtype,newtype)) return -1;
+  strcpy(mtnamec,mtname);
+  while ((p = strchr(mtnamec,'/'))) *p = '_';
+  sprintf(root,"/%s",mtname);
+  sprintf(base,"/res/.orig_%s",mtnamec);
+  sprintf(key,"fs.%s.type",desc->name);
+  sprintf(value,"%d",newtype);
+  ProgressStep step = { progress, ctx, 0, 0 };
+  if (newtype&TYPE_LOOP) {
+    // the image is built on the partition, next to the old files
+    char extfs[PATH_MAX];
+    char loopdev[PATH_MAX];
+    char tmpmount[PATH_MAX];
+    long long used = used_space(root);
+    // ext2 needs some room for itself in the image
+    if (!desc->loop_size || used<0 || used>desc->loop_size/10*9 || free_space(root)<desc->loop_size) return -1;
+    sprintf(extfs,"%s/.extfs",root);
+    sprintf(tmpmount,"/res/.fmt_%s",strrchr(partition,'/')+1);
+    step.span = 0.3;
+    if (loopdev_create_file(extfs,desc->loop_size,step_progress,&step)) {
+      unlink(extfs);
+      return -1;
+    }
+    int lfd = loopdev_attach(extfs,NULL,0,loopdev,sizeof(loopdev));
+    if (lfd<0) {
+      unlink(extfs);
+      return -1;
+    }
+    step.base = 0.3;
+    step.span = 0.1;
+    int failed = -1;
+    int formatted = format_mkfs(TYPE_EXT2,loopdev,mtname,desc,desc->loop_size,step_progress,&step)==0;
+    call_native("mkdir",tmpmount,NULL);
+    call_native("chmod","700",tmpmount,NULL);
+    if (formatted && call_native("mount","-t","ext2","-o",TYPE_EXT2_DEFAULT_MOUNT,loopdev,tmpmount,NULL)==0) {
+      step.base = 0.4;
+      step.span = 0.6;
+      failed = sysconv_copy(root,tmpmount,".extfs",step_progress,&step);
+      call_native("umount","-f",tmpmount,NULL);
+    }
+    close(lfd);
+    loopdev_detach(loopdev);
+    call_native("rm","-rf",tmpmount,NULL);
+    if (failed) {
+      // the old files are still there
+      unlink(extfs);
+      return -1;
+    }
+    // from here on the new filesystem is the one that counts, removing the
+    // old files only frees up space
+    set_conf(key,value);
+    remove_contents(root,".extfs");
+  } else {
+    // the files are copied out of the image, then the image is deleted
+    long long used = used_space(root);
+    if (used<0 || free_space(base)<used) return -1;
+    step.span = 1.0;
+    int failed = sysconv_copy(root,base,NULL,step_progress,&step);
+    if (failed) {
+      remove_contents(base,".extfs");
+      return -1;
+    }
+    set_conf(key,value);
+  }
+  sync();
+  unmount_filesystem(root);
+  // the superblock stays the same, only the cache knows about the change
+  detect_cache_store(partition,newtype);
+  if (check_and_mount(newtype,partition,loopname,mtname,secret)) return CONVERT_LIVE_UNMOUNTED;
+  if (!(newtype&TYPE_LOOP)) {
+    char extfs[PATH_MAX];
+    sprintf(extfs,"%s/.extfs",root);
+    unlink(extfs);
+  }
+  if (progress) progress(ctx,1.0);
+  return 0;
 }
 
 int filesystem_create(const char* partition, const char* label) {
@@ -894,7 +1388,11 @@ int mount_from_config_or_autodetect(const char* keyname, const char* partition,
     if (res==0) return fstype;
   }
   fstype = filesystem_check(partition);
-  if (!(fstype&TYPE_FSTYPE_MASK)) fstype = filesystem_create(partition,mtname);
+  if (!(fstype&TYPE_FSTYPE_MASK)) {
+    interaction_lock();
+    fstype = filesystem_create(partition,mtname);
+    interaction_unlock();
+  }
   if (fstype&TYPE_FSTYPE_MASK) {
     sprintf(value,"%d",fstype);
     set_conf(keyname,value);
@@ -904,48 +1402,131 @@ int mount_from_config_or_autodetect(const char* keyname, const char* partition,
   return 0;
 }
 
-int unmount_filesystem(const char* partition)
+// parallel mounting
+//
+// Jobs on different block devices are independent, their fsck and mount
+// can run at the same time. Jobs on the same device (or on directories of
+// the same filesystem) are run in their original order.
+
+struct mount_job_state {
+  MountJob* job;
+  char* secret;
+  dev_t device;
+  int depends;     // index of the job we have to wait for, -1 if none
+  int started;
+  int done;
+  pthread_t thread;
+};
+
+static pthread_mutex_t g_jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_jobs_cond = PTHREAD_COND_INITIALIZER;
+
+static dev_t mount_job_device(const char* partition)
 {
-  // TODO: this should be way more intelligent
-  char loopname[40];
-  char blockname[40];
-  int found = 0;
-  if (strcmp(partition,"/system")==0) {
-    strcpy(loopname,"/dev/block/loop4");
-    strcpy(blockname,SYSTEM_BLOCK_NAME);
-    found = 1;
-  } else if (strcmp(partition,"/tmp/sys")==0) {
-    strcpy(loopname,"/dev/block/loop4");
-    strcpy(blockname,SYSTEM_BLOCK_NAME);
-    found = 1;
-  } else if (strcmp(partition,"/cache")==0) {
-    strcpy(loopname,"/dev/block/loop1");
-    strcpy(blockname,CACHE_BLOCK_NAME);
-    found = 1;
-  } else if (strcmp(partition,"/data")==0) {
-    strcpy(loopname,"/dev/block/loop2");
-    strcpy(blockname,DATA_BLOCK_NAME);
-    found = 1;
-#ifdef HAS_DATADATA
-  } else if (strcmp(partition,"/dbdata")==0) {
-    strcpy(loopname,"/dev/block/loop3");
-    strcpy(blockname,DBDATA_BLOCK_NAME);
-    found = 1;
-#endif
-  } else if (strcmp(partition,"/efs")==0) {
-    strcpy(loopname,"/dev/block/loop4");
-    strcpy(blockname,EFS_BLOCK_NAME);
-    found = 1;
+  struct stat s;
+  if (stat(partition,&s)) return 0;
+  return S_ISBLK(s.st_mode) ? s.st_rdev : s.st_dev;
+}
+
+static void* mount_job_thread(void* cookie)
+{
+  struct mount_job_state* state = cookie;
+  MountJob* job = state->job;
+  job->fstype = mount_from_config_or_autodetect(job->keyname,job->partition,job->loopname,job->mtname,state->secret);
+  pthread_mutex_lock(&g_jobs_mutex);
+  state->done = 1;
+  pthread_cond_broadcast(&g_jobs_cond);
+  pthread_mutex_unlock(&g_jobs_mutex);
+  return NULL;
+}
+
+void mount_from_config_parallel(MountJob* jobs, int count, char* secret, int parallel, void (*progress)(int done, int count))
+{
+  struct mount_job_state* states = NULL;
+  int i, j;
+  if (parallel) states = calloc(count,sizeof(*states));
+  if (!states) {
+    for (i=0; i<count; i++) {
+      jobs[i].fstype = mount_from_config_or_autodetect(jobs[i].keyname,jobs[i].partition,jobs[i].loopname,jobs[i].mtname,secret);
+      if (progress) progress(i+1,count);
+    }
+    return;
+  }
+  for (i=0; i<count; i++) {
+    states[i].job = &jobs[i];
+    states[i].secret = secret;
+    states[i].device = mount_job_device(jobs[i].partition);
+    states[i].depends = -1;
+    // unknown devices are treated as being the same
+    for (j=i-1; j>=0; j--) {
+      if (states[j].device==states[i].device) {
+        states[i].depends = j;
+        break;
+      }
+    }
+  }
+  int done = 0;
+  pthread_mutex_lock(&g_jobs_mutex);
+  for (;;) {
+    int running = 0;
+    int newdone = 0;
+    // start every job whose dependency is finished
+    for (i=0; i<count; i++) {
+      if (states[i].started) continue;
+      if (states[i].depends>=0 && !states[states[i].depends].done) continue;
+      states[i].started = 1;
+      if (pthread_create(&states[i].thread,NULL,mount_job_thread,&states[i])) {
+        // couldn't start a thread, do it from here
+        states[i].started = 2;
+        pthread_mutex_unlock(&g_jobs_mutex);
+        mount_job_thread(&states[i]);
+        pthread_mutex_lock(&g_jobs_mutex);
+      }
+    }
+    for (i=0; i<count; i++) {
+      if (states[i].done) newdone++;
+      else if (states[i].started) running++;
+    }
+    if (newdone!=done) {
+      done = newdone;
+      if (progress) {
+        pthread_mutex_unlock(&g_jobs_mutex);
+        progress(done,count);
+        pthread_mutex_lock(&g_jobs_mutex);
+      }
+    }
+    if (done==count) break;
+    if (running) pthread_cond_wait(&g_jobs_cond,&g_jobs_mutex);
+  }
+  pthread_mutex_unlock(&g_jobs_mutex);
+  for (i=0; i<count; i++) {
+    if (states[i].started==1) pthread_join(states[i].thread,NULL);
   }
-  if (found) {
+  free(states);
+}
+
+int unmount_filesystem(const char* partition)
+{
+  const PartitionDesc* desc = get_partition_desc_by_mount_point(partition);
+  if (desc) {
+    char loopname[PATH_MAX];
     char cryptname[PATH_MAX];
-    call_busybox("umount","-f",loopname,NULL); // unmount loop device
-    call_busybox("losetup","-d",loopname,NULL); // disconnect loop file
-    call_busybox("umount","-f",blockname,NULL); // unmount original device
+    char mtnamec[PATH_MAX];
+    char* p;
+    const char* blockname = desc->block;
+    // the loop device isn't fixed, look it up by its file (see check_and_mount)
+    strcpy(mtnamec,partition+1);
+    while ((p = strchr(mtnamec,'/'))) *p = '_';
+    sprintf(cryptname,"/res/.orig_%s/.extfs",mtnamec);
+    if (loopdev_find(cryptname,loopname,sizeof(loopname))==0) {
+      call_native("umount","-f",loopname,NULL); // unmount loop device
+      loopdev_detach(loopname); // autoclear has done this already, unless the kernel is too old
+    }
+    call_native("umount","-f",blockname,NULL); // unmount original device
     sprintf(cryptname,"/dev/mapper/sec%s",strrchr(blockname,'/')+1);
-    call_busybox("umount","-f",cryptname,NULL); // unmount crypt device
-    sprintf(cryptname,"sec%s",strrchr(blockname,'/')+1);
-    call_cryptsetup("cryptsetup","luksClose",cryptname,NULL); // close crypt device
+    call_native("umount","-f",cryptname,NULL); // unmount crypt device
+    close_encrypted_partition(blockname); // close crypt device
+    invalidate_mounted_volumes();
     return 0;
   } else {
     return -1;
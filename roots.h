@@ -110,16 +110,64 @@
 #define BLOCK_DBDATA_LOOP_SIZE 128382976
 #define BLOCK_CACHE_LOOP_SIZE 29726720
 
+// the partitions Steam manages. The table (g_partition_table) is defined by
+// the device, adding a partition only needs a new entry there
+typedef struct {
+  const char* name;             // used as fs.<name>.type in the config, and mounted to /<name>
+  const char* root;             // root name, like "SYSTEM:"
+  const char* mount_point;
+  const char* temp_mount_point; // where it's mounted while being converted, or NULL
+  const char* block;            // block device
+  const char* loop;             // preferred loop device for TYPE_LOOP, like "loop4"
+  long long loop_size;          // size of the loop file created by the formatter, 0 for none
+  const char* fat_options;      // fat.format options
+  int workload;                 // WORKLOAD_*, the formatter chooses the parameters by this
+} PartitionDesc;
+
+#define WORKLOAD_READ_MOSTLY 1        // written once, read a lot (system)
+#define WORKLOAD_SMALL_FILES 2        // databases and app data
+#define WORKLOAD_LARGE_FILES 3        // downloads and caches
+
+extern const PartitionDesc g_partition_table[];
+int get_num_partition_descs();
+// lookups by one of the fields. These use hash maps built at first use
+const PartitionDesc* get_partition_desc_by_root(const char* root);
+const PartitionDesc* get_partition_desc_by_mount_point(const char* mount_point);
+const PartitionDesc* get_partition_desc_by_block(const char* block);
+// accepts both "loop4" and "/dev/block/loop4"
+const PartitionDesc* get_partition_desc_by_loop(const char* loop);
+
 // check if block contains an encrypted partition or not
 int is_encrypted_partition(const char* partition);
 // opens an encrypted block
 int open_encrypted_partition(const char* partition, char* secret);
+void close_encrypted_partition(const char* partition);
 // checks which filesystem is contained inside the block. returns the filsystem code
 int filesystem_check(const char* partition);
+// true if the rfs mounted by check_and_mount as mtname is inconsistent
+// (TYPE_RFS_BAD). The detection cache only knows the type, not these marks
+int filesystem_rfs_bad(int fstype, const char* mtname);
 // fsck's and mounts the filesystem. returns 0 if success
 int check_and_mount(int fstype, const char* partition, const char* loopname, const char* mtname, char* secret);
-// formats a block to the desired filesystem
+// formats a block to the desired filesystem. returns the type, 0 if it failed
 int filesystem_format(int fstype, const char* partition, const char* loopname, const char* mtname, char* secret);
+// same, reporting the progress (0.0-1.0) through progress
+int filesystem_format_progress(int fstype, const char* partition, const char* loopname, const char* mtname, char* secret,
+                               void (*progress)(void* ctx, float fraction), void* ctx);
+// true if the partition can be converted between the types in place: the
+// loop file is built next to the old files, or the files are moved out of it
+int filesystem_can_convert_live(int oldtype, int newtype);
+// converts the mounted partition in place, copying the files directly from
+// the old filesystem into the new one. The new type is saved in the config
+// and the partition is mounted again. Returns 0 on success, -1 if it failed
+// before the new filesystem was complete, leaving the old one as it was.
+// CONVERT_LIVE_UNMOUNTED means the conversion is done and saved, only the
+// mount of the new filesystem failed: the old files are gone by then
+#define CONVERT_LIVE_UNMOUNTED 1
+int filesystem_convert_live(int oldtype, int newtype, const char* partition, const char* loopname, const char* mtname, char* secret,
+                            void (*progress)(void* ctx, float fraction), void* ctx);
+// asks for a new password (twice). secret must be at least 256 bytes
+void filesystem_ask_secret(char* secret);
 // asks the user what to do
 int filesystem_create(const char* partition, const char* label);
 // mounts a filesystem from the config, and falls back in case of failure. returns the filesystem type
@@ -127,6 +175,18 @@ int mount_from_config_or_autodetect(const char* keyname, const char* partition,
 // unmounts a filesystem completely
 int unmount_filesystem(const char* partition);
 
+typedef struct {
+  const char* keyname;
+  const char* partition;
+  const char* loopname;
+  const char* mtname;
+  int fstype;              // result of mount_from_config_or_autodetect
+} MountJob;
+// runs mount_from_config_or_autodetect for all the jobs. Jobs on different
+// devices are run in parallel if parallel is set. progress is called from
+// the calling thread
+void mount_from_config_parallel(MountJob* jobs, int count, char* secret, int parallel, void (*progress)(int done, int count));
+
 // End of Steam stuff
 //////////////////////////////////////////////////////////////
 
@@ -163,6 +223,12 @@ int ensure_root_path_mounted(const char *root_path);
 
 int ensure_root_path_unmounted(const char *root_path);
 
+/* Forces a rescan of the mount table on the next query. Changes are
+ * detected automatically, this is only needed right after a mount change
+ * done by us.
+ */
+void invalidate_mounted_volumes();
+
 const MtdPartition *get_root_mtd_partition(const char *root_path);
 
 /* "root" must be the exact name of the root; no relative path is permitted.
@@ -180,4 +246,7 @@ typedef struct {
     const char *filesystem_options;
 } RootInfo;
 
+// the root of a root path like "SYSTEM:" or "SDCARD:/foo", NULL if unknown
+const RootInfo* get_root_info_for_path(const char* root_path);
+
 #endif  // RECOVERY_ROOTS_H_
@@ -44,7 +44,11 @@
 #include "extendedcommands.h"
 #include "commands.h"
 #include "steamext.h"
+#include "native.h"
+#include "trace.h"
 #include "nandroid.h"
+#include "iotune.h"
+#include "tweaks.h"
 
 extern char **environ;
 
@@ -58,7 +62,7 @@ int apply_ln(char* name) {
 int apply_rm(char* name) {
   char tmp[128];
   sprintf(tmp,"/system/bin/%s",name);
-  return call_busybox("rm",tmp,NULL);
+  return call_native("rm",tmp,NULL);
 }
 
 void apply_root_to_device(int mode) {
@@ -66,18 +70,18 @@ void apply_root_to_device(int mode) {
   ui_print(APPROOT_COPYING);
 
   ui_print(APPROOT_COPYING_SU);
-  call_busybox("rm","/system/bin/su",NULL);
-  call_busybox("rm","/system/xbin/su",NULL);
-  call_busybox("cp","/res/misc/su","/system/xbin/su",NULL);
-  call_busybox("chown","0.0","/system/xbin/su",NULL);
-  call_busybox("chmod","4755","/system/xbin/su",NULL);
+  call_native("rm","/system/bin/su",NULL);
+  call_native("rm","/system/xbin/su",NULL);
+  call_native("cp","/res/misc/su","/system/xbin/su",NULL);
+  call_native("chown","0.0","/system/xbin/su",NULL);
+  call_native("chmod","4755","/system/xbin/su",NULL);
 
   ui_print(APPROOT_COPYING_APK);
-  call_busybox("rm","/system/app/Superuser.apk",NULL);
-  call_busybox("rm","/data/app/Superuser.apk",NULL);
-  call_busybox("cp","/res/misc/Superuser.apk","/system/app/Superuser.apk",NULL);
-  call_busybox("chown","0.0","/system/app/Superuser.apk",NULL);
-  call_busybox("chmod","644","/system/app/Superuser.apk",NULL);
+  call_native("rm","/system/app/Superuser.apk",NULL);
+  call_native("rm","/data/app/Superuser.apk",NULL);
+  call_native("cp","/res/misc/Superuser.apk","/system/app/Superuser.apk",NULL);
+  call_native("chown","0.0","/system/app/Superuser.apk",NULL);
+  call_native("chmod","644","/system/app/Superuser.apk",NULL);
 
   ui_print(APPROOT_CRSYMLINK);
   char** command = steam_command_list;
@@ -120,19 +124,36 @@ void apply_root_to_device(int mode) {
   }
 
   ui_print(APPROOT_COPYING_BB);
-  call_busybox("rm","/system/xbin/busybox",NULL);
-  call_busybox("rm","/system/bin/busybox",NULL);
+  call_native("rm","/system/xbin/busybox",NULL);
+  call_native("rm","/system/bin/busybox",NULL);
 #ifdef STEAM_HAS_BUSYBOX
-  call_busybox("cp","/sbin/steam","/system/xbin/busybox",NULL);
+  call_native("cp","/sbin/steam","/system/xbin/busybox",NULL);
 #else
-  call_busybox("cp","/sbin/busybox","/system/xbin/busybox",NULL);
+  call_native("cp","/sbin/busybox","/system/xbin/busybox",NULL);
 #endif
-  call_busybox("chmod","755","/system/xbin/busybox",NULL);
+  call_native("chmod","755","/system/xbin/busybox",NULL);
 
 
   ui_print(APPROOT_DONE);
 }
 
+static void io_benchmark() {
+  IotuneResult results[IOTUNE_MAX_DEVICES];
+  int i;
+  ensure_root_path_mounted("CACHE:");
+  ui_print(IOTUNE_BENCH_START);
+  int count = iotune_benchmark("/cache",results,IOTUNE_MAX_DEVICES);
+  for (i=0; i<count; i++) {
+    int p = results[i].profile;
+    ui_print(IOTUNE_BENCH_RESULT,results[i].device,iotune_profile_name(p),results[i].latency_us[p],results[i].throughput_kb[p]);
+  }
+  if (count) {
+    set_conf("tweaks.iosched.profile","auto");
+  } else {
+    ui_print(IOTUNE_BENCH_NONE);
+  }
+}
+
 void tweak_menu() {
   int chosen_item = 1;
   for (;;)
@@ -148,6 +169,8 @@ void tweak_menu() {
     int kernelsched = 0;
     int misc = 0;
     int sysrw = 0;
+    int bootprofile = 0;
+    int ioprofile = 0;
     if (get_conf("adb.boot",value) && sscanf(value,"%d",&adbboot)==1) {} else adbboot = 0;
     if (get_conf("adb.root",value) && sscanf(value,"%d",&adbroot)==1) {} else adbroot = 0;
     if (strcmp(get_conf_def("preinit.recovery.graphics",value,"0"),"1")==0) bootlog = 1;
@@ -158,6 +181,12 @@ void tweak_menu() {
     if (get_conf("tweaks.kernelsched",value) && sscanf(value,"%d",&kernelsched)==1) {} else kernelsched = 0;
     if (get_conf("tweaks.misc",value) && sscanf(value,"%d",&misc)==1) {} else misc = 0;
     if (get_conf("fs.system.ro",value) && sscanf(value,"%d",&sysrw)==1) {} else sysrw = 1;
+    if (get_conf("debug.bootprofile",value) && sscanf(value,"%d",&bootprofile)==1) {} else bootprofile = 0;
+    get_conf_def("tweaks.iosched.profile",value,"custom");
+    for (ioprofile=IOTUNE_NUM_PROFILES; ioprofile>0; ioprofile--) {
+      if (strcmp(value,iotune_profile_name(ioprofile-1))==0) break;
+    }
+    if (strcmp(value,"auto")==0) ioprofile = IOTUNE_NUM_PROFILES+1;
     ui_start_menu_ext();
     ui_add_menu(0,0,MENU_TYPE_GLOBAL_HEADER,MENU_TWEAKS_HEADER,NULL);
     
@@ -188,6 +217,16 @@ void tweak_menu() {
     ui_add_menu(kernelsched*18,18,MENU_TYPE_CHECKBOX,MENU_TWEAKS_KERNELSCHED,MENU_TWEAKS_KERNELSCHED_HELP);
     ui_add_menu(misc*19,19,MENU_TYPE_CHECKBOX,MENU_TWEAKS_MISC,MENU_TWEAKS_MISC_HELP);
     ui_add_menu(sysrw*20,20,MENU_TYPE_CHECKBOX,MENU_TWEAKS_SYS_RW,MENU_TWEAKS_SYS_RW_HELP);
+    ui_add_menu(bootprofile*28,28,MENU_TYPE_CHECKBOX,MENU_TWEAKS_BOOTPROFILE,MENU_TWEAKS_BOOTPROFILE_HELP);
+    ui_add_menu(0,27,MENU_TYPE_ELEMENT,MENU_TWEAKS_SHOW,MENU_TWEAKS_SHOW_HELP);
+
+    ui_add_menu(0,0,MENU_TYPE_GROUP_HEADER,MENU_TWEAKS_IOPROFILE,NULL);
+    ui_add_menu(ioprofile+21,21,MENU_TYPE_RADIOBOX,MENU_TWEAKS_IOPROFILE_CUSTOM,MENU_TWEAKS_IOPROFILE_CUSTOM_HELP);
+    ui_add_menu(ioprofile+21,22,MENU_TYPE_RADIOBOX,MENU_TWEAKS_IOPROFILE_LATENCY,MENU_TWEAKS_IOPROFILE_LATENCY_HELP);
+    ui_add_menu(ioprofile+21,23,MENU_TYPE_RADIOBOX,MENU_TWEAKS_IOPROFILE_THROUGHPUT,MENU_TWEAKS_IOPROFILE_THROUGHPUT_HELP);
+    ui_add_menu(ioprofile+21,24,MENU_TYPE_RADIOBOX,MENU_TWEAKS_IOPROFILE_BATTERY,MENU_TWEAKS_IOPROFILE_BATTERY_HELP);
+    ui_add_menu(ioprofile+21,25,MENU_TYPE_RADIOBOX,MENU_TWEAKS_IOPROFILE_AUTO,MENU_TWEAKS_IOPROFILE_AUTO_HELP);
+    ui_add_menu(0,26,MENU_TYPE_ELEMENT,MENU_TWEAKS_IOPROFILE_BENCH,MENU_TWEAKS_IOPROFILE_BENCH_HELP);
     chosen_item = get_menu_selection_ext(chosen_item,&me);
     if (chosen_item == GO_BACK) {
       ui_end_menu();
@@ -224,6 +263,16 @@ void tweak_menu() {
     if (me.group_id==18) { kernelsched = kernelsched?0:1; sprintf(value,"%d",kernelsched); set_conf("tweaks.kernelsched",value); }
     if (me.group_id==19) { misc = misc?0:1; sprintf(value,"%d",misc); set_conf("tweaks.misc",value); }
     if (me.group_id==20) { sysrw = sysrw?0:1; sprintf(value,"%d",sysrw); set_conf("fs.system.ro",value); }
+    if (me.group_id==28) { bootprofile = bootprofile?0:1; sprintf(value,"%d",bootprofile); set_conf("debug.bootprofile",value); }
+    if ((me.group_id>=21) && (me.group_id<=25)) {
+      if (me.group_id==25) {
+        set_conf("tweaks.iosched.profile","auto");
+      } else {
+        set_conf("tweaks.iosched.profile",iotune_profile_name(me.group_id-22));
+      }
+    }
+    if (me.group_id==26) io_benchmark();
+    if (me.group_id==27) tweaks_show(ui_print);
     ui_end_menu();
   }
 }
@@ -580,11 +629,11 @@ void file_manager() {
         show_partition_menu();
       } else if (me.id==3) {
         ui_end_menu();
-        call_busybox("mkdir","/mnt",NULL);
-        call_busybox("mkdir","/mnt/sdcard",NULL);
+        call_native("mkdir","/mnt",NULL);
+        call_native("mkdir","/mnt/sdcard",NULL);
         ensure_root_path_mounted("SDCARD:");
-        call_busybox("mkdir","/mnt/sdcard/steam",NULL);
-        call_busybox("mkdir","/mnt/sdcard/steam/logs",NULL);
+        call_native("mkdir","/mnt/sdcard/steam",NULL);
+        call_native("mkdir","/mnt/sdcard/steam/logs",NULL);
         char backup_path[PATH_MAX];
         time_t t = time(NULL);
         struct tm *tmp = localtime(&t); 
@@ -595,7 +644,7 @@ void file_manager() {
         } else {
           strftime(backup_path, PATH_MAX, "/mnt/sdcard/steam/logs/%F.%H.%M.%S", tmp);
         }
-        call_busybox("mkdir",backup_path,NULL);
+        call_native("mkdir",backup_path,NULL);
         char text[PATH_MAX];
         sprintf(text,"cp /tmp/*.log %s",backup_path);
         sh(text);
@@ -653,7 +702,7 @@ void file_manager() {
             }
           } else {
             char* fheaders[] = {FILEMANAGER_FILECMD_HEADER,NULL};
-            char* flist[] = {FILEMANAGER_FILECMD_CLIPADD,FILEMANAGER_FILECMD_CAT,FILEMANAGER_FILECMD_HEAD,FILEMANAGER_FILECMD_RM,NULL};
+            char* flist[] = {FILEMANAGER_FILECMD_CLIPADD,FILEMANAGER_FILECMD_CAT,FILEMANAGER_FILECMD_HEAD,FILEMANAGER_FILECMD_RM,FILEMANAGER_FILECMD_TRACE,NULL};
             int sel2 = get_menu_selection(fheaders,flist,0);
             if (sel2!=GO_BACK) {
               if (sel2==0) {
@@ -662,6 +711,8 @@ void file_manager() {
                 sprintf(npath,"rm %s",xpath);
                 ui_print("%s\n",npath);
                 __system(npath);
+              } else if (sel2==4) {
+                show_trace(xpath,10,ui_print);
               } else if (sel2==1 || sel2==2) {
                 FILE* f = fopen(npath,"r+");
                 if (f) {
@@ -0,0 +1,628 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Streaming staging of /system for filesystem conversion
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#include "sysconv.h"
+
+#define CHUNK 65536
+#define PROGRESS_STEP (1024*1024)
+
+#define ENTRY_END 0
+#define ENTRY_DIR 1
+#define ENTRY_FILE 2
+#define ENTRY_SYMLINK 3
+#define ENTRY_HARDLINK 4
+#define ENTRY_NODE 5
+
+// followed by the path relative to the root, then size bytes of data: the
+// contents of a file, the target of a symlink or the path of the first link
+typedef struct {
+  uint16_t type;
+  uint16_t pathlen;
+  uint32_t mode;
+  uint32_t uid;
+  uint32_t gid;
+  uint32_t atime;
+  uint32_t mtime;
+  uint32_t rdev;
+  uint32_t reserved;
+  uint64_t size;
+} EntryHeader;
+
+typedef struct Link {
+  ino_t ino;
+  char* path;
+  struct Link* next;
+} Link;
+
+typedef struct {
+  SysconvStage* st;
+  z_stream z;
+  int fd;
+  int spilled;
+  int rootlen;
+  dev_t dev;
+  const char* skip;
+  Link* links;
+  long long total;
+  long long next_progress;
+  void (*progress)(void* ctx, float fraction);
+  void* ctx;
+  unsigned char buf[CHUNK];
+  unsigned char out[CHUNK];
+} Writer;
+
+typedef struct {
+  SysconvStage* st;
+  z_stream z;
+  int fd;
+  int spilled;
+  int eof;
+  unsigned char in[CHUNK];
+  unsigned char out[CHUNK];
+} Reader;
+
+long long sysconv_ram_budget(long long reserve)
+{
+  char line[128];
+  long long kb, avail = 0;
+  FILE* f = fopen("/proc/meminfo","r");
+  if (!f) return 0;
+  while (fgets(line,sizeof(line),f)) {
+    // the page cache of the old filesystem can be dropped, ramfs pages can't,
+    // so Cached doesn't count
+    if (sscanf(line,"MemFree: %lld kB",&kb)==1) avail += kb*1024;
+    if (sscanf(line,"Buffers: %lld kB",&kb)==1) avail += kb*1024;
+  }
+  fclose(f);
+  avail -= reserve;
+  return avail>0 ? avail : 0;
+}
+
+//////////////////////////////
+// writing
+
+static int sink(Writer* w, const unsigned char* data, size_t len)
+{
+  SysconvStage* st = w->st;
+  while (len) {
+    size_t n = len;
+    if (!w->spilled) {
+      long long room = st->ram_budget-st->ram_bytes;
+      if (room<=0) {
+        // memory is full, the rest of the stream goes to the spill file
+        if (w->fd>=0) close(w->fd);
+        w->fd = open(st->spill_file,O_WRONLY|O_CREAT|O_TRUNC,0600);
+        if (w->fd<0) return -1;
+        w->spilled = 1;
+        continue;
+      }
+      if ((long long)n>room) n = room;
+    }
+    ssize_t r = write(w->fd,data,n);
+    if (r<0 && errno==EINTR) continue;
+    if (r<0 && !w->spilled && (errno==ENOSPC || errno==ENOMEM)) {
+      // the estimate was too optimistic
+      st->ram_budget = st->ram_bytes;
+      continue;
+    }
+    if (r<=0) {
+      if (r==0) errno = ENOSPC;
+      return -1;
+    }
+    if (w->spilled) st->spill_bytes += r; else st->ram_bytes += r;
+    data += r;
+    len -= r;
+  }
+  return 0;
+}
+
+static int put(Writer* w, const void* data, size_t len, int flush)
+{
+  w->z.next_in = (Bytef*)data;
+  w->z.avail_in = len;
+  do {
+    w->z.next_out = w->out;
+    w->z.avail_out = CHUNK;
+    if (deflate(&w->z,flush)==Z_STREAM_ERROR) {
+      errno = EIO;
+      return -1;
+    }
+    if (sink(w,w->out,CHUNK-w->z.avail_out)) return -1;
+  } while (w->z.avail_out==0);
+  return 0;
+}
+
+static void report(Writer* w)
+{
+  if (!w->progress || w->st->data_bytes<w->next_progress) return;
+  w->next_progress = w->st->data_bytes+PROGRESS_STEP;
+  float f = w->total ? (float)w->st->data_bytes/w->total : 0;
+  w->progress(w->ctx,f<1.0 ? f : 1.0);
+}
+
+static int put_header(Writer* w, int type, const char* path, const struct stat* s, uint64_t size)
+{
+  EntryHeader h;
+  const char* rel = path+w->rootlen;
+  if (*rel=='/') rel++;
+  memset(&h,0,sizeof(h));
+  h.type = type;
+  h.pathlen = strlen(rel);
+  h.mode = s->st_mode;
+  h.uid = s->st_uid;
+  h.gid = s->st_gid;
+  h.atime = s->st_atime;
+  h.mtime = s->st_mtime;
+  h.rdev = s->st_rdev;
+  h.size = size;
+  w->st->entries++;
+  if (put(w,&h,sizeof(h),Z_NO_FLUSH)) return -1;
+  return put(w,rel,h.pathlen,Z_NO_FLUSH);
+}
+
+static int put_file(Writer* w, const char* path, const struct stat* s)
+{
+  uint64_t left = s->st_size;
+  int fd = open(path,O_RDONLY);
+  if (put_header(w,ENTRY_FILE,path,s,left)) {
+    if (fd>=0) close(fd);
+    return -1;
+  }
+  if (fd<0) w->st->errors++;
+  while (left) {
+    size_t n = left<CHUNK ? (size_t)left : CHUNK;
+    ssize_t r = fd>=0 ? read(fd,w->buf,n) : 0;
+    if (r<0 && errno==EINTR) continue;
+    if (r<=0) {
+      // the size is in the header already, keep the stream in sync. Broken
+      // files are expected on a bad rfs
+      if (fd>=0) {
+        w->st->errors++;
+        close(fd);
+        fd = -1;
+      }
+      memset(w->buf,0,n);
+      r = n;
+    }
+    if (put(w,w->buf,r,Z_NO_FLUSH)) {
+      if (fd>=0) close(fd);
+      return -1;
+    }
+    left -= r;
+    w->st->data_bytes += r;
+    report(w);
+  }
+  if (fd>=0) close(fd);
+  return 0;
+}
+
+// returns the first path of the inode, or NULL if this is the first
+static const char* find_link(Writer* w, const char* path, const struct stat* s)
+{
+  Link* l;
+  for (l = w->links; l; l = l->next) {
+    if (l->ino==s->st_ino) return l->path;
+  }
+  l = malloc(sizeof(Link));
+  if (!l) return NULL;
+  l->ino = s->st_ino;
+  l->path = strdup(path+w->rootlen+1);
+  l->next = w->links;
+  w->links = l;
+  return NULL;
+}
+
+static int put_entry(Writer* w, char* path, int len);
+
+static int put_dir(Writer* w, char* path, int len)
+{
+  DIR* dir = opendir(path);
+  struct dirent* de;
+  int ret = 0;
+  if (!dir) {
+    w->st->errors++;
+    return 0;
+  }
+  while (!ret && (de = readdir(dir))) {
+    if (strcmp(de->d_name,".")==0 || strcmp(de->d_name,"..")==0) continue;
+    int l = snprintf(path+len,PATH_MAX-len,"/%s",de->d_name);
+    if (l>=PATH_MAX-len) {
+      w->st->errors++;
+      continue;
+    }
+    if (w->skip && strcmp(path+w->rootlen+1,w->skip)==0) continue;
+    ret = put_entry(w,path,len+l);
+  }
+  closedir(dir);
+  path[len] = '\0';
+  return ret;
+}
+
+static int put_entry(Writer* w, char* path, int len)
+{
+  struct stat s;
+  char* target = (char*)w->buf;
+  if (lstat(path,&s)) {
+    w->st->errors++;
+    return 0;
+  }
+  if (S_ISDIR(s.st_mode)) {
+    if (put_header(w,ENTRY_DIR,path,&s,0)) return -1;
+    // only the directory of a mount point is kept
+    if (s.st_dev!=w->dev) return 0;
+    return put_dir(w,path,len);
+  }
+  if (S_ISLNK(s.st_mode)) {
+    int l = readlink(path,target,PATH_MAX-1);
+    if (l<0) {
+      w->st->errors++;
+      return 0;
+    }
+    if (put_header(w,ENTRY_SYMLINK,path,&s,l)) return -1;
+    return put(w,target,l,Z_NO_FLUSH);
+  }
+  if (S_ISREG(s.st_mode)) {
+    const char* first = s.st_nlink>1 ? find_link(w,path,&s) : NULL;
+    if (first) {
+      if (put_header(w,ENTRY_HARDLINK,path,&s,strlen(first))) return -1;
+      return put(w,first,strlen(first),Z_NO_FLUSH);
+    }
+    return put_file(w,path,&s);
+  }
+  // device nodes, fifos and sockets
+  return put_header(w,ENTRY_NODE,path,&s,0);
+}
+
+// writes the stream to fd, and closes it
+static int stage(SysconvStage* st, const char* root, int fd, int level, const char* skip,
+                 void (*progress)(void* ctx, float fraction), void* ctx)
+{
+  char path[PATH_MAX];
+  struct stat s;
+  struct statfs fs;
+  int ret = -1;
+  Writer* w = lstat(root,&s) ? NULL : calloc(1,sizeof(Writer));
+  if (!w) {
+    if (fd>=0) close(fd);
+    return -1;
+  }
+  st->ram_bytes = st->spill_bytes = st->data_bytes = 0;
+  st->entries = st->errors = 0;
+  w->st = st;
+  w->dev = s.st_dev;
+  w->skip = skip;
+  w->progress = progress;
+  w->ctx = ctx;
+  // used blocks are close enough for the progress bar
+  if (statfs(root,&fs)==0) w->total = (long long)(fs.f_blocks-fs.f_bfree)*fs.f_bsize;
+  w->fd = fd;
+  if (w->fd<0) st->ram_budget = 0;
+  if (deflateInit(&w->z,level)!=Z_OK) {
+    if (w->fd>=0) close(w->fd);
+    free(w);
+    return -1;
+  }
+  snprintf(path,sizeof(path),"%s",root);
+  w->rootlen = strlen(path);
+  if (w->rootlen && path[w->rootlen-1]=='/') path[--w->rootlen] = '\0';
+  if (put_dir(w,path,w->rootlen)==0) {
+    EntryHeader end;
+    memset(&end,0,sizeof(end));
+    end.type = ENTRY_END;
+    if (put(w,&end,sizeof(end),Z_NO_FLUSH)==0 && put(w,NULL,0,Z_FINISH)==0) ret = 0;
+  }
+  int err = errno;
+  deflateEnd(&w->z);
+  if (w->spilled && fsync(w->fd) && ret==0) {
+    err = errno;
+    ret = -1;
+  }
+  if (w->fd>=0 && close(w->fd) && ret==0) {
+    err = errno;
+    ret = -1;
+  }
+  while (w->links) {
+    Link* l = w->links;
+    w->links = l->next;
+    free(l->path);
+    free(l);
+  }
+  if (progress) progress(ctx,1.0);
+  free(w);
+  errno = err;
+  return ret;
+}
+
+int sysconv_stage(SysconvStage* st, const char* root, void (*progress)(void* ctx, float fraction), void* ctx)
+{
+  int fd = open(st->ram_file,O_WRONLY|O_CREAT|O_TRUNC,0600);
+  // speed matters more than size, most of /system is compressed already
+  return stage(st,root,fd,1,NULL,progress,ctx);
+}
+
+//////////////////////////////
+// reading
+
+static int get(Reader* r, void* data, size_t len)
+{
+  SysconvStage* st = r->st;
+  r->z.next_out = data;
+  r->z.avail_out = len;
+  while (r->z.avail_out) {
+    if (r->z.avail_in==0 && !r->eof) {
+      ssize_t n = r->fd>=0 ? read(r->fd,r->in,CHUNK) : 0;
+      if (n<0 && errno==EINTR) continue;
+      if (n<0) return -1;
+      if (n==0) {
+        if (r->spilled || !st->spill_bytes) {
+          r->eof = 1;
+        } else {
+          // the stream continues in the spill file
+          if (r->fd>=0) close(r->fd);
+          r->fd = open(st->spill_file,O_RDONLY);
+          if (r->fd<0) return -1;
+          r->spilled = 1;
+        }
+        continue;
+      }
+      r->z.next_in = r->in;
+      r->z.avail_in = n;
+    }
+    int ret = inflate(&r->z,Z_NO_FLUSH);
+    if (ret==Z_STREAM_END) return r->z.avail_out ? -1 : 0;
+    // no progress without more input
+    if (ret==Z_BUF_ERROR && !r->eof) continue;
+    if (ret!=Z_OK) return -1;
+  }
+  return 0;
+}
+
+typedef struct DirTimes {
+  char* path;
+  struct timeval times[2];
+  struct DirTimes* next;
+} DirTimes;
+
+static void set_times(struct timeval* times, const EntryHeader* h)
+{
+  times[0].tv_sec = h->atime;
+  times[0].tv_usec = 0;
+  times[1].tv_sec = h->mtime;
+  times[1].tv_usec = 0;
+}
+
+// chown and chmod fail on rfs, that's not an error
+static void set_owner(const char* path, const EntryHeader* h)
+{
+  chown(path,h->uid,h->gid);
+  // after chown, which clears the suid bits
+  chmod(path,h->mode&07777);
+}
+
+// reads the stream from fd, and closes it
+static int restore(SysconvStage* st, const char* root, int fd, void (*progress)(void* ctx, float fraction), void* ctx)
+{
+  char path[PATH_MAX];
+  char target[PATH_MAX];
+  EntryHeader h;
+  DirTimes* dirs = NULL;
+  long long done = 0, next_progress = 0;
+  int failed = 0;
+  Reader* r = calloc(1,sizeof(Reader));
+  if (!r) {
+    if (fd>=0) close(fd);
+    return -1;
+  }
+  r->st = st;
+  r->fd = fd;
+  if (inflateInit(&r->z)!=Z_OK) {
+    if (r->fd>=0) close(r->fd);
+    free(r);
+    return -1;
+  }
+  int rootlen = snprintf(path,sizeof(path),"%s/",root);
+  while (failed>=0) {
+    if (get(r,&h,sizeof(h))) {
+      failed = -1;
+      break;
+    }
+    if (h.type==ENTRY_END) break;
+    if (rootlen+h.pathlen>=PATH_MAX || get(r,path+rootlen,h.pathlen)) {
+      failed = -1;
+      break;
+    }
+    path[rootlen+h.pathlen] = '\0';
+    struct timeval times[2];
+    set_times(times,&h);
+    if (h.type==ENTRY_DIR) {
+      // lost+found is there already
+      if (mkdir(path,0700) && errno!=EEXIST) {
+        failed++;
+        continue;
+      }
+      set_owner(path,&h);
+      // the times are set at the end, creating the contents changes them
+      DirTimes* d = malloc(sizeof(DirTimes));
+      if (d && (d->path = strdup(path))) {
+        memcpy(d->times,times,sizeof(times));
+        d->next = dirs;
+        dirs = d;
+      } else {
+        free(d);
+      }
+    } else if (h.type==ENTRY_FILE) {
+      uint64_t left = h.size;
+      unlink(path);
+      int fd = open(path,O_WRONLY|O_CREAT|O_TRUNC,0600);
+      if (fd<0) failed++;
+      while (left && failed>=0) {
+        size_t n = left<CHUNK ? (size_t)left : CHUNK;
+        unsigned char* buf = r->out;
+        // the data has to be read even if the file can't be written
+        if (get(r,buf,n)) {
+          failed = -1;
+          break;
+        }
+        if (fd>=0) {
+          size_t off = 0;
+          while (off<n) {
+            ssize_t w = write(fd,buf+off,n-off);
+            if (w<0 && errno==EINTR) continue;
+            if (w<=0) break;
+            off += w;
+          }
+          if (off<n) {
+            failed++;
+            close(fd);
+            fd = -1;
+          }
+        }
+        left -= n;
+        done += n;
+        if (progress && done>=next_progress) {
+          next_progress = done+PROGRESS_STEP;
+          float f = st->data_bytes ? (float)done/st->data_bytes : 0;
+          progress(ctx,f<1.0 ? f : 1.0);
+        }
+      }
+      if (fd>=0) {
+        fchown(fd,h.uid,h.gid);
+        fchmod(fd,h.mode&07777);
+        if (close(fd)) failed++;
+        utimes(path,times);
+      }
+    } else if (h.type==ENTRY_SYMLINK || h.type==ENTRY_HARDLINK) {
+      if (h.size>=sizeof(target) || get(r,target,h.size)) {
+        failed = -1;
+        break;
+      }
+      target[h.size] = '\0';
+      unlink(path);
+      if (h.type==ENTRY_SYMLINK) {
+        if (symlink(target,path)) failed++; else lchown(path,h.uid,h.gid);
+      } else {
+        char first[PATH_MAX];
+        snprintf(first,sizeof(first),"%s/%s",root,target);
+        if (link(first,path)) failed++;
+      }
+    } else if (h.type==ENTRY_NODE) {
+      unlink(path);
+      if (mknod(path,h.mode,h.rdev)) {
+        failed++;
+      } else {
+        set_owner(path,&h);
+        utimes(path,times);
+      }
+    } else {
+      failed = -1;
+    }
+  }
+  // children first, the list is in reverse order
+  while (dirs) {
+    DirTimes* d = dirs;
+    dirs = d->next;
+    utimes(d->path,d->times);
+    free(d->path);
+    free(d);
+  }
+  inflateEnd(&r->z);
+  if (r->fd>=0) close(r->fd);
+  free(r);
+  if (progress) progress(ctx,1.0);
+  return failed;
+}
+
+int sysconv_restore(SysconvStage* st, const char* root, void (*progress)(void* ctx, float fraction), void* ctx)
+{
+  return restore(st,root,open(st->ram_file,O_RDONLY),progress,ctx);
+}
+
+//////////////////////////////
+// copying
+
+typedef struct {
+  SysconvStage st;
+  const char* root;
+  const char* skip;
+  int fd;
+  int ret;
+  void (*progress)(void* ctx, float fraction);
+  void* ctx;
+} CopyJob;
+
+static void* copy_thread(void* arg)
+{
+  CopyJob* job = arg;
+  // nothing to gain by compressing a pipe
+  job->ret = stage(&job->st,job->root,job->fd,Z_NO_COMPRESSION,job->skip,job->progress,job->ctx);
+  return NULL;
+}
+
+int sysconv_copy(const char* from, const char* to, const char* skip, void (*progress)(void* ctx, float fraction), void* ctx)
+{
+  int fds[2];
+  pthread_t thread;
+  CopyJob job;
+  memset(&job,0,sizeof(job));
+  if (pipe(fds)) return -1;
+  job.st.ram_budget = LLONG_MAX;
+  job.root = from;
+  job.skip = skip;
+  job.fd = fds[1];
+  job.progress = progress;
+  job.ctx = ctx;
+  int rfd = dup(fds[0]);
+  if (pthread_create(&thread,NULL,copy_thread,&job)) {
+    close(fds[0]);
+    close(fds[1]);
+    if (rfd>=0) close(rfd);
+    return -1;
+  }
+  // the tree is read on the thread while it's written here
+  int failed = restore(&job.st,to,fds[0],NULL,NULL);
+  if (rfd>=0) {
+    // if the restore gave up, the writer still has to be able to finish
+    char buf[4096];
+    while (read(rfd,buf,sizeof(buf))>0);
+    close(rfd);
+  }
+  pthread_join(thread,NULL);
+  if (job.ret || failed<0) return -1;
+  return failed+job.st.errors;
+}
+
+void sysconv_cleanup(SysconvStage* st)
+{
+  unlink(st->ram_file);
+  if (st->spill_bytes) unlink(st->spill_file);
+}
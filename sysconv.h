@@ -0,0 +1,38 @@
+#ifndef __STEAM_SYSCONV_H
+#define __STEAM_SYSCONV_H
+
+#include <limits.h>
+
+// Staging of a directory tree for filesystem conversion. The tree is packed
+// into one compressed stream with all metadata and hardlinks, which is kept
+// in RAM while it fits and spilled to a file (on the sdcard) after that
+
+typedef struct {
+  char ram_file[PATH_MAX];     // should be on a RAM backed filesystem
+  char spill_file[PATH_MAX];   // opened only if the RAM budget runs out
+  long long ram_budget;
+  // filled by sysconv_stage
+  long long ram_bytes;         // compressed bytes in ram_file
+  long long spill_bytes;       // compressed bytes in spill_file
+  long long data_bytes;        // uncompressed file data
+  int entries;
+  int errors;                  // files that couldn't be read completely
+} SysconvStage;
+
+// memory that can be used for staging, keeping reserve bytes free
+long long sysconv_ram_budget(long long reserve);
+// packs everything under root (not crossing mount points). progress may be
+// NULL. Returns 0 if the stream is complete, -1 with errno set if it couldn't
+// be written (ENOSPC if the spill file ran out of space)
+int sysconv_stage(SysconvStage* st, const char* root, void (*progress)(void* ctx, float fraction), void* ctx);
+// unpacks the stream under root. Returns the number of entries that
+// couldn't be restored, or -1 if the stream is corrupt
+int sysconv_restore(SysconvStage* st, const char* root, void (*progress)(void* ctx, float fraction), void* ctx);
+// copies the tree under from to to, reading and writing at the same time.
+// skip is a path relative to from that's left out (may be NULL). Returns the
+// number of entries that couldn't be copied, -1 if it failed completely
+int sysconv_copy(const char* from, const char* to, const char* skip, void (*progress)(void* ctx, float fraction), void* ctx);
+// deletes the staged files
+void sysconv_cleanup(SysconvStage* st);
+
+#endif
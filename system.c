@@ -18,36 +18,28 @@
 
 #include <signal.h>
 #include <sys/wait.h>
+#include <pthread.h>
 
 #include "system.h"
 
 
 // This was pulled from bionic: The default system command always looks
-// for shell in /system/bin/sh. This is bad.
-
-#ifdef STEAM_HAS_BUSYBOX
-// if busybox is compiled in, use the base app, as that's probably avialable
-#define _PATH_BSHELL "/sbin/steam"
-#else
-// else use a busybox in /sbin. (having busybox there usually has a higher chance than having sh there)
-#define _PATH_BSHELL "/sbin/busybox"
-#endif
+// for shell in /system/bin/sh. This is bad. The shell used instead is
+// _PATH_BSHELL from system.h
 
 extern char **environ;
-int
-__system(const char *command)
+
+static int
+run_argv(char * const argv[])
 {
   pid_t pid;
     sig_t intsave, quitsave;
     sigset_t mask, omask;
     int pstat;
-    char *argp[] = {"sh", "-c", NULL, NULL};
 
-    if (!command)        /* just checking... */
+    if (!argv || !argv[0])        /* just checking... */
         return(1);
 
-    argp[2] = (char *)command;
-
     sigemptyset(&mask);
     sigaddset(&mask, SIGCHLD);
     sigprocmask(SIG_BLOCK, &mask, &omask);
@@ -57,7 +49,7 @@ __system(const char *command)
         return(-1);
     case 0:                /* child */
         sigprocmask(SIG_SETMASK, &omask, NULL);
-        execve(_PATH_BSHELL, argp, environ);
+        execve(_PATH_BSHELL, argv, environ);
     _exit(127);
   }
 
@@ -70,132 +62,331 @@ __system(const char *command)
     return (pid == -1 ? -1 : (WIFEXITED(pstat) ? WEXITSTATUS(pstat) : pstat));
 }
 
+static void trace_argv(int type, char * const argv[], unsigned long long start, int status, int outbytes);
+static off_t trace_outsize();
+
+// runs the shell binary with the given argument list. As the binary is a
+// multi-call binary, argv[0] selects the applet to run
+int
+__system_argv(char * const argv[])
+{
+    unsigned long long start;
+    off_t outsize;
+    int ret;
+
+    if (!system_trace_enabled())
+        return run_argv(argv);
+
+    start = system_trace_now();
+    outsize = trace_outsize();
+    ret = run_argv(argv);
+    trace_argv(SYSTEM_TRACE_SYSTEM, argv, start, ret,
+        outsize<0 ? -1 : (int)(trace_outsize()-outsize));
+    return ret;
+}
+
+int
+__system(const char *command)
+{
+    char *argp[] = {"sh", "-c", NULL, NULL};
+
+    if (!command)        /* just checking... */
+        return(1);
+
+    argp[2] = (char *)command;
+    return __system_argv(argp);
+}
+
+//////////////////////////////
+// command tracing
+//
+// When enabled every command started through here is appended to a binary
+// trace file as a struct system_trace_record followed by the command line
+// (arguments separated by spaces). Records are written with a single
+// write() to an O_APPEND file, so all the processes of a boot can share
+// the same trace.
+
+#define TRACE_MAX_PENDING 16
+#define TRACE_MAX_COMMAND 1024
+
+static int trace_fd = -1;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+  pid_t pid;
+  unsigned long long start;
+  char command[256];
+} trace_pending[TRACE_MAX_PENDING];
+
+int system_trace_open(const char* file)
+{
+  if (trace_fd>=0) return 0;
+  trace_fd = open(file,O_WRONLY|O_CREAT|O_APPEND,0644);
+  if (trace_fd<0) return -1;
+  fcntl(trace_fd,F_SETFD,FD_CLOEXEC);
+  return 0;
+}
+
+void system_trace_close()
+{
+  if (trace_fd>=0) {
+    close(trace_fd);
+    trace_fd = -1;
+  }
+}
+
+int system_trace_enabled()
+{
+  return trace_fd>=0;
+}
+
+unsigned long long system_trace_now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (unsigned long long)ts.tv_sec*1000000ULL+ts.tv_nsec/1000;
+}
+
+static void trace_write(int type, const char* command, unsigned long long start, int status, int outbytes)
+{
+  char buf[sizeof(struct system_trace_record)+TRACE_MAX_COMMAND];
+  struct system_trace_record* rec = (struct system_trace_record*)buf;
+  int len = strlen(command);
+  if (trace_fd<0) return;
+  if (len>TRACE_MAX_COMMAND) len = TRACE_MAX_COMMAND;
+  rec->type = type;
+  rec->len = len;
+  rec->pid = getpid();
+  rec->start_us = start;
+  rec->duration_us = system_trace_now()-start;
+  rec->status = status;
+  rec->outbytes = outbytes;
+  memcpy(buf+sizeof(*rec),command,len);
+  write(trace_fd,buf,sizeof(*rec)+len);
+}
+
+static void trace_argv(int type, char * const argv[], unsigned long long start, int status, int outbytes)
+{
+  char command[TRACE_MAX_COMMAND+1];
+  int i, l = 0;
+  if (trace_fd<0) return;
+  command[0] = '\0';
+  for (i=0; argv[i] && l<TRACE_MAX_COMMAND; i++) {
+    l += snprintf(command+l,TRACE_MAX_COMMAND+1-l,i?" %s":"%s",argv[i]);
+  }
+  trace_write(type,command,start,status,outbytes);
+}
+
+void system_trace_record(int type, char * const argv[], unsigned long long start, int status)
+{
+  trace_argv(type,argv,start,status,-1);
+}
+
+void system_trace_span(int type, const char* label, unsigned long long start, int status)
+{
+  trace_write(type,label,start,status,-1);
+}
+
+static char trace_stage_name[64];
+static unsigned long long trace_stage_start;
+
+void system_trace_stage(const char* name)
+{
+  unsigned long long now = system_trace_now();
+  if (trace_stage_name[0]) trace_write(SYSTEM_TRACE_STAGE,trace_stage_name,trace_stage_start,0,-1);
+  trace_stage_name[0] = '\0';
+  if (name) {
+    strncpy(trace_stage_name,name,sizeof(trace_stage_name)-1);
+    trace_stage_name[sizeof(trace_stage_name)-1] = '\0';
+    trace_stage_start = now;
+  }
+}
+
+// size of our stdout if it's redirected to a file, which is the case for
+// the logs in init and recovery. -1 otherwise
+static off_t trace_outsize()
+{
+  struct stat s;
+  if (fstat(STDOUT_FILENO,&s) || !S_ISREG(s.st_mode)) return -1;
+  return s.st_size;
+}
+
+static void trace_popen_start(pid_t pid, const char* command)
+{
+  int i;
+  if (trace_fd<0 || pid<=0) return;
+  pthread_mutex_lock(&trace_mutex);
+  for (i=0; i<TRACE_MAX_PENDING; i++) {
+    if (trace_pending[i].pid==0) {
+      trace_pending[i].pid = pid;
+      trace_pending[i].start = system_trace_now();
+      strncpy(trace_pending[i].command,command,255);
+      trace_pending[i].command[255] = '\0';
+      break;
+    }
+  }
+  pthread_mutex_unlock(&trace_mutex);
+}
+
+static void trace_popen_end(pid_t pid, int status)
+{
+  int i;
+  if (trace_fd<0) return;
+  pthread_mutex_lock(&trace_mutex);
+  for (i=0; i<TRACE_MAX_PENDING; i++) {
+    if (trace_pending[i].pid==pid) {
+      trace_write(SYSTEM_TRACE_POPEN,trace_pending[i].command,trace_pending[i].start,status,-1);
+      trace_pending[i].pid = 0;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&trace_mutex);
+}
+
 // This is a popen3 like implementation using file descriptors
-// if fd's are NULL they are not used
+// if fd's are NULL they are not used (the child gets /dev/null)
 // if fd's are not NULL, and they are below 0, they will be created, and the fd will be put back
 // if fd's are not NULL, and they are above 0, they will be used inside the new process, to allow piping
 // flags:
 //   POPEN_JOINSTDERR: joins stdout and stderr
+//
+// popen3 only execs a shell, so it uses vfork, which doesn't copy the address
+// space of the (possibly big) parent. popen3func has to run code inside the
+// child, so that one still needs a real fork. Both run in the caller, so the
+// child sees its current directory and environment.
 
-#define POPEN_JOINSTDERR 1
-static void system_call_func(const char* command)
+static int devnull_fd = -1;
+
+static int get_devnull()
 {
-  execl(_PATH_BSHELL,"sh","-c",command,(char*)NULL);
+  if (devnull_fd<0) {
+    devnull_fd = open("/dev/null",O_RDWR);
+    if (devnull_fd>=0) fcntl(devnull_fd,F_SETFD,FD_CLOEXEC);
+  }
+  return devnull_fd;
 }
 
+// moves the child side fds to stdin, stdout and stderr. Only uses syscalls,
+// so it's safe to call after vfork
+static void spawn_child_setup(const int fds[3])
+{
+  int cfd[3] = { fds[0], fds[1], fds[2] };
+  int i;
+  for (i=0; i<3; i++) {
+    if (cfd[i]<3 && cfd[i]!=i) {
+      // would be overwritten by one of the dup2 calls below
+      int n = fcntl(cfd[i],F_DUPFD,3);
+      int j;
+      for (j=2; j>=i; j--) if (cfd[j]==cfd[i]) cfd[j] = n;
+    }
+  }
+  for (i=0; i<3; i++) {
+    if (cfd[i]==i) {
+      fcntl(i,F_SETFD,0);
+    } else {
+      dup2(cfd[i],i);
+    }
+  }
+  // the caller's fds aren't close-on-exec, a copy left open would keep a
+  // pipe from ever reaching EOF
+  for (i=0; i<3; i++) {
+    if (cfd[i]>2) close(cfd[i]);
+  }
+}
 
-pid_t popen3(int *stdin_fd, int* stdout_fd, int *stderr_fd, int flags, const char * command)
+static pid_t spawn_local(int cfd[3], int pfd[3], const char* command, void (*func)(const char* command))
 {
-  return popen3func(stdin_fd,stdout_fd,stderr_fd,flags,command,system_call_func);
+  pid_t pid;
+  if (func) {
+    pid = fork();
+    if (pid==0) {
+      int i;
+      spawn_child_setup(cfd);
+      for (i=0; i<3; i++) {
+        if (pfd[i]>2) close(pfd[i]);
+      }
+      func(command);
+      _exit(127);
+    }
+  } else {
+    char *argp[] = {"sh", "-c", NULL, NULL};
+    argp[2] = (char *)command;
+    pid = vfork();
+    if (pid==0) {
+      // everything not needed is close-on-exec
+      spawn_child_setup(cfd);
+      execve(_PATH_BSHELL, argp, environ);
+      _exit(127);
+    }
+  }
+  return pid;
 }
 
-pid_t popen3func(int *stdin_fd, int* stdout_fd, int *stderr_fd, int flags, const char * command, void (*func)(const char* command))
+static pid_t spawn3(int *stdin_fd, int* stdout_fd, int *stderr_fd, int flags, const char * command, void (*func)(const char* command))
 {
+  int* fds[3] = { stdin_fd, stdout_fd, stderr_fd };
+  int cfd[3] = { -1, -1, -1 };
+  int pfd[3] = { -1, -1, -1 };
+  int own[3] = { 0, 0, 0 };
+  int i;
   pid_t pid;
-  int stdin_pipe[2];
-  int stdout_pipe[2];
-  int stderr_pipe[2];
 
   if ((flags&POPEN_JOINSTDERR) && stderr_fd) {
     errno = EINVAL;
     return -1;
   }
 
-  if (pipe(stdin_pipe)<0) {
-    return -1;
-  }
-
-  if (pipe(stdout_pipe)<0) {
-    close(stdin_pipe[0]);
-    close(stdin_pipe[1]);
-    return -1;
+  for (i=0; i<3; i++) {
+    if (i==2 && (flags&POPEN_JOINSTDERR)) {
+      cfd[2] = cfd[1];
+    } else if (!fds[i]) {
+      if ((cfd[i] = get_devnull())<0) goto error;
+    } else if (*fds[i]>=0) {
+      cfd[i] = *fds[i];
+      if ((pfd[i] = dup(*fds[i]))<0) goto error;
+      fcntl(pfd[i],F_SETFD,FD_CLOEXEC);
+    } else {
+      int p[2];
+      if (pipe(p)<0) goto error;
+      fcntl(p[0],F_SETFD,FD_CLOEXEC);
+      fcntl(p[1],F_SETFD,FD_CLOEXEC);
+      cfd[i] = i==0 ? p[0] : p[1];
+      pfd[i] = i==0 ? p[1] : p[0];
+      own[i] = 1;
+    }
   }
 
-  if (pipe(stderr_pipe)<0) {
-    close(stdin_pipe[0]);
-    close(stdin_pipe[1]);
-    close(stdout_pipe[0]);
-    close(stdout_pipe[1]);
-    return -1;
-  }
+  pid = spawn_local(cfd,pfd,command,func);
+  if (pid<0) goto error;
 
-  if (flags&POPEN_JOINSTDERR) {
-    dup2(stdout_pipe[0],stderr_pipe[0]);
-    dup2(stdout_pipe[1],stderr_pipe[1]);
-  }
-  switch (pid = fork()) {
-    case -1:
-      close(stdin_pipe[0]);close(stdout_pipe[0]);close(stderr_pipe[0]);
-      close(stdin_pipe[1]);close(stdout_pipe[1]);close(stderr_pipe[1]);
-      return -1;
-    case 0:
-      {
-        close(stdin_pipe[1]);
-        close(stdout_pipe[0]);
-        close(stderr_pipe[0]);
-        if (stdin_fd) {
-          if (*stdin_fd >= 0) {
-            dup2(*stdin_fd,stdin_pipe[0]);
-          }
-          close(*stdin_fd);
-        }
-        if (stdout_fd) {
-          if (*stdout_fd >= 0) {
-            dup2(*stdout_fd,stdout_pipe[1]);
-          }
-          close(*stdout_fd);
-        }
-        if (stderr_fd) {
-          if (*stderr_fd >= 0) {
-            dup2(*stderr_fd,stderr_pipe[1]);
-          }
-          close(*stderr_fd);
-        }
-        if (stdin_pipe[0]!=STDIN_FILENO) {
-          dup2(stdin_pipe[0],STDIN_FILENO);
-          close(stdin_pipe[0]);
-        }
-        if (stdout_pipe[1]!=STDOUT_FILENO) {
-          dup2(stdout_pipe[1],STDOUT_FILENO);
-          close(stdout_pipe[1]);
-        }
-        if (stderr_pipe[1]!=STDERR_FILENO) {
-          dup2(stderr_pipe[1],STDERR_FILENO);
-          close(stderr_pipe[1]);
-        }
-        func(command);
-        _exit(127);
-      }
+  for (i=0; i<3; i++) {
+    if (own[i]) close(cfd[i]);
+    if (fds[i]) *fds[i] = pfd[i];
   }
+  return pid;
 
-  close(stdin_pipe[0]);
-  close(stdout_pipe[1]);
-  close(stderr_pipe[1]);
-  if (stdin_fd) {
-    if (*stdin_fd >= 0) {
-      dup2(*stdin_fd,stdin_pipe[1]);
+error:
+  {
+    int err = errno;
+    for (i=0; i<3; i++) {
+      if (own[i]) close(cfd[i]);
+      if (pfd[i]>=0) close(pfd[i]);
     }
-    *stdin_fd = stdin_pipe[1];
-  } else {
-    close(stdin_pipe[1]);
-  }
-  if (stdout_fd) {
-    if (*stdout_fd >= 0) {
-      dup2(*stdout_fd,stdout_pipe[0]);
-    }
-    *stdout_fd = stdout_pipe[0];
-  } else {
-    close(stdout_pipe[0]);
-  }
-  if (stderr_fd) {
-    if (*stderr_fd >= 0) {
-      dup2(*stderr_fd,stderr_pipe[0]);
-    }
-    *stderr_fd = stderr_pipe[0];
-  } else {
-    close(stderr_pipe[0]);
+    errno = err;
   }
+  return -1;
+}
 
+pid_t popen3(int *stdin_fd, int* stdout_fd, int *stderr_fd, int flags, const char * command)
+{
+  pid_t pid = spawn3(stdin_fd,stdout_fd,stderr_fd,flags,command,NULL);
+  trace_popen_start(pid,command);
+  return pid;
+}
+
+pid_t popen3func(int *stdin_fd, int* stdout_fd, int *stderr_fd, int flags, const char * command, void (*func)(const char* command))
+{
+  pid_t pid = spawn3(stdin_fd,stdout_fd,stderr_fd,flags,command,func);
+  trace_popen_start(pid,command);
   return pid;
 }
 
@@ -217,10 +408,20 @@ int pclose3(pid_t pid, int* stdin_fd, int* stdout_fd, int* stderr_fd, int signal
     p = waitpid(pid, &pstat, 0);
   } while (p == -1 && errno == EINTR);
 
-  return (p == -1 ? -1 : (WIFEXITED(pstat) ? WEXITSTATUS(pstat) : pstat));
+  int ret = (p == -1 ? -1 : (WIFEXITED(pstat) ? WEXITSTATUS(pstat) : pstat));
+  trace_popen_end(pid,ret);
+  return ret;
 }
 
 int sh(char* command) {
-  return call_busybox("sh","-c",command,NULL);
+  unsigned long long start;
+  char *argp[] = {"sh", "-c", NULL, NULL};
+  int ret;
+  if (!system_trace_enabled()) return call_busybox("sh","-c",command,NULL);
+  start = system_trace_now();
+  ret = call_busybox("sh","-c",command,NULL);
+  argp[2] = command;
+  system_trace_record(SYSTEM_TRACE_BUSYBOX,argp,start,ret);
+  return ret;
 }
 
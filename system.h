@@ -5,10 +5,58 @@
 
 #define POPEN_JOINSTDERR 1
 
+// the shell of sh(), popen3() and the scripts
+#ifdef STEAM_HAS_BUSYBOX
+// if busybox is compiled in, use the base app, as that's probably avialable
+#define _PATH_BSHELL "/sbin/steam"
+#else
+// else use a busybox in /sbin. (having busybox there usually has a higher chance than having sh there)
+#define _PATH_BSHELL "/sbin/busybox"
+#endif
+
 int __system(const char *command);
+int __system_argv(char * const argv[]);
 pid_t popen3func(int *stdin_fd, int* stdout_fd, int *stderr_fd, int flags, const char * command, void (*func)(const char* command));
 pid_t popen3(int *stdin_fd, int* stdout_fd, int *stderr_fd, int flags, const char * command);
 int pclose3(pid_t pid, int *stdin_fd, int *stdout_fd, int *stderr_fd, int signal);
 int sh(char* command);
 
+// binary command trace. The file is a list of records, each followed by
+// len bytes of command line
+#define SYSTEM_TRACE_FILE "/tmp/steam.trace"
+
+#define SYSTEM_TRACE_SYSTEM 1
+#define SYSTEM_TRACE_POPEN 2
+#define SYSTEM_TRACE_BUSYBOX 3
+#define SYSTEM_TRACE_NATIVE 4
+// boot profile spans, the command is a label
+#define SYSTEM_TRACE_STAGE 5
+#define SYSTEM_TRACE_MOUNT 6
+#define SYSTEM_TRACE_FSCK 7
+#define SYSTEM_TRACE_SCRIPT 8
+#define SYSTEM_TRACE_MODULE 9
+
+struct system_trace_record {
+  unsigned short type;
+  unsigned short len;
+  int pid;
+  unsigned long long start_us;   // CLOCK_MONOTONIC
+  unsigned long long duration_us;
+  int status;
+  int outbytes;                  // bytes written to our log meanwhile, -1 if unknown
+};
+
+int system_trace_open(const char* file);
+void system_trace_close();
+int system_trace_enabled();
+unsigned long long system_trace_now();
+// records a command that was not run through system.c
+void system_trace_record(int type, char * const argv[], unsigned long long start, int status);
+// records a span from start until now
+void system_trace_span(int type, const char* label, unsigned long long start, int status);
+// ends the current stage of this process and starts the next one. NULL only
+// ends it. Stages started before the trace is opened are kept, and written
+// when they end
+void system_trace_stage(const char* name);
+
 #endif
@@ -0,0 +1,262 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "system.h"
+#include "locale.h"
+#include "trace.h"
+
+#define TRACE_MAX_APPLETS 64
+
+struct trace_entry {
+  struct system_trace_record rec;
+  char* command;
+};
+
+struct trace_applet {
+  char name[32];
+  int count;
+  unsigned long long total_us;
+};
+
+static const char* trace_type_name(int type)
+{
+  switch (type) {
+    case SYSTEM_TRACE_SYSTEM: return "sys";
+    case SYSTEM_TRACE_POPEN: return "pop";
+    case SYSTEM_TRACE_BUSYBOX: return "bb ";
+    case SYSTEM_TRACE_NATIVE: return "nat";
+    case SYSTEM_TRACE_STAGE: return "stg";
+    case SYSTEM_TRACE_MOUNT: return "mnt";
+    case SYSTEM_TRACE_FSCK: return "fsk";
+    case SYSTEM_TRACE_SCRIPT: return "scr";
+    case SYSTEM_TRACE_MODULE: return "mod";
+  }
+  return "???";
+}
+
+// the applet that did the work: the first word of the command, or the first
+// word of the script for "sh -c" calls
+static void trace_applet_name(const char* command, char* name, int len)
+{
+  const char* p = command;
+  const char* e;
+  if (strncmp(p,"sh -c ",6)==0) p += 6;
+  while (*p==' ') p++;
+  e = p;
+  while (*e && *e!=' ') e++;
+  // use the basename of the binary
+  const char* b = p;
+  const char* c;
+  for (c = p; c<e; c++) if (*c=='/') b = c+1;
+  if (e-b>=len) e = b+len-1;
+  memcpy(name,b,e-b);
+  name[e-b] = '\0';
+}
+
+static int compare_duration(const void* a, const void* b)
+{
+  const struct trace_entry* ea = a;
+  const struct trace_entry* eb = b;
+  if (ea->rec.duration_us==eb->rec.duration_us) return 0;
+  return ea->rec.duration_us<eb->rec.duration_us ? 1 : -1;
+}
+
+static int compare_total(const void* a, const void* b)
+{
+  const struct trace_applet* aa = a;
+  const struct trace_applet* ab = b;
+  if (aa->total_us==ab->total_us) return 0;
+  return aa->total_us<ab->total_us ? 1 : -1;
+}
+
+// reads all the records of a trace file. Returns their number, -1 if the
+// file couldn't be opened
+static int load_trace(const char* file, struct trace_entry** pentries)
+{
+  FILE* f = fopen(file,"r");
+  struct trace_entry* entries = NULL;
+  int num = 0, size = 0;
+  if (!f) return -1;
+  for (;;) {
+    struct system_trace_record rec;
+    if (fread(&rec,sizeof(rec),1,f)!=1) break;
+    if (num==size) {
+      struct trace_entry* e;
+      size = size ? size*2 : 256;
+      e = realloc(entries,size*sizeof(*entries));
+      if (!e) break;
+      entries = e;
+    }
+    entries[num].rec = rec;
+    entries[num].command = malloc(rec.len+1);
+    if (!entries[num].command || fread(entries[num].command,1,rec.len,f)!=rec.len) {
+      free(entries[num].command);
+      break;
+    }
+    entries[num].command[rec.len] = '\0';
+    num++;
+  }
+  fclose(f);
+  *pentries = entries;
+  return num;
+}
+
+static void free_trace(struct trace_entry* entries, int num)
+{
+  int i;
+  for (i=0; i<num; i++) free(entries[i].command);
+  free(entries);
+}
+
+static int compare_start(const void* a, const void* b)
+{
+  const struct trace_entry* ea = a;
+  const struct trace_entry* eb = b;
+  if (ea->rec.start_us==eb->rec.start_us) {
+    // the enclosing span first
+    if (ea->rec.duration_us==eb->rec.duration_us) return 0;
+    return ea->rec.duration_us<eb->rec.duration_us ? 1 : -1;
+  }
+  return ea->rec.start_us<eb->rec.start_us ? -1 : 1;
+}
+
+int show_trace(const char* file, int count, void (*print)(const char* fmt, ...))
+{
+  struct trace_entry* entries = NULL;
+  struct trace_applet applets[TRACE_MAX_APPLETS];
+  int num, numapplets = 0;
+  unsigned long long total = 0;
+  int i, j;
+
+  num = load_trace(file,&entries);
+  if (num<0) {
+    print(TRACE_NOFILE,file);
+    return -1;
+  }
+  // only the commands, the boot profile spans overlap them
+  for (i=j=0; i<num; i++) {
+    if (entries[i].rec.type<SYSTEM_TRACE_STAGE) entries[j++] = entries[i];
+    else free(entries[i].command);
+  }
+  num = j;
+
+  for (i=0; i<num; i++) {
+    char name[32];
+    total += entries[i].rec.duration_us;
+    trace_applet_name(entries[i].command,name,sizeof(name));
+    for (j=0; j<numapplets; j++) {
+      if (strcmp(applets[j].name,name)==0) break;
+    }
+    if (j==numapplets) {
+      if (numapplets==TRACE_MAX_APPLETS) continue;
+      strcpy(applets[j].name,name);
+      applets[j].count = 0;
+      applets[j].total_us = 0;
+      numapplets++;
+    }
+    applets[j].count++;
+    applets[j].total_us += entries[i].rec.duration_us;
+  }
+
+  print(TRACE_HEADER,num,(int)(total/1000000),(int)(total/1000%1000));
+  if (num) {
+    qsort(entries,num,sizeof(*entries),compare_duration);
+    print(TRACE_SLOWEST);
+    for (i=0; i<num && i<count; i++) {
+      print("%6llu.%03llu %s %3d %s\n",entries[i].rec.duration_us/1000,entries[i].rec.duration_us%1000,
+        trace_type_name(entries[i].rec.type),entries[i].rec.status,entries[i].command);
+    }
+    qsort(applets,numapplets,sizeof(*applets),compare_total);
+    print(TRACE_BYAPPLET);
+    for (i=0; i<numapplets && i<count; i++) {
+      print("%6llu.%03llu %4d %s\n",applets[i].total_us/1000,applets[i].total_us%1000,
+        applets[i].count,applets[i].name);
+    }
+  }
+
+  free_trace(entries,num);
+  return 0;
+}
+
+int show_timeline(const char* file, unsigned int min_us, void (*print)(const char* fmt, ...))
+{
+  struct trace_entry* entries = NULL;
+  unsigned long long first = 0, last = 0;
+  int num, i;
+
+  num = load_trace(file,&entries);
+  if (num<0) {
+    print(TRACE_NOFILE,file);
+    return -1;
+  }
+  qsort(entries,num,sizeof(*entries),compare_start);
+  for (i=0; i<num; i++) {
+    unsigned long long end = entries[i].rec.start_us+entries[i].rec.duration_us;
+    if (i==0) first = entries[i].rec.start_us;
+    if (end>last) last = end;
+  }
+  print(TRACE_TIMELINE,num,(int)(first/1000000),(int)(first/1000%1000),
+    (int)(last/1000000),(int)(last/1000%1000));
+  print(TRACE_TIMELINE_COLUMNS,min_us/1000);
+  for (i=0; i<num; i++) {
+    struct system_trace_record* rec = &entries[i].rec;
+    int span = rec->type>=SYSTEM_TRACE_STAGE;
+    if (!span && rec->duration_us<min_us) continue;
+    print("%4llu.%03llu %6llu %s %5d %s%s\n",rec->start_us/1000000,rec->start_us/1000%1000,
+      rec->duration_us/1000,trace_type_name(rec->type),rec->pid,
+      rec->type==SYSTEM_TRACE_STAGE ? "" : "  ",entries[i].command);
+  }
+  free_trace(entries,num);
+  return 0;
+}
+
+static void trace_printf(const char* fmt, ...)
+{
+  va_list ap;
+  va_start(ap,fmt);
+  vprintf(fmt,ap);
+  va_end(ap);
+}
+
+int steam_trace_main(int argc, char** argv)
+{
+  int count = 20;
+  int timeline = 0;
+  unsigned int min_ms = 0;
+  const char* file = SYSTEM_TRACE_FILE;
+  int i;
+  for (i=1; i<argc; i++) {
+    if (strcmp(argv[i],"-n")==0 && i+1<argc) {
+      count = atoi(argv[++i]);
+    } else if (strcmp(argv[i],"-t")==0) {
+      timeline = 1;
+    } else if (strcmp(argv[i],"-m")==0 && i+1<argc) {
+      min_ms = atoi(argv[++i]);
+    } else if (argv[i][0]=='-') {
+      printf(TRACE_USAGE);
+      return -1;
+    } else {
+      file = argv[i];
+    }
+  }
+  if (timeline) return show_timeline(file,min_ms*1000,trace_printf) ? 1 : 0;
+  return show_trace(file,count,trace_printf) ? 1 : 0;
+}
@@ -0,0 +1,17 @@
+#ifndef __STEAM_TRACE_H
+#define __STEAM_TRACE_H
+
+// copy of the trace of the last boot, saved at the end of postinit
+#define BOOT_PROFILE_FILE "/cache/steam.boot.trace"
+
+// prints a summary of a command trace created by system.c: the slowest
+// count commands and the time spent in each applet
+// print is either printf like, or ui_print
+int show_trace(const char* file, int count, void (*print)(const char* fmt, ...));
+// prints every record of a trace in order of start time, with the time since
+// boot. Commands shorter than min_us are left out, spans are always shown
+int show_timeline(const char* file, unsigned int min_us, void (*print)(const char* fmt, ...));
+
+int steam_trace_main(int argc, char** argv);
+
+#endif
@@ -0,0 +1,207 @@
+/* Copyright (C) 2010 Zsolt Sz Sztupák
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tweaks.h"
+#include "config.h"
+#include "locale.h"
+
+#define TWEAKS_MAX_PATHS 16
+#define TWEAKS_VALUE_LEN 32
+
+static const Tunable tunables[] = {
+  { "kernelvm",    "swappiness",                  "/proc/sys/vm/swappiness",                     "0",        0, 100 },
+  { "kernelvm",    "dirty_ratio",                 "/proc/sys/vm/dirty_ratio",                    "20",       1, 100 },
+  { "kernelvm",    "vfs_cache_pressure",          "/proc/sys/vm/vfs_cache_pressure",             "100",      1, 10000 },
+  { "kernelvm",    "min_free_kbytes",             "/proc/sys/vm/min_free_kbytes",                "2746",     128, 262144 },
+  { "kernelsched", "sched_latency_ns",            "/proc/sys/kernel/sched_latency_ns",           "20000000", 100000, 1000000000 },
+  { "kernelsched", "sched_min_granularity_ns",    "/proc/sys/kernel/sched_min_granularity_ns",   "1000000",  100000, 1000000000 },
+  { "kernelsched", "sched_wakeup_granularity_ns", "/proc/sys/kernel/sched_wakeup_granularity_ns","2000000",  0, 1000000000 },
+  { "misc",        "dirty_writeback_centisecs",   "/proc/sys/vm/dirty_writeback_centisecs",      "2000",     0, 360000 },
+  { "misc",        "dirty_expire_centisecs",      "/proc/sys/vm/dirty_expire_centisecs",         "1000",     1, 360000 },
+};
+#define TUNABLES (int)(sizeof(tunables)/sizeof(tunables[0]))
+
+static const struct {
+  const char* group;
+  const char* message;
+} groups[] = {
+  { "kernelvm", TWEAKS_ENABLE_KERNELVM },
+  { "kernelsched", TWEAKS_ENABLE_KERNELSCHED },
+  { "misc", TWEAKS_ENABLE_MISC },
+};
+#define GROUPS (int)(sizeof(groups)/sizeof(groups[0]))
+
+// expands the '*' components of pattern. Returns the number of paths
+static int expand_path(const char* pattern, char paths[][PATH_MAX], int num, int max)
+{
+  const char* star = strchr(pattern,'*');
+  char dir[PATH_MAX];
+  const char* slash;
+  const char* rest;
+  int plen, slen;
+  DIR* d;
+  struct dirent* entry;
+  if (num>=max) return num;
+  if (!star) {
+    if (access(pattern,F_OK)==0) strcpy(paths[num++],pattern);
+    return num;
+  }
+  // dir/prefix*suffix/rest
+  for (slash = star; slash>pattern && *slash!='/'; slash--);
+  rest = strchr(star,'/');
+  if (!rest) rest = star+strlen(star);
+  snprintf(dir,sizeof(dir),"%.*s",(int)(slash-pattern),pattern);
+  plen = star-slash-1;
+  slen = rest-star-1;
+  d = opendir(dir[0] ? dir : "/");
+  if (!d) return num;
+  while ((entry = readdir(d)) != NULL && num<max) {
+    char next[PATH_MAX];
+    int nlen = strlen(entry->d_name);
+    if (entry->d_name[0]=='.' || nlen<plen+slen) continue;
+    if (strncmp(entry->d_name,slash+1,plen) || strncmp(entry->d_name+nlen-slen,star+1,slen)) continue;
+    snprintf(next,sizeof(next),"%s/%s%s",dir,entry->d_name,rest);
+    num = expand_path(next,paths,num,max);
+  }
+  closedir(d);
+  return num;
+}
+
+static int read_value(const char* path, char* value, int len)
+{
+  int fd = open(path,O_RDONLY);
+  int r;
+  if (fd<0) return -1;
+  r = read(fd,value,len-1);
+  close(fd);
+  if (r<0) return -1;
+  value[r] = '\0';
+  // only the first line, without the whitespace around it
+  value[strcspn(value,"\n")] = '\0';
+  while (r>0 && (value[r-1]==' ' || value[r-1]=='\t' || value[r-1]=='\n')) value[--r] = '\0';
+  return 0;
+}
+
+static int write_value(const char* path, const char* value)
+{
+  char buf[TWEAKS_VALUE_LEN+1];
+  int fd = open(path,O_WRONLY);
+  int len = snprintf(buf,sizeof(buf),"%s\n",value);
+  int r;
+  if (fd<0) return -1;
+  r = write(fd,buf,len);
+  if (close(fd) && r==len) r = -1;
+  return r==len ? 0 : -1;
+}
+
+// the configured value if it is a number in range, the default otherwise
+static const char* tunable_value(const Tunable* t, char* value)
+{
+  char key[KEY_MAX_LENGTH];
+  char* end;
+  long long v;
+  snprintf(key,sizeof(key),"tweaks.%s.%s",t->group,t->key);
+  if (!get_conf(key,value)) return strcpy(value,t->def);
+  v = strtoll(value,&end,10);
+  if (end==value || *end || v<t->min || v>t->max || strlen(value)>TWEAKS_VALUE_LEN) {
+    printf(TWEAKS_INVALID,value,key,t->def);
+    strcpy(value,t->def);
+  }
+  return value;
+}
+
+int tweaks_apply(const char* group)
+{
+  char values[TUNABLES][VALUE_MAX_LENGTH];
+  int written[TUNABLES];
+  int i, j, failed = 0;
+  // validate everything before touching the kernel
+  for (i=0; i<TUNABLES; i++) {
+    if (strcmp(tunables[i].group,group)==0) tunable_value(&tunables[i],values[i]);
+  }
+  for (i=0; i<TUNABLES; i++) {
+    char paths[TWEAKS_MAX_PATHS][PATH_MAX];
+    int num;
+    written[i] = 0;
+    if (strcmp(tunables[i].group,group)) continue;
+    num = expand_path(tunables[i].path,paths,0,TWEAKS_MAX_PATHS);
+    if (!num) {
+      printf(TWEAKS_MISSING,tunables[i].path);
+      failed++;
+      continue;
+    }
+    for (j=0; j<num; j++) {
+      if (write_value(paths[j],values[i])) {
+        printf(TWEAKS_WRITE_FAILED,paths[j],strerror(errno));
+        break;
+      }
+    }
+    if (j<num) failed++;
+    else written[i] = 1;
+  }
+  // the kernel may clamp or ignore a value without failing the write
+  for (i=0; i<TUNABLES; i++) {
+    char current[TWEAKS_VALUE_LEN+1];
+    if (!written[i]) continue;
+    if (tweaks_read(&tunables[i],current,sizeof(current)) || strcmp(current,values[i])) {
+      printf(TWEAKS_NOT_APPLIED,tunables[i].path,current,values[i]);
+      failed++;
+    }
+  }
+  return failed;
+}
+
+int tweaks_apply_enabled()
+{
+  char value[VALUE_MAX_LENGTH];
+  char key[KEY_MAX_LENGTH];
+  int i, failed = 0;
+  for (i=0; i<GROUPS; i++) {
+    snprintf(key,sizeof(key),"tweaks.%s",groups[i].group);
+    if (strcmp(get_conf_def(key,value,"0"),"1")) continue;
+    printf("%s",groups[i].message);
+    failed += tweaks_apply(groups[i].group);
+  }
+  return failed;
+}
+
+int tweaks_read(const Tunable* t, char* value, int len)
+{
+  char paths[1][PATH_MAX];
+  value[0] = '\0';
+  if (!expand_path(t->path,paths,0,1)) return -1;
+  return read_value(paths[0],value,len);
+}
+
+void tweaks_show(void (*print)(const char* fmt, ...))
+{
+  int i;
+  print(TWEAKS_CURRENT);
+  for (i=0; i<TUNABLES; i++) {
+    char current[TWEAKS_VALUE_LEN+1];
+    char value[VALUE_MAX_LENGTH];
+    if (tweaks_read(&tunables[i],current,sizeof(current))) strcpy(current,"-");
+    print(TWEAKS_CURRENT_VALUE,tunables[i].key,current,tunable_value(&tunables[i],value));
+  }
+}
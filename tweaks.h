@@ -0,0 +1,29 @@
+#ifndef __STEAM_TWEAKS_H
+#define __STEAM_TWEAKS_H
+
+// sysctl / sysfs tunables
+//
+// Each tunable belongs to a group that is switched on with tweaks.<group>=1
+// and takes its value from tweaks.<group>.<key>. A path may contain '*' in
+// one or more of its components, the value is then written to every match
+// (e.g. /sys/devices/system/cpu/cpu*/cpufreq/scaling_governor)
+
+typedef struct {
+  const char* group;
+  const char* key;
+  const char* path;
+  const char* def;
+  long long min, max;   // allowed range of the value
+} Tunable;
+
+// applies every tunable of the group: all values are validated first, then
+// written, then read back. Returns the number of tunables that failed
+int tweaks_apply(const char* group);
+// applies every enabled group, printing the enable message of each
+int tweaks_apply_enabled();
+// current kernel value of the first path of the tunable, -1 if it can't be read
+int tweaks_read(const Tunable* t, char* value, int len);
+// lists the tunables with their current and configured values
+void tweaks_show(void (*print)(const char* fmt, ...));
+
+#endif
@@ -72,6 +72,10 @@ static gr_surface gProgressBarFill;
 static gr_surface gBackgroundSave = NULL;
 
 static int ui_has_initialized = 0;
+// Set while only the boot splash runs: framebuffer and progress bar, without
+// bitmaps, input or log readers. gSplashDirty asks for a redraw
+static int ui_splash_only = 0;
+static int gSplashDirty = 0;
 
 static const struct { gr_surface* surface; const char *name; } BITMAPS[] = {
     { &gBackgroundIcon[BACKGROUND_ICON_INSTALLING], "icon_steam" },
@@ -566,11 +570,37 @@ static void draw_secret(void)
   }
 }
 
+// Draw the boot splash: a progress bar on black, no bitmaps needed.
+// gr_fill takes the corners of the rectangle.
+// Should only be called with gUpdateMutex locked.
+static void draw_splash_locked(void)
+{
+    int width = gr_fb_width() / 2;
+    int dx = (gr_fb_width() - width) / 2;
+    int dy = gr_fb_height() - 4 * CHAR_HEIGHT;
+    float progress = gProgressScopeStart + gProgress * gProgressScopeSize;
+    int pos = (int) (progress * width);
+
+    gr_color(0, 0, 0, 255);
+    gr_fill(0, 0, gr_fb_width(), gr_fb_height());
+    if (gProgressBarType == PROGRESSBAR_TYPE_NONE) return;
+    gr_color(MENU_TEXT_COLOR_BACK);
+    gr_fill(dx, dy, dx + width, dy + CHAR_HEIGHT);
+    if (pos > 0) {
+        gr_color(MENU_TEXT_COLOR);
+        gr_fill(dx, dy, dx + pos, dy + CHAR_HEIGHT);
+    }
+}
+
 // Redraw everything on the screen.  Does not flip pages.
 // Should only be called with gUpdateMutex locked.
 static void draw_screen_locked(void)
 {
     if (!ui_has_initialized) return;
+    if (ui_splash_only) {
+        draw_splash_locked();
+        return;
+    }
     draw_background_locked(gCurrentIcon);
     draw_progress_locked();
 
@@ -686,10 +716,15 @@ static void *ui_thread(void *cookie)
             if (progress > 1.0) progress = 1.0;
             if (progress > gProgress) {
                 gProgress = progress;
+                gSplashDirty = 1;
             }
         }
 
-        update_screen_locked();
+        // the splash only changes with the progress
+        if (!ui_splash_only || gSplashDirty) {
+            gSplashDirty = 0;
+            update_screen_locked();
+        }
         pthread_mutex_unlock(&gUpdateMutex);
     }
     pthread_exit(NULL);
@@ -964,13 +999,31 @@ static void *input_thread(void *cookie)
     return NULL;
 }
 
-// initialize ui
-void ui_init(void)
+// start the boot splash: only the framebuffer and the thread drawing the
+// progress. ui_init() completes it when a menu is needed
+void ui_init_splash(void)
 {
-    int i;
+    if (ui_has_initialized) return;
     gBackgroundSave = NULL;
     ui_has_initialized = 1;
+    ui_splash_only = 1;
+    gSplashDirty = 1;
     gr_init();
+    pt_ui_thread_active = 1;
+    pthread_create(&pt_ui_thread, NULL, ui_thread, NULL);
+}
+
+// initialize ui, or complete the splash started by ui_init_splash
+void ui_init(void)
+{
+    int i;
+    int splash = ui_splash_only;
+    if (ui_has_initialized && !splash) return;
+    if (!splash) {
+        gBackgroundSave = NULL;
+        ui_has_initialized = 1;
+        gr_init();
+    }
     ev_init();
 
 
@@ -1001,12 +1054,19 @@ void ui_init(void)
     memset(mousePos, 0, sizeof(mousePos));
     memset(oldMousePos, 0, sizeof(oldMousePos));
 
-    pt_ui_thread_active = 1;
     pt_input_thread_active = 1;
     pt_logreaders_active = 1;
     activeLog = &logs[TEXTCONTAINER_MAIN];
 
-    pthread_create(&pt_ui_thread, NULL, ui_thread, NULL);
+    if (splash) {
+        // the running ui thread draws the full screen from now on
+        pthread_mutex_lock(&gUpdateMutex);
+        ui_splash_only = 0;
+        pthread_mutex_unlock(&gUpdateMutex);
+    } else {
+        pt_ui_thread_active = 1;
+        pthread_create(&pt_ui_thread, NULL, ui_thread, NULL);
+    }
     pthread_create(&pt_input_thread, NULL, input_thread, NULL);
 
     for (i=1; i<NUM_TEXTCONTAINERS; i++) {
@@ -1023,16 +1083,21 @@ void ui_done(void)
   pt_logreaders_active = 0;
   pt_input_thread_active = 0;
   pt_ui_thread_active = 0;
-  for (i=1; i<NUM_TEXTCONTAINERS; i++) {
-    pthread_join(logreaders[i-1],NULL);
+  if (!ui_splash_only) {
+    for (i=1; i<NUM_TEXTCONTAINERS; i++) {
+      pthread_join(logreaders[i-1],NULL);
+    }
+    pthread_join(pt_input_thread,NULL);
   }
-  pthread_join(pt_input_thread,NULL);
   pthread_join(pt_ui_thread,NULL);
-  draw_background_locked(gCurrentIcon);
-  ev_exit();
+  if (!ui_splash_only) {
+    draw_background_locked(gCurrentIcon);
+    ev_exit();
+  }
   gr_exit();
-  gr_free_surface(gBackgroundSave);
+  if (gBackgroundSave) gr_free_surface(gBackgroundSave);
   gBackgroundSave = NULL;
+  ui_splash_only = 0;
   ui_has_initialized = 0;
 }
 
@@ -1080,6 +1145,7 @@ void ui_show_progress(float portion, int seconds)
     gProgressScopeTime = time(NULL);
     gProgressScopeDuration = seconds;
     gProgress = 0;
+    gSplashDirty = 1;
 //    update_progress_locked();
     pthread_mutex_unlock(&gUpdateMutex);
 }
@@ -1091,10 +1157,11 @@ void ui_set_progress(float fraction)
     if (fraction > 1.0) fraction = 1.0;
     if (gProgressBarType == PROGRESSBAR_TYPE_NORMAL && fraction > gProgress) {
         // Skip updates that aren't visibly different.
-        int width = gr_get_width(gProgressBarIndeterminate[0]);
+        int width = ui_splash_only ? gr_fb_width() / 2 : gr_get_width(gProgressBarIndeterminate[0]);
         float scale = width * gProgressScopeSize;
         if ((int) (gProgress * scale) != (int) (fraction * scale)) {
             gProgress = fraction;
+            gSplashDirty = 1;
 //            update_progress_locked();
         }
     }
@@ -1108,6 +1175,7 @@ void ui_reset_progress()
     gProgressScopeStart = gProgressScopeSize = 0;
     gProgressScopeTime = gProgressScopeDuration = 0;
     gProgress = 0;
+    gSplashDirty = 1;
 //    update_screen_locked();
     pthread_mutex_unlock(&gUpdateMutex);
 }
@@ -36,6 +36,8 @@ extern char TEMPORARY_LOG_FILE[255];
 
 // Initialize and destroy the graphics and events system.
 void ui_init();
+// framebuffer splash with a progress bar only, ui_init() completes it
+void ui_init_splash();
 void ui_done();
 
 // Use KEY_* codes from <linux/input.h> or KEY_DREAM_* from "minui/minui.h".